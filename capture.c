@@ -0,0 +1,303 @@
+/**
+ * Screenshots and gameplay capture to the SD card, see capture.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "capture.h"
+#include "capture_codec.h"
+#include "main.h"
+#include "storage.h"
+
+#include "ff.h"
+#include "f_util.h"
+#include "f_raw_stream.h"
+
+#define SECTOR_SIZE     512
+#define QUEUE_WORDS     (CAPTURE_QUEUE_BYTES / 2)
+#define FRAME_PIXELS    (TB_SCREEN_WIDTH * TB_SCREEN_HEIGHT)
+#define SHOT_BYTES      ((CAPTURE_RECORD_WORDS * 2 + CAPTURE_FRAME_WORDS(FRAME_PIXELS)) * 2)
+
+typedef enum {
+    CAPTURE_IDLE,
+    CAPTURE_RECORDING,
+    CAPTURE_STOPPING,       // waiting for core1 to be out of capture_frame()
+} capture_state_t;
+
+// The queue is word aligned so SDIO can DMA straight from it. prev is the
+// last frame encoded, as the reader will have it.
+static uint32_t queue[CAPTURE_QUEUE_BYTES / 4];
+static uint16_t prev[FRAME_PIXELS];
+
+static struct {
+    volatile capture_state_t state;
+    bool screenshot;
+    char path[32];
+    f_raw_stream_t rs;
+    uint32_t session;
+    uint32_t start_us;
+    uint32_t start_ms;
+
+    // Queue positions in 16 bit words since the start, never wrapped: the
+    // file ends long before they would
+    volatile uint32_t head;         // written by core1
+    volatile uint32_t tail;         // written to the card by core0
+
+    // Core1
+    uint32_t seq;
+    bool key;
+    uint32_t dropped;
+    uint32_t keys;
+    uint32_t cost_us;
+    uint64_t cost_total_us;
+    uint32_t cost_worst_us;
+
+    // Core0
+    uint32_t polls;                 // that wrote something
+    uint64_t write_total_us;
+    uint32_t write_worst_us;
+} capture;
+
+bool capture_active(void) {
+    return capture.state != CAPTURE_IDLE;
+}
+
+// A new file in CAPTURE_DIR, allocated in one piece so it can be streamed
+static bool create_file(FSIZE_t bytes) {
+    FRESULT fr = f_mkdir(CAPTURE_DIR);
+    if (fr != FR_OK && fr != FR_EXIST) {
+        printf("Capture: f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+
+    FILINFO fno;
+    int n;
+    for (n = 0; n < 10000; n++) {
+        snprintf(capture.path, sizeof(capture.path), CAPTURE_DIR "/%s%04d.tbc",
+                 capture.screenshot ? "shot" : "cap", n);
+        if (f_stat(capture.path, &fno) == FR_NO_FILE) break;
+    }
+    if (n == 10000) {
+        printf("Capture: no free file name in " CAPTURE_DIR "\n");
+        return false;
+    }
+
+    FIL fil;
+    fr = f_open(&fil, capture.path, FA_WRITE | FA_CREATE_NEW);
+    if (fr != FR_OK) {
+        printf("Capture: f_open(%s) error: %s (%d)\n", capture.path, FRESULT_str(fr), fr);
+        storage_io_error(fr, to_ms());
+        return false;
+    }
+    fr = f_expand(&fil, bytes, 1);
+    if (fr == FR_OK) fr = f_raw_stream_open(&fil, &capture.rs);
+    FRESULT fr_close = f_close(&fil);
+    if (fr == FR_OK) fr = fr_close;
+    if (fr != FR_OK) {
+        printf("Capture: %s unusable: %s (%d)\n", capture.path, FRESULT_str(fr), fr);
+        f_unlink(capture.path);
+        storage_io_error(fr, to_ms());
+        return false;
+    }
+    return true;
+}
+
+bool capture_start(bool screenshot) {
+    if (capture.state != CAPTURE_IDLE || !storage_mounted()) return false;
+
+    capture.screenshot = screenshot;
+    FSIZE_t bytes = screenshot ? (SHOT_BYTES + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE
+                               : (FSIZE_t)CAPTURE_FILE_MB * 1024 * 1024;
+    if (!create_file(bytes)) return false;
+
+    capture.head = capture.tail = 0;
+    capture.seq = 0;
+    capture.key = true;
+    capture.dropped = capture.keys = 0;
+    capture.cost_us = capture.cost_worst_us = 0;
+    capture.cost_total_us = 0;
+    capture.polls = capture.write_worst_us = 0;
+    capture.write_total_us = 0;
+    capture.start_us = time_us_32();
+    capture.start_ms = to_ms();
+    capture.session = capture.start_us ^ (uint32_t)capture.rs.lba;
+    __dmb();
+    capture.state = CAPTURE_RECORDING;
+    if (!screenshot) printf("Capture: recording to %s\n", capture.path);
+    return true;
+}
+
+void capture_stop(void) {
+    if (capture.state == CAPTURE_RECORDING) capture.state = CAPTURE_STOPPING;
+}
+
+void capture_discard(void) {
+    if (capture.state != CAPTURE_IDLE)
+        printf("Capture: card removed, %s incomplete\n", capture.path);
+    capture.state = CAPTURE_IDLE;
+}
+
+static void put_record(uint32_t pos, uint32_t flags, uint32_t time_us, uint32_t words) {
+    capture_record_t record = {
+        .magic = CAPTURE_MAGIC,
+        .session = capture.session,
+        .seq = capture.seq,
+        .time_us = time_us,
+        .width = TB_SCREEN_WIDTH,
+        .height = TB_SCREEN_HEIGHT,
+        .flags = flags,
+        .words = words,
+    };
+    const uint16_t *src = (const uint16_t *)&record;
+    uint16_t *ring = (uint16_t *)queue;
+    for (uint32_t i = 0; i < CAPTURE_RECORD_WORDS; i++) {
+        ring[pos] = src[i];
+        if (++pos == QUEUE_WORDS) pos = 0;
+    }
+}
+
+void __not_in_flash_func(capture_frame)(void) {
+    if (capture.state != CAPTURE_RECORDING) return;
+    if (capture.screenshot && capture.seq) return;
+
+    uint32_t start = time_us_32();
+    uint32_t head = capture.head;
+    uint32_t space = QUEUE_WORDS - (head - capture.tail);
+    uint32_t words = 0;
+
+    if (space > CAPTURE_RECORD_WORDS) {
+        bool key = capture.key;
+        if (key) memset(prev, 0, sizeof(prev));
+        uint16_t *ring = (uint16_t *)queue;
+        uint32_t pos = (head + CAPTURE_RECORD_WORDS) % QUEUE_WORDS;
+        space -= CAPTURE_RECORD_WORDS;
+        if (frame_palette.bits == 4)
+            words = capture_encode(ring, QUEUE_WORDS, pos, space, prev, frame_buffer_copy, &frame_palette,
+                                   FRAME_PIXELS, 4);
+        else if (frame_palette.bits == 8)
+            words = capture_encode(ring, QUEUE_WORDS, pos, space, prev, frame_buffer_copy, &frame_palette,
+                                   FRAME_PIXELS, 8);
+        else
+            words = capture_encode(ring, QUEUE_WORDS, pos, space, prev, frame_buffer_copy, &frame_palette,
+                                   FRAME_PIXELS, 16);
+
+        // prev was changed on the way: whatever comes next starts over
+        capture.key = !words;
+        if (words) {
+            put_record(head % QUEUE_WORDS, key ? CAPTURE_KEY : 0, start - capture.start_us, words);
+            if (key) capture.keys++;
+            capture.seq++;
+            // The record has to be there before the head says so
+            __dmb();
+            capture.head = head + CAPTURE_RECORD_WORDS + words;
+        }
+    }
+    if (!words) capture.dropped++;
+
+    uint32_t us = time_us_32() - start;
+    capture.cost_us = us;
+    capture.cost_total_us += us;
+    if (us > capture.cost_worst_us) capture.cost_worst_us = us;
+}
+
+uint32_t __not_in_flash_func(capture_cost_us)(void) {
+    return capture.state == CAPTURE_IDLE ? 0 : capture.cost_us;
+}
+
+// Write up to max whole sectors from the queue. Returns false if the card
+// failed.
+static bool write_sectors(uint32_t max, uint32_t now_ms) {
+    uint32_t queued = (capture.head - capture.tail) * 2 / SECTOR_SIZE;
+    if (queued > max) queued = max;
+    while (queued) {
+        uint32_t offset = capture.tail % QUEUE_WORDS * 2;
+        UINT count = (CAPTURE_QUEUE_BYTES - offset) / SECTOR_SIZE;
+        if (count > queued) count = queued;
+        UINT written;
+        FRESULT fr = f_raw_stream_write(&capture.rs, (const uint8_t *)queue + offset, count, &written);
+        if (fr != FR_OK) {
+            printf("Capture: write error: %s (%d), %s abandoned\n", FRESULT_str(fr), fr, capture.path);
+            storage_io_error(fr, now_ms);
+            return false;
+        }
+        if (written < count) {
+            // The file is full: keep what is there
+            printf("Capture: %s full\n", capture.path);
+            if (capture.state == CAPTURE_RECORDING) capture.state = CAPTURE_STOPPING;
+            capture.tail = capture.head;
+            return true;
+        }
+        capture.tail += count * SECTOR_SIZE / 2;
+        queued -= count;
+    }
+    return true;
+}
+
+static void print_stats(void) {
+    uint32_t frames = capture.seq;
+    uint32_t ms = to_ms() - capture.start_ms;
+    uint32_t kb = (uint32_t)(capture.rs.pos * SECTOR_SIZE / 1024);
+    uint32_t attempts = frames + capture.dropped;
+    printf("Capture: %s, %lu frames in %lu.%lu s (%lu.%lu fps), %lu dropped, %lu key frames, %lu KB\n",
+           capture.path, (unsigned long)frames, (unsigned long)(ms / 1000), (unsigned long)(ms / 100 % 10),
+           (unsigned long)(ms ? (uint64_t)frames * 1000 / ms : 0),
+           (unsigned long)(ms ? (uint64_t)frames * 10000 / ms % 10 : 0),
+           (unsigned long)capture.dropped, (unsigned long)capture.keys, (unsigned long)kb);
+    printf("  core1 %lu us per frame, %lu worst; core0 %lu us per write, %lu worst\n",
+           (unsigned long)(attempts ? capture.cost_total_us / attempts : 0),
+           (unsigned long)capture.cost_worst_us,
+           (unsigned long)(capture.polls ? capture.write_total_us / capture.polls : 0),
+           (unsigned long)capture.write_worst_us);
+}
+
+// Core1 is done with the queue: close the capture with an end record,
+// write the rest and shrink the file to it
+static void finish(uint32_t now_ms) {
+    uint32_t head = capture.head;
+    uint32_t space = QUEUE_WORDS - (head - capture.tail);
+    if (space >= CAPTURE_RECORD_WORDS) {
+        put_record(head % QUEUE_WORDS, CAPTURE_END, time_us_32() - capture.start_us, 0);
+        head += CAPTURE_RECORD_WORDS;
+    }
+    // Zeros up to the sector's end
+    uint16_t *ring = (uint16_t *)queue;
+    while (head * 2 % SECTOR_SIZE) ring[head++ % QUEUE_WORDS] = 0;
+    capture.head = head;
+
+    capture.state = CAPTURE_IDLE;
+    if (!write_sectors(UINT32_MAX, now_ms)) return;
+
+    FIL fil;
+    FRESULT fr = f_open(&fil, capture.path, FA_WRITE);
+    if (fr == FR_OK) fr = f_lseek(&fil, (FSIZE_t)capture.rs.pos * SECTOR_SIZE);
+    if (fr == FR_OK) fr = f_truncate(&fil);
+    FRESULT fr_close = f_close(&fil);
+    if (fr == FR_OK) fr = fr_close;
+    if (fr != FR_OK) printf("Capture: could not shrink %s: %s (%d)\n", capture.path, FRESULT_str(fr), fr);
+
+    if (capture.screenshot) printf("Capture: screenshot %s\n", capture.path);
+    else print_stats();
+}
+
+void capture_poll(uint32_t now_ms, bool core1_idle) {
+    if (capture.state == CAPTURE_IDLE) return;
+
+    uint32_t start = time_us_32();
+    uint32_t tail = capture.tail;
+    if (!write_sectors(CAPTURE_SECTORS_PER_POLL, now_ms)) {
+        capture.state = CAPTURE_IDLE;
+        return;
+    }
+    if (capture.tail != tail) {
+        uint32_t us = time_us_32() - start;
+        capture.polls++;
+        capture.write_total_us += us;
+        if (us > capture.write_worst_us) capture.write_worst_us = us;
+    }
+
+    if (capture.state == CAPTURE_RECORDING && capture.screenshot && capture.seq)
+        capture.state = CAPTURE_STOPPING;
+    if (capture.state == CAPTURE_STOPPING && core1_idle) finish(now_ms);
+}
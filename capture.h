@@ -0,0 +1,61 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Screenshots and gameplay capture to the SD card (TINYBIT_CAPTURE).
+//
+// Core1 encodes each frame it sent, from frame_buffer_copy before it lets
+// core0 have the buffer back, as a delta against the frame before
+// (capture_codec.h) into a RAM queue. Core0 writes whole sectors from the
+// queue to a preallocated, contiguous file in /captures with
+// f_raw_stream_write(), at most CAPTURE_SECTORS_PER_POLL per pass of the
+// frame loop. Neither waits for the other: a frame that does not fit in
+// the queue is dropped, and the one after goes as a key frame.
+//
+// Starting a capture creates the file and stopping one shrinks it to what
+// was written; both use FatFs and take a moment. A screenshot is a capture
+// of one frame. The capture's frame rate and what it cost on each core are
+// printed when it stops. tools/capture_convert.py turns captures into PNG
+// or GIF.
+
+#ifndef CAPTURE
+#define CAPTURE 0
+#endif
+
+#define CAPTURE_DIR                 "/captures"
+#define CAPTURE_FILE_MB             64      // longest capture
+#define CAPTURE_QUEUE_BYTES         (80 * 512)  // holds a key frame
+#define CAPTURE_SECTORS_PER_POLL    16
+
+#if CAPTURE
+
+// Core0. screenshot captures a single frame and stops.
+bool capture_start(bool screenshot);
+void capture_stop(void);
+bool capture_active(void);
+// Once per pass of the frame loop. core1_idle: frame_ready is clear, so
+// core1 is not encoding.
+void capture_poll(uint32_t now_ms, bool core1_idle);
+// The card has gone away: drop the capture
+void capture_discard(void);
+
+// Core1: after sending a frame, while frame_ready is still set. The time
+// it took is part of core1's present time.
+void capture_frame(void);
+uint32_t capture_cost_us(void);
+
+#else
+
+static inline bool capture_start(bool screenshot) { (void)screenshot; return false; }
+static inline void capture_stop(void) {}
+static inline bool capture_active(void) { return false; }
+static inline void capture_poll(uint32_t now_ms, bool core1_idle) { (void)now_ms; (void)core1_idle; }
+static inline void capture_discard(void) {}
+static inline void capture_frame(void) {}
+static inline uint32_t capture_cost_us(void) { return 0; }
+
+#endif
+
+#endif // CAPTURE_H
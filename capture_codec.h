@@ -0,0 +1,136 @@
+#ifndef CAPTURE_CODEC_H
+#define CAPTURE_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "lcd_palette.h"
+
+// Capture file format (TINYBIT_CAPTURE, see capture.h).
+//
+// A capture is a run of records back to back, each a capture_record_t and
+// its frame as 16 bit words, padded to a whole 32 bit word. All little
+// endian. Frames are RGBA4444 in the framebuffer's layout with alpha 0,
+// whether they went to core1 as pixels or as palette indices.
+//
+// Each pixel is XORed with the same pixel of the frame before, or with 0
+// in a key frame, and the XORed words are run length coded:
+//
+//   0x8000 | n, v      n copies of v, n from 1 to 32767
+//   n, v1 ... vn       n words as they are
+//   0                  nothing, for padding
+//
+// so pixels that did not change cost a run of 0. A record with
+// CAPTURE_END and no words closes the capture. Readers stop at the first
+// record with the wrong magic, session or sequence number: the file may
+// be longer than the capture, over stale data.
+//
+// Header only, like lcd_palette.h: core1 inlines the encoder, and
+// tools/capture_check.c runs it on the host.
+
+#define CAPTURE_MAGIC       0x50434254  // "TBCP"
+#define CAPTURE_KEY         0x0001      // against 0, not the frame before
+#define CAPTURE_END         0x0002
+#define CAPTURE_RUN         0x8000
+#define CAPTURE_MAX_COUNT   0x7fff
+
+typedef struct {
+    uint32_t magic;
+    uint32_t session;       // the same in every record of a capture
+    uint32_t seq;           // 0 for the first record
+    uint32_t time_us;       // since the capture started
+    uint16_t width, height;
+    uint16_t flags;
+    uint16_t reserved;
+    uint32_t words;         // 16 bit words that follow, even
+} capture_record_t;
+
+#define CAPTURE_RECORD_WORDS    (sizeof(capture_record_t) / 2)
+
+// Most 16 bit words a frame of count pixels can take: no token costs more
+// than the pixels it covers, plus a literal count for each 32767 of them
+// and the padding
+#define CAPTURE_FRAME_WORDS(count)  ((count) + (count) / CAPTURE_MAX_COUNT + 2)
+
+static inline uint16_t capture_pixel(const uint8_t *frame, const lcd_palette_t *palette, int i, int bits) {
+    if (bits == 16) return ((const uint16_t *)frame)[i] & 0xf0ff;
+    return palette->colours[lcd_palette_at(frame, i, bits)];
+}
+
+// Encode count pixels of frame, with bits per pixel as in palette->bits,
+// against prev into ring (size words) from pos, and make prev the frame.
+// Returns the words written, or 0 if that would be more than space;
+// prev is then partly updated and the next frame has to be a key frame.
+// Pass bits as a constant so each format gets its own loop.
+static inline __attribute__((always_inline)) uint32_t capture_encode(uint16_t *ring, uint32_t size, uint32_t pos,
+                                                                     uint32_t space, uint16_t *prev,
+                                                                     const uint8_t *frame,
+                                                                     const lcd_palette_t *palette, int count,
+                                                                     int bits) {
+    uint32_t n = 0;
+    uint32_t literal = 0, literal_at = 0;   // the open literal, 0 for none
+    uint16_t pixel = capture_pixel(frame, palette, 0, bits);
+
+    for (int i = 0; i < count;) {
+        uint16_t v = pixel ^ prev[i];
+        int run = 1;
+        if (bits == 16 && !v) {
+            // Unchanged pixels, most of a frame: two at a time
+            const uint16_t *pixels = (const uint16_t *)frame;
+            int j = i + 1, end = count - i > CAPTURE_MAX_COUNT ? i + CAPTURE_MAX_COUNT : count;
+            if ((j & 1) && j < end && (pixels[j] & 0xf0ff) == prev[j]) j++;
+            if (!(j & 1)) {
+                uint32_t a, b;
+                while (j + 2 <= end) {
+                    memcpy(&a, &pixels[j], 4);
+                    memcpy(&b, &prev[j], 4);
+                    if ((a & 0xf0fff0ff) != b) break;
+                    j += 2;
+                }
+            }
+            run = j - i;
+        }
+        while (i + run < count) {
+            pixel = capture_pixel(frame, palette, i + run, bits);
+            if ((uint16_t)(pixel ^ prev[i + run]) != v || run == CAPTURE_MAX_COUNT) break;
+            run++;
+        }
+
+        if (run >= 3) {
+            if (n + 2 > space) return 0;
+            literal = 0;
+            ring[pos] = CAPTURE_RUN | run;
+            if (++pos == size) pos = 0;
+            ring[pos] = v;
+            if (++pos == size) pos = 0;
+            n += 2;
+        } else {
+            // One or two pixels: cheaper in a literal
+            for (int k = 0; k < run; k++) {
+                if (n + 2 > space) return 0;
+                if (!literal) {
+                    literal_at = pos;
+                    if (++pos == size) pos = 0;
+                    n++;
+                }
+                ring[pos] = v;
+                if (++pos == size) pos = 0;
+                n++;
+                ring[literal_at] = ++literal;
+                if (literal == CAPTURE_MAX_COUNT) literal = 0;
+            }
+        }
+        if (v)
+            for (int k = 0; k < run; k++) prev[i + k] ^= v;
+        i += run;
+    }
+
+    if (n & 1) {
+        if (n == space) return 0;
+        ring[pos] = 0;
+        n++;
+    }
+    return n;
+}
+
+#endif // CAPTURE_CODEC_H
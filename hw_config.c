@@ -30,8 +30,10 @@ static spi_t spi = {
     .miso_gpio = 12,
     //.baud_rate = 125 * 1000 * 1000 / 8  // 15625000 Hz
     //.baud_rate = 125 * 1000 * 1000 / 6  // 20833333 Hz
-    .baud_rate = 125 * 1000 * 1000 / 4  // 31250000 Hz
+    //.baud_rate = 125 * 1000 * 1000 / 4  // 31250000 Hz
     //.baud_rate = 125 * 1000 * 1000 / 2  // 62500000 Hz
+    // Capped at 25 MHz unless the card switches to High Speed
+    .baud_rate = 50 * 1000 * 1000
 };
 
 /* SPI Interface */
@@ -48,7 +50,8 @@ static sd_card_t sd_card = {
 
 /* ********************************************************************** */
 
-size_t sd_get_num() { return 1; }
+// Both are called from the SDIO DMA interrupt for every block
+size_t __not_in_flash_func(sd_get_num)() { return 1; }
 
 /**
  * @brief Get a pointer to an SD card object by its number.
@@ -57,7 +60,7 @@ size_t sd_get_num() { return 1; }
  *
  * @return A pointer to the SD card object, or @c NULL if the number is invalid.
  */
-sd_card_t *sd_get_by_num(size_t num) {
+sd_card_t *__not_in_flash_func(sd_get_by_num)(size_t num) {
     if (0 == num) {
         // The number 0 is a valid SD card number.
         // Return a pointer to the sd_card object.
@@ -25,6 +25,7 @@ static uint32_t* active_dma_buffer = conversion_buffer_a;  // Buffer DMA reads f
 static uint32_t* fill_buffer = conversion_buffer_b;        // Buffer CPU writes to
 static volatile bool cpu_buffer_full = false;             // New data ready to swap
 static uint32_t current_sample_count = 0;
+static volatile uint32_t underruns = 0;                   // DMA finished with no new buffer
 
 void i2s_out_program_init(PIO pio, uint sm, uint offset, uint din_pin, uint bclk_pin, uint sample_rate) {
     uint lrclk_pin = bclk_pin + 1; // LRCLK must be adjacent to BCLK
@@ -60,9 +61,13 @@ void i2s_out_program_init(PIO pio, uint sm, uint offset, uint din_pin, uint bclk
 }
 
 // DMA interrupt handler - swap buffers when transfer completes
-static void i2s_dma_irq_handler(void) {
+static void __not_in_flash_func(i2s_dma_irq_handler)(void) {
     dma_channel_acknowledge_irq0(i2s_dma_channel);
 
+    // Nothing new queued: the fill buffer goes out again, half written
+    if (!cpu_buffer_full)
+        underruns++;
+
     // Swap buffers
     uint32_t* temp = active_dma_buffer;
     active_dma_buffer = fill_buffer;
@@ -110,7 +115,26 @@ void i2s_init(void) {
     pio_sm_set_enabled(i2s_pio, i2s_sm, true);
 }
 
-void i2s_queue_samples() {
+uint32_t __not_in_flash_func(i2s_underruns)(void) {
+    return underruns;
+}
+
+uint32_t __not_in_flash_func(i2s_queued_us)(void) {
+    uint32_t samples = 0;
+    if (dma_channel_is_busy(i2s_dma_channel))
+        samples = dma_hw->ch[i2s_dma_channel].transfer_count & DMA_CH0_TRANS_COUNT_COUNT_BITS;
+    if (cpu_buffer_full)
+        samples += TB_AUDIO_FRAME_SAMPLES;
+    // In 32 bits: a 64 bit divide calls __aeabi_uldivmod, which is in
+    // flash. samples is at most two buffers, far below the 107374 where
+    // this overflows.
+#if I2S_SAMPLE_RATE % 25
+    #error "i2s_queued_us() needs I2S_SAMPLE_RATE to be a multiple of 25"
+#endif
+    return samples * (1000000 / 25) / (I2S_SAMPLE_RATE / 25);
+}
+
+void __not_in_flash_func(i2s_queue_samples)() {
 
     // wait for second buffer to be free if we're still processing the previous one
     // since this task runs in the main loop, fps is limited to audio playback
@@ -20,4 +20,11 @@
 void i2s_init(void);
 void i2s_queue_samples(void);
 
+// Buffers the DMA ran out on since boot: each one is a glitch
+uint32_t i2s_underruns(void);
+
+// Audio still to play, queued buffer included: how long core0 can go
+// without queueing more before the DMA runs out
+uint32_t i2s_queued_us(void);
+
 #endif // I2S_H
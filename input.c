@@ -0,0 +1,85 @@
+/**
+ * Button sampling and debouncing, see input.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "main.h"
+#include "input.h"
+#include "input_debounce.h"
+
+static const struct {
+    uint8_t button, pin;
+} buttons[] = {
+    { TB_BUTTON_A, 17 },
+    { TB_BUTTON_B, 16 },
+    { TB_BUTTON_UP, 21 },
+    { TB_BUTTON_DOWN, 19 },
+    { TB_BUTTON_LEFT, 18 },
+    { TB_BUTTON_RIGHT, 20 },
+};
+#define BUTTONS (sizeof(buttons) / sizeof(buttons[0]))
+
+static input_debounce_t debounce;
+static uint32_t pins_mask;
+static uint alarm;
+static uint32_t next_sample_us;
+
+static void __not_in_flash_func(input_alarm_irq_handler)(void) {
+    timer_hw->intr = 1u << alarm;
+    uint32_t now = time_us_32();
+    input_debounce_sample(&debounce, gpio_get_all(), now);
+
+    // On the sampling grid; if an interrupt held this one up past the next
+    // sample, start a new grid rather than set an alarm that has passed
+    next_sample_us += INPUT_SAMPLE_US;
+    if ((int32_t)(next_sample_us - now) < INPUT_SAMPLE_US / 4) next_sample_us = now + INPUT_SAMPLE_US;
+    timer_hw->alarm[alarm] = next_sample_us;
+}
+
+void input_init(void) {
+    for (size_t i = 0; i < BUTTONS; i++) pins_mask |= 1u << buttons[i].pin;
+    gpio_init_mask(pins_mask);
+    gpio_set_dir_in_masked(pins_mask);
+    input_debounce_init(&debounce, pins_mask, gpio_get_all());
+
+    alarm = hardware_alarm_claim_unused(true);
+    irq_set_exclusive_handler(hardware_alarm_get_irq_num(alarm), input_alarm_irq_handler);
+    hw_set_bits(&timer_hw->inte, 1u << alarm);
+    irq_set_enabled(hardware_alarm_get_irq_num(alarm), true);
+    next_sample_us = time_us_32() + INPUT_SAMPLE_US;
+    timer_hw->alarm[alarm] = next_sample_us;
+}
+
+uint32_t __not_in_flash_func(input_poll)(void) {
+    uint32_t pins = input_debounce_frame(&debounce, time_us_32());
+    uint32_t pressed = 0;
+    for (size_t i = 0; i < BUTTONS; i++)
+        if (pins >> buttons[i].pin & 1) pressed |= 1u << buttons[i].button;
+    return pressed;
+}
+
+void input_dump(void) {
+    // Copied with the alarm off so the counters go together
+    irq_set_enabled(hardware_alarm_get_irq_num(alarm), false);
+    input_stats_t s = debounce.stats;
+    irq_set_enabled(hardware_alarm_get_irq_num(alarm), true);
+
+    printf("input: %d ms debounce, sampled every %d us\n",
+           INPUT_DEBOUNCE_SAMPLES * INPUT_SAMPLE_US / 1000, INPUT_SAMPLE_US);
+    printf("  presses %lu (%lu shorter than a frame), bounces rejected %lu, queue overflows %lu\n",
+           (unsigned long)s.presses, (unsigned long)s.short_presses, (unsigned long)s.bounces,
+           (unsigned long)s.overflows);
+    printf("  press to frame: mean %lu us, worst %lu us\n",
+           (unsigned long)(s.latency_count ? s.latency_total_us / s.latency_count : 0),
+           (unsigned long)s.latency_worst_us);
+}
+
+void input_reset(void) {
+    irq_set_enabled(hardware_alarm_get_irq_num(alarm), false);
+    memset(&debounce.stats, 0, sizeof(debounce.stats));
+    irq_set_enabled(hardware_alarm_get_irq_num(alarm), true);
+}
@@ -0,0 +1,22 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+// Buttons. A timer alarm interrupt on core0 reads all six with one
+// gpio_get_all() every INPUT_SAMPLE_US, debounces them and queues each
+// press and release with the time it started (input_debounce.h).
+// tinybit_poll_input() takes the queue once per frame: a button reads
+// pressed for a frame if it was down at any point since the last one, so
+// taps shorter than a frame are not lost, and bounce does not make a
+// double tap. The buttons are active high.
+
+void input_init(void);
+// Once per frame: bit b set for TB_BUTTON b pressed
+uint32_t input_poll(void);
+// Presses, rejected bounces, taps shorter than a frame, and how long
+// presses took to reach a frame
+void input_dump(void);
+void input_reset(void);
+
+#endif // INPUT_H
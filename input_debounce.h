@@ -0,0 +1,145 @@
+#ifndef INPUT_DEBOUNCE_H
+#define INPUT_DEBOUNCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Button debouncing for input.c.
+//
+// A timer interrupt reads all the GPIOs at once every INPUT_SAMPLE_US and
+// hands the word to input_debounce_sample(). Each pin in the mask has an
+// integrator: it counts up on samples that read pressed and down on ones
+// that read released, and the pin only changes state when it reaches
+// INPUT_DEBOUNCE_SAMPLES or 0. Contact bounce and spikes shorter than that
+// never get there. Each change goes into an event queue with the time the
+// integrator left its rail, the first sample of the change.
+//
+// Once per frame input_debounce_frame() empties the queue. A button
+// pressed at any point since the last frame reads pressed for this one,
+// so a press that starts and ends between two frames is still seen, and
+// released on the next.
+//
+// The interrupt and the frame loop run on the same core: the queue needs
+// no more than volatile positions. Header only, like pacing.h, so
+// tools/input_sim.c can run it on synthetic bounce patterns.
+
+#define INPUT_SAMPLE_US         1000
+#define INPUT_DEBOUNCE_SAMPLES  4       // net samples for a change, 4 ms
+#define INPUT_QUEUE_SIZE        32      // power of 2
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t pin;
+    bool pressed;
+} input_event_t;
+
+typedef struct {
+    uint32_t presses;
+    uint32_t bounces;       // integrator went back without a change
+    uint32_t short_presses; // pressed and released between two frames
+    uint32_t overflows;     // events lost to a full queue
+    uint32_t latency_count; // presses seen by a frame, and how late
+    uint64_t latency_total_us;
+    uint32_t latency_worst_us;
+} input_stats_t;
+
+typedef struct {
+    uint32_t mask;          // pins sampled
+    volatile uint32_t state;    // debounced, 1 for pressed
+    uint32_t moving;        // integrator off its rail
+    uint8_t count[32];      // 0 released .. INPUT_DEBOUNCE_SAMPLES pressed
+    uint32_t since_us[32];  // when the integrator left its rail
+    input_event_t events[INPUT_QUEUE_SIZE];
+    volatile uint32_t head; // written by the interrupt
+    volatile uint32_t tail;
+    input_stats_t stats;
+} input_debounce_t;
+
+// raw: a first sample, taken as settled
+static inline void input_debounce_init(input_debounce_t *d, uint32_t mask, uint32_t raw) {
+    memset(d, 0, sizeof(*d));
+    d->mask = mask;
+    d->state = raw & mask;
+    for (int pin = 0; pin < 32; pin++)
+        if (d->state >> pin & 1) d->count[pin] = INPUT_DEBOUNCE_SAMPLES;
+}
+
+static inline void input_debounce_push(input_debounce_t *d, int pin, bool pressed, uint32_t time_us) {
+    uint32_t head = d->head;
+    if (head - d->tail == INPUT_QUEUE_SIZE) {
+        d->stats.overflows++;
+        return;
+    }
+    d->events[head & (INPUT_QUEUE_SIZE - 1)] = (input_event_t){ time_us, (uint8_t)pin, pressed };
+    d->head = head + 1;
+}
+
+// The interrupt: raw is gpio_get_all(), 1 for pressed
+static inline void input_debounce_sample(input_debounce_t *d, uint32_t raw, uint32_t now_us) {
+    uint32_t state = d->state;
+    // Only pins that read differently or are still settling have work
+    uint32_t active = ((raw ^ state) | d->moving) & d->mask;
+    while (active) {
+        int pin = __builtin_ctz(active);
+        uint32_t bit = 1u << pin;
+        active &= active - 1;
+
+        int count = d->count[pin];
+        if (!(d->moving & bit)) {
+            d->moving |= bit;
+            d->since_us[pin] = now_us;
+        }
+        if (raw & bit) {
+            if (count < INPUT_DEBOUNCE_SAMPLES) count++;
+        } else if (count > 0) {
+            count--;
+        }
+        d->count[pin] = count;
+
+        if (count == (state & bit ? 0 : INPUT_DEBOUNCE_SAMPLES)) {
+            state ^= bit;
+            d->moving &= ~bit;
+            input_debounce_push(d, pin, state & bit, d->since_us[pin]);
+        } else if (count == (state & bit ? INPUT_DEBOUNCE_SAMPLES : 0)) {
+            d->moving &= ~bit;
+            d->stats.bounces++;
+        }
+    }
+    d->state = state;
+}
+
+static inline bool input_debounce_next(input_debounce_t *d, input_event_t *e) {
+    uint32_t tail = d->tail;
+    if (tail == d->head) return false;
+    *e = d->events[tail & (INPUT_QUEUE_SIZE - 1)];
+    d->tail = tail + 1;
+    return true;
+}
+
+// Once per frame: the pins that read pressed for it. Empties the queue.
+static inline uint32_t input_debounce_frame(input_debounce_t *d, uint32_t now_us) {
+    uint32_t pressed = 0, released = 0;
+    input_event_t e;
+    while (input_debounce_next(d, &e)) {
+        uint32_t bit = 1u << e.pin;
+        if (e.pressed) {
+            pressed |= bit;
+            d->stats.presses++;
+            uint32_t late = now_us - e.time_us;
+            d->stats.latency_count++;
+            d->stats.latency_total_us += late;
+            if (late > d->stats.latency_worst_us) d->stats.latency_worst_us = late;
+        } else if (pressed & bit) {
+            released |= bit;
+        }
+    }
+    uint32_t state = d->state;
+    // Not __builtin_popcount(): that is a libgcc call in flash on the M33,
+    // and there are only a few buttons
+    for (uint32_t shorts = released & ~state; shorts; shorts &= shorts - 1)
+        d->stats.short_presses++;
+    return state | pressed;
+}
+
+#endif // INPUT_DEBOUNCE_H
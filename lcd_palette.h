@@ -0,0 +1,85 @@
+#ifndef LCD_PALETTE_H
+#define LCD_PALETTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Indexed frames for the LCD (TINYBIT_LCD_INDEXED).
+//
+// Most cartridges draw with a handful of colours. When a frame has at most
+// 256, core0 copies it for core1 as 8 bit indices into a palette, and as 4
+// bit indices when it has at most 16: 16 or 8 KB instead of 32, and core1
+// converts each palette entry once per frame instead of every pixel. With
+// more colours the frame goes over as plain RGBA4444.
+//
+// Alpha is dropped: the LCD never shows it (lcd_pixel.h), so colours that
+// only differ in alpha share an entry.
+
+#define LCD_PALETTE_SIZE    256
+
+typedef struct {
+    uint16_t bits;          // per pixel: 4 or 8 for indices, 16 for RGBA4444
+    uint16_t count;         // colours in use
+    uint16_t colours[LCD_PALETTE_SIZE];     // framebuffer layout, alpha 0
+} lcd_palette_t;
+
+// Where each colour went in the last frames: a frame stamp and the index
+// the colour got, so the table never needs clearing for a new frame. Keep
+// one between calls, zeroed before the first.
+typedef struct {
+    uint16_t slots[4096];
+    uint8_t stamp;
+} lcd_palette_map_t;
+
+// Colour without alpha as a 12 bit number, to look up in a 4096 entry table
+static inline uint32_t lcd_palette_key(uint16_t pixel) {
+    return (pixel & 0xff) | ((pixel >> 4) & 0xf00);
+}
+
+// Index of pixel x in a row of 4 or 8 bit indices. 4 bit rows have the
+// first pixel of each pair in the high nibble.
+static inline uint32_t lcd_palette_at(const uint8_t *row, int x, int bits) {
+    return bits == 8 ? row[x] : (row[x >> 1] >> (~x & 1) * 4) & 0x0f;
+}
+
+// Index the pixels of a frame into out, with the palette in palette, and
+// return true; or return false if the frame has more than
+// LCD_PALETTE_SIZE colours, leaving out partly written and the palette
+// undefined. count must be even.
+static inline __attribute__((always_inline)) bool lcd_palette_index(lcd_palette_t *palette, uint8_t *out,
+                                                                    const uint16_t *pixels, int count,
+                                                                    lcd_palette_map_t *map) {
+    uint16_t *slots = map->slots;
+    if (++map->stamp == 0) {
+        memset(slots, 0, sizeof(map->slots));
+        map->stamp = 1;
+    }
+    uint32_t mark = (uint32_t)map->stamp << 8;
+    uint32_t colours = 0;
+
+    for (int i = 0; i < count; i++) {
+        uint16_t pixel = pixels[i];
+        uint32_t key = lcd_palette_key(pixel);
+        uint32_t slot = slots[key];
+        if ((slot & 0xff00) != mark) {
+            if (colours == LCD_PALETTE_SIZE) return false;
+            palette->colours[colours] = pixel & 0xf0ff;
+            slot = mark | colours++;
+            slots[key] = slot;
+        }
+        out[i] = slot;
+    }
+
+    palette->count = colours;
+    palette->bits = 8;
+    if (colours <= 16) {
+        // Pack in place: each pair is read before its byte is written
+        for (int i = 0; i < count; i += 2)
+            out[i >> 1] = out[i] << 4 | out[i + 1];
+        palette->bits = 4;
+    }
+    return true;
+}
+
+#endif // LCD_PALETTE_H
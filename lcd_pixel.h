@@ -0,0 +1,52 @@
+#ifndef LCD_PIXEL_H
+#define LCD_PIXEL_H
+
+#include <stdint.h>
+
+// Pixel conversion from the TinyBit framebuffer to the ST7789 bus formats.
+//
+// Framebuffer pixels are RGBA4444 in a uint16_t laid out as
+// 0xBARG: red in bits 4-7, green in bits 0-3, alpha in bits 8-11 and
+// blue in bits 12-15.
+
+// RGB565 (COLMOD 0x55), sent high byte first. The 4-bit channels are left
+// justified in their 5 and 6 bit fields.
+static inline uint16_t lcd_rgb565(uint16_t pixel) {
+    uint16_t r = (pixel >> 4) & 0x0f;
+    uint16_t g = pixel & 0x0f;
+    uint16_t b = pixel >> 12;
+    return (r << 12) | (g << 7) | (b << 1);
+}
+
+// RGB444 (COLMOD 0x53): two pixels in three bytes, R0G0 B0R1 G1B1. The
+// first byte is the framebuffer's low byte as it is.
+static inline void lcd_pack_rgb444(uint8_t *dest, uint16_t p0, uint16_t p1) {
+    dest[0] = p0 & 0xff;
+    dest[1] = ((p0 >> 8) & 0xf0) | ((p1 >> 4) & 0x0f);
+    dest[2] = (p1 << 4) | (p1 >> 12);
+}
+
+// For filtering (lcd_scale.h): the channels spread out as 0xRR?GG?BB, each
+// channel as 4.4 fixed point in 8 bits, with 4 bits under red and green
+// for the fraction a blend of blends leaves. The interpolator can blend
+// two of these as one integer, twice over, and nothing carries from one
+// channel into the next.
+static inline uint32_t lcd_rgb_spread(uint16_t pixel) {
+    return ((uint32_t)(pixel & 0xf0) << 24) | ((uint32_t)(pixel & 0x0f) << 16) | ((pixel >> 8) & 0xf0);
+}
+
+// RGB565 from lcd_rgb_spread() values and blends of them, rounded. Gives
+// the same as lcd_rgb565() for unblended pixels.
+static inline uint16_t lcd_spread_to_565(uint32_t v) {
+    v += 0x04002004;
+    return ((v >> 16) & 0xf800) | ((v >> 9) & 0x07e0) | ((v >> 3) & 0x001f);
+}
+
+// Back to framebuffer layout with alpha 0, rounded to 4 bits, for
+// lcd_pack_rgb444()
+static inline uint16_t lcd_spread_to_fb(uint32_t v) {
+    v += 0x08008008;
+    return ((v >> 24) & 0xf0) | ((v >> 16) & 0x0f) | ((v << 8) & 0xf000);
+}
+
+#endif // LCD_PIXEL_H
@@ -0,0 +1,68 @@
+#ifndef LCD_SCALE_H
+#define LCD_SCALE_H
+
+#include <stdint.h>
+
+// Filtered scaling from the framebuffer to the panel.
+//
+// Nearest neighbour scaling by 240/128 makes every source pixel one or two
+// panel pixels wide, which shimmers when things scroll. The filtered modes
+// blend the two nearest source pixels on each axis instead:
+//
+// - bilinear: plain linear blend, soft but even.
+// - sharp: flat inside each source pixel and a one panel pixel ramp
+//   between neighbours (the "sharp bilinear" shader), so edges stay crisp
+//   and all pixels look the same width.
+//
+// lcd_scale_taps() computes where each output pixel samples on one axis.
+// The blend weight has 1/16 steps, enough for 4 bit channels, and keeps
+// interpolator blends of lcd_rgb_spread() values exact (lcd_pixel.h).
+
+typedef enum {
+    LCD_SCALE_NEAREST,
+    LCD_SCALE_BILINEAR,
+    LCD_SCALE_SHARP,
+    LCD_SCALE_MODES
+} lcd_scale_t;
+
+static const char *const lcd_scale_names[LCD_SCALE_MODES] = { "nearest", "bilinear", "sharp" };
+
+// Output pixel = src[index] blended towards src[index + 1] by alpha / 16
+typedef struct {
+    uint8_t index;
+    uint8_t alpha;
+} lcd_scale_tap_t;
+
+// Taps for dst output pixels from src source pixels, for the filtered
+// modes. The pixel centres line up: output x is centred on source
+// position (x + 0.5) * src / dst, and edge pixels are clamped.
+static inline void lcd_scale_taps(lcd_scale_tap_t *taps, int src, int dst, lcd_scale_t mode) {
+    for (int x = 0; x < dst; x++) {
+        // Output pixel centre in source pixels
+        int32_t t = (int32_t)(((int64_t)(2 * x + 1) * src << 16) / (2 * dst));
+
+        if (mode == LCD_SCALE_SHARP) {
+            // Move it to the source pixel's centre, except within half an
+            // output pixel of the edge with the next source pixel
+            int32_t range = 0x8000 - (int32_t)(((int64_t)src << 15) / dst);
+            int32_t d = (t & 0xffff) - 0x8000;
+            int32_t c = d < -range ? -range : d > range ? range : d;
+            t = (t & ~0xffff) + (int32_t)((int64_t)(d - c) * dst / src) + 0x8000;
+        }
+
+        // Blend the two source pixels whose centres are either side of it
+        int32_t u = t - 0x8000;
+        if (u < 0) u = 0;
+        if (u > (src - 1) << 16) u = (src - 1) << 16;
+        int32_t i = u >> 16, f = u & 0xffff;
+
+        int32_t alpha = (f + 0x800) >> 12;
+        if (alpha >= 16) {
+            i++;
+            alpha = 0;
+        }
+        taps[x] = (lcd_scale_tap_t){ (uint8_t)i, (uint8_t)alpha };
+    }
+}
+
+#endif // LCD_SCALE_H
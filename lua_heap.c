@@ -0,0 +1,460 @@
+/**
+ * Pool + TLSF heap for Lua, see lua_heap.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "lua_heap.h"
+
+#define POOL_PAGES      (LUA_HEAP_POOL_SIZE / LUA_HEAP_PAGE_SIZE)
+#define POOL_BYTES      (POOL_PAGES * LUA_HEAP_PAGE_SIZE)
+#define NO_PAGE         0xFFFF
+#define PAGE_UNUSED     0xFF
+
+// TLSF: the first level splits sizes by power of two, the second level
+// splits each power of two into 16 lists. Blocks are multiples of 8 bytes.
+#define ALIGN_LOG2      3
+#define SL_LOG2         4
+#define SL_COUNT        (1 << SL_LOG2)
+#define FL_SHIFT        (SL_LOG2 + ALIGN_LOG2)
+#define SMALL_BLOCK     (1 << FL_SHIFT)     // below this everything is in list 0
+#define FL_COUNT        14                  // blocks up to 1 MB
+
+#define BLOCK_FREE      1u
+#define BLOCK_HDR       8u
+
+typedef struct tlsf_block {
+    uint32_t size;          // payload bytes | BLOCK_FREE
+    uint32_t prev_size;     // payload bytes of the block just below this one
+    struct tlsf_block* next_free;   // free list links, only while free
+    struct tlsf_block* prev_free;
+} tlsf_block_t;
+
+#define BLOCK_MIN       ((uint32_t)((sizeof(tlsf_block_t) - BLOCK_HDR + 7) & ~7u))
+
+_Static_assert(POOL_BYTES < LUA_HEAP_SIZE, "no room left for the TLSF region");
+_Static_assert(LUA_HEAP_SIZE < (1u << (FL_COUNT + FL_SHIFT - 1)), "FL_COUNT too small");
+
+typedef struct {
+    uint16_t free;          // offset + 1 of the first free object, 0 if none
+    uint16_t bump;          // offset of the first object never handed out
+    uint16_t used;
+    uint8_t cls;            // PAGE_UNUSED while on the free page list
+    uint16_t prev, next;    // partial list of the class, or the free page list
+} page_t;
+
+static const uint16_t class_size[LUA_HEAP_CLASSES] = { 8, 16, 24, 32, 48, 64, 96, 128 };
+
+// Class for a size, indexed by (size + 7) / 8
+static const uint8_t class_of_8[LUA_HEAP_SMALL_MAX / 8 + 1] = {
+    0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7,
+};
+
+static uint64_t heap_mem[LUA_HEAP_SIZE / 8];
+
+static struct {
+    bool ready;
+    bool trace;
+    page_t pages[POOL_PAGES];
+    uint16_t partial[LUA_HEAP_CLASSES];     // pages of each class with room left
+    uint16_t free_pages;
+    uint32_t fl_bitmap;
+    uint16_t sl_bitmap[FL_COUNT];
+    tlsf_block_t* heads[FL_COUNT][SL_COUNT];
+    tlsf_block_t* first;                    // first real TLSF block
+    uint32_t in_use;
+    uint32_t peak_in_use;
+    uint32_t pages_free;
+    uint32_t pool_fallbacks;
+    uint32_t failures;
+    lua_heap_class_stats_t classes[LUA_HEAP_CLASSES];
+} heap;
+
+static inline uint8_t* pool_base(void) {
+    return (uint8_t*)heap_mem;
+}
+
+static inline bool in_pool(const void* ptr) {
+    return (const uint8_t*)ptr >= pool_base() && (const uint8_t*)ptr < pool_base() + POOL_BYTES;
+}
+
+static inline int fls32(uint32_t x) {
+    return 31 - __builtin_clz(x);
+}
+
+static void account(int32_t delta) {
+    heap.in_use += delta;
+    if (heap.in_use > heap.peak_in_use) heap.peak_in_use = heap.in_use;
+}
+
+// Size-class pools
+
+static void partial_link(uint8_t cls, uint16_t p) {
+    page_t* pg = &heap.pages[p];
+    pg->prev = NO_PAGE;
+    pg->next = heap.partial[cls];
+    if (pg->next != NO_PAGE) heap.pages[pg->next].prev = p;
+    heap.partial[cls] = p;
+}
+
+static void partial_unlink(uint8_t cls, uint16_t p) {
+    page_t* pg = &heap.pages[p];
+    if (pg->prev != NO_PAGE) heap.pages[pg->prev].next = pg->next;
+    else heap.partial[cls] = pg->next;
+    if (pg->next != NO_PAGE) heap.pages[pg->next].prev = pg->prev;
+}
+
+static inline bool page_full(const page_t* pg) {
+    return !pg->free && pg->bump + class_size[pg->cls] > LUA_HEAP_PAGE_SIZE;
+}
+
+static void* pool_alloc(uint8_t cls) {
+    uint16_t p = heap.partial[cls];
+    if (p == NO_PAGE) {
+        p = heap.free_pages;
+        if (p == NO_PAGE) return NULL;
+        heap.free_pages = heap.pages[p].next;
+        heap.pages_free--;
+        heap.pages[p] = (page_t){ .cls = cls };
+        heap.classes[cls].pages++;
+        partial_link(cls, p);
+    }
+
+    page_t* pg = &heap.pages[p];
+    uint8_t* base = pool_base() + p * LUA_HEAP_PAGE_SIZE;
+    void* obj;
+    if (pg->free) {
+        obj = base + pg->free - 1;
+        pg->free = *(uint16_t*)obj;
+    } else {
+        obj = base + pg->bump;
+        pg->bump += class_size[cls];
+    }
+    pg->used++;
+    if (page_full(pg)) partial_unlink(cls, p);
+
+    lua_heap_class_stats_t* c = &heap.classes[cls];
+    c->allocs++;
+    if (++c->live > c->peak_live) c->peak_live = c->live;
+    account(class_size[cls]);
+    return obj;
+}
+
+static void pool_free(void* obj) {
+    uint32_t offset = (uint8_t*)obj - pool_base();
+    uint16_t p = offset / LUA_HEAP_PAGE_SIZE;
+    page_t* pg = &heap.pages[p];
+    uint8_t cls = pg->cls;
+    bool was_full = page_full(pg);
+
+    *(uint16_t*)obj = pg->free;
+    pg->free = offset % LUA_HEAP_PAGE_SIZE + 1;
+    pg->used--;
+
+    if (pg->used == 0) {
+        // Hand the page back so any class can use it
+        if (!was_full) partial_unlink(cls, p);
+        pg->cls = PAGE_UNUSED;
+        pg->next = heap.free_pages;
+        heap.free_pages = p;
+        heap.pages_free++;
+        heap.classes[cls].pages--;
+    } else if (was_full) {
+        partial_link(cls, p);
+    }
+
+    heap.classes[cls].frees++;
+    heap.classes[cls].live--;
+    account(-(int32_t)class_size[cls]);
+}
+
+// TLSF
+
+static inline uint32_t block_size(const tlsf_block_t* b) {
+    return b->size & ~BLOCK_FREE;
+}
+
+static inline tlsf_block_t* block_next(const tlsf_block_t* b) {
+    return (tlsf_block_t*)((uint8_t*)b + BLOCK_HDR + block_size(b));
+}
+
+static inline tlsf_block_t* block_prev(const tlsf_block_t* b) {
+    return (tlsf_block_t*)((uint8_t*)b - b->prev_size - BLOCK_HDR);
+}
+
+static inline tlsf_block_t* block_from_ptr(const void* ptr) {
+    return (tlsf_block_t*)((uint8_t*)ptr - BLOCK_HDR);
+}
+
+static void mapping(uint32_t size, int* fl, int* sl) {
+    if (size < SMALL_BLOCK) {
+        *fl = 0;
+        *sl = size >> ALIGN_LOG2;
+    } else {
+        int f = fls32(size);
+        *sl = (size >> (f - SL_LOG2)) ^ SL_COUNT;
+        *fl = f - FL_SHIFT + 1;
+    }
+}
+
+static void list_insert(tlsf_block_t* b) {
+    int fl, sl;
+    mapping(block_size(b), &fl, &sl);
+    b->prev_free = NULL;
+    b->next_free = heap.heads[fl][sl];
+    if (b->next_free) b->next_free->prev_free = b;
+    heap.heads[fl][sl] = b;
+    heap.fl_bitmap |= 1u << fl;
+    heap.sl_bitmap[fl] |= 1u << sl;
+}
+
+static void list_remove(tlsf_block_t* b) {
+    int fl, sl;
+    mapping(block_size(b), &fl, &sl);
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+    if (b->prev_free) b->prev_free->next_free = b->next_free;
+    else {
+        heap.heads[fl][sl] = b->next_free;
+        if (!b->next_free) {
+            heap.sl_bitmap[fl] &= ~(1u << sl);
+            if (!heap.sl_bitmap[fl]) heap.fl_bitmap &= ~(1u << fl);
+        }
+    }
+}
+
+// Free list holding blocks of at least size bytes, good fit
+static tlsf_block_t* list_search(uint32_t size) {
+    if (size >= SMALL_BLOCK) size += (1u << (fls32(size) - SL_LOG2)) - 1;
+    int fl, sl;
+    mapping(size, &fl, &sl);
+    if (fl >= FL_COUNT) return NULL;
+
+    uint32_t sl_map = heap.sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint32_t fl_map = heap.fl_bitmap & (~0u << (fl + 1));
+        if (!fl_map) return NULL;
+        fl = __builtin_ctz(fl_map);
+        sl_map = heap.sl_bitmap[fl];
+    }
+    return heap.heads[fl][__builtin_ctz(sl_map)];
+}
+
+// Mark b free, merge it with free neighbours and put it on a list
+static void block_release(tlsf_block_t* b) {
+    tlsf_block_t* next = block_next(b);
+    if (next->size & BLOCK_FREE) {
+        list_remove(next);
+        b->size += BLOCK_HDR + block_size(next);
+    }
+    tlsf_block_t* prev = block_prev(b);
+    if (prev->size & BLOCK_FREE) {
+        list_remove(prev);
+        prev->size += BLOCK_HDR + block_size(b);
+        b = prev;
+    }
+    b->size |= BLOCK_FREE;
+    block_next(b)->prev_size = block_size(b);
+    list_insert(b);
+}
+
+// Trim a used block to size bytes if the rest can stand as a block
+static void block_trim(tlsf_block_t* b, uint32_t size) {
+    uint32_t have = block_size(b);
+    if (have < size + BLOCK_HDR + BLOCK_MIN) return;
+    tlsf_block_t* rest = (tlsf_block_t*)((uint8_t*)b + BLOCK_HDR + size);
+    rest->size = have - size - BLOCK_HDR;
+    rest->prev_size = size;
+    b->size = size;
+    block_next(rest)->prev_size = block_size(rest);
+    block_release(rest);
+}
+
+static inline uint32_t block_request(size_t size) {
+    uint32_t s = (size + 7) & ~7u;
+    return s < BLOCK_MIN ? BLOCK_MIN : s;
+}
+
+static void* tlsf_malloc(size_t size) {
+    if (size > LUA_HEAP_SIZE) return NULL;
+    uint32_t need = block_request(size);
+    tlsf_block_t* b = list_search(need);
+    if (!b) return NULL;
+    list_remove(b);
+    b->size &= ~BLOCK_FREE;
+    block_trim(b, need);
+    account(block_size(b));
+    return (uint8_t*)b + BLOCK_HDR;
+}
+
+static void tlsf_free(void* ptr) {
+    tlsf_block_t* b = block_from_ptr(ptr);
+    account(-(int32_t)block_size(b));
+    block_release(b);
+}
+
+// Grow or shrink in place if possible
+static bool tlsf_resize(void* ptr, size_t size) {
+    if (size > LUA_HEAP_SIZE) return false;
+    tlsf_block_t* b = block_from_ptr(ptr);
+    uint32_t need = block_request(size);
+    uint32_t before = block_size(b);
+
+    if (need > before) {
+        tlsf_block_t* next = block_next(b);
+        if (!(next->size & BLOCK_FREE) || before + BLOCK_HDR + block_size(next) < need)
+            return false;
+        list_remove(next);
+        b->size = before + BLOCK_HDR + block_size(next);
+        block_next(b)->prev_size = b->size;
+    }
+    block_trim(b, need);
+    account((int32_t)block_size(b) - (int32_t)before);
+    return true;
+}
+
+static void heap_init(void) {
+    memset(&heap, 0, sizeof(heap));
+
+    for (int c = 0; c < LUA_HEAP_CLASSES; c++) {
+        heap.partial[c] = NO_PAGE;
+        heap.classes[c].size = class_size[c];
+    }
+    heap.free_pages = NO_PAGE;
+    for (int p = POOL_PAGES - 1; p >= 0; p--) {
+        heap.pages[p].cls = PAGE_UNUSED;
+        heap.pages[p].next = heap.free_pages;
+        heap.free_pages = p;
+    }
+    heap.pages_free = POOL_PAGES;
+
+    // Zero-sized used blocks at both ends stop merging at the edges
+    uint8_t* start = pool_base() + POOL_BYTES;
+    uint8_t* end = (uint8_t*)heap_mem + sizeof(heap_mem) - sizeof(tlsf_block_t);
+    tlsf_block_t* lo = (tlsf_block_t*)start;
+    tlsf_block_t* b = (tlsf_block_t*)(start + BLOCK_HDR);
+    tlsf_block_t* hi = (tlsf_block_t*)end;
+    lo->size = 0;
+    lo->prev_size = 0;
+    b->size = (end - (uint8_t*)b - BLOCK_HDR) | BLOCK_FREE;
+    b->prev_size = 0;
+    hi->size = 0;
+    hi->prev_size = block_size(b);
+    list_insert(b);
+    heap.first = b;
+
+    heap.ready = true;
+}
+
+static void* heap_malloc(size_t size) {
+    void* p = NULL;
+    if (size <= LUA_HEAP_SMALL_MAX) {
+        p = pool_alloc(class_of_8[(size + 7) >> 3]);
+        if (!p) heap.pool_fallbacks++;
+    }
+    if (!p) p = tlsf_malloc(size);
+    if (!p) heap.failures++;
+    return p;
+}
+
+static void heap_free(void* ptr) {
+    if (in_pool(ptr)) pool_free(ptr);
+    else tlsf_free(ptr);
+}
+
+static void* heap_realloc(void* ptr, size_t size) {
+    if (!ptr) return heap_malloc(size);
+
+    uint32_t old_size;
+    if (in_pool(ptr)) {
+        uint8_t cls = heap.pages[((uint8_t*)ptr - pool_base()) / LUA_HEAP_PAGE_SIZE].cls;
+        if (size <= LUA_HEAP_SMALL_MAX && class_of_8[(size + 7) >> 3] == cls) return ptr;
+        old_size = class_size[cls];
+    } else {
+        old_size = block_size(block_from_ptr(ptr));
+        // Shrinking into a class moves it to a pool page if one has room
+        void* p = size <= LUA_HEAP_SMALL_MAX ? pool_alloc(class_of_8[(size + 7) >> 3]) : NULL;
+        if (p) {
+            memcpy(p, ptr, old_size < size ? old_size : size);
+            tlsf_free(ptr);
+            return p;
+        }
+        if (tlsf_resize(ptr, size)) return ptr;
+    }
+
+    void* p = heap_malloc(size);
+    if (!p) return NULL;
+    memcpy(p, ptr, old_size < size ? old_size : size);
+    heap_free(ptr);
+    return p;
+}
+
+void* lua_heap_realloc(void* ptr, size_t size) {
+    if (!heap.ready) heap_init();
+    if (size == 0) {
+        lua_heap_free(ptr);
+        return NULL;
+    }
+    void* p = heap_realloc(ptr, size);
+    if (heap.trace) {
+        if (ptr) printf("@r %lx %lx %lu\n", (unsigned long)(uintptr_t)ptr,
+                        (unsigned long)(uintptr_t)p, (unsigned long)size);
+        else printf("@a %lx %lu\n", (unsigned long)(uintptr_t)p, (unsigned long)size);
+    }
+    return p;
+}
+
+void lua_heap_free(void* ptr) {
+    if (!ptr) return;
+    if (heap.trace) printf("@f %lx\n", (unsigned long)(uintptr_t)ptr);
+    heap_free(ptr);
+}
+
+void lua_heap_reset(void) {
+    bool trace = heap.trace;
+    heap_init();
+    heap.trace = trace;
+}
+
+void lua_heap_trace(bool on) {
+    heap.trace = on;
+}
+
+void lua_heap_stats(lua_heap_stats_t* stats) {
+    if (!heap.ready) heap_init();
+    memset(stats, 0, sizeof(*stats));
+    stats->in_use = heap.in_use;
+    stats->peak_in_use = heap.peak_in_use;
+    stats->pages_free = heap.pages_free;
+    stats->pool_fallbacks = heap.pool_fallbacks;
+    stats->failures = heap.failures;
+    memcpy(stats->classes, heap.classes, sizeof(stats->classes));
+
+    for (tlsf_block_t* b = heap.first; block_size(b); b = block_next(b)) {
+        if (!(b->size & BLOCK_FREE)) continue;
+        stats->tlsf_free += block_size(b);
+        stats->tlsf_free_blocks++;
+        if (block_size(b) > stats->tlsf_largest) stats->tlsf_largest = block_size(b);
+    }
+    if (stats->tlsf_free)
+        stats->fragmentation = 1000 - (uint32_t)((uint64_t)stats->tlsf_largest * 1000 / stats->tlsf_free);
+}
+
+void lua_heap_dump(void) {
+    lua_heap_stats_t s;
+    lua_heap_stats(&s);
+    printf("Lua heap: %lu bytes in use, peak %lu, %d KB total\n",
+           (unsigned long)s.in_use, (unsigned long)s.peak_in_use, LUA_HEAP_SIZE / 1024);
+    printf("  TLSF: %lu bytes free in %lu blocks, largest %lu, fragmentation %lu.%lu%%\n",
+           (unsigned long)s.tlsf_free, (unsigned long)s.tlsf_free_blocks,
+           (unsigned long)s.tlsf_largest, (unsigned long)(s.fragmentation / 10),
+           (unsigned long)(s.fragmentation % 10));
+    printf("  Pools: %lu of %d pages free, %lu fallbacks to TLSF, %lu failed requests\n",
+           (unsigned long)s.pages_free, POOL_PAGES, (unsigned long)s.pool_fallbacks,
+           (unsigned long)s.failures);
+    for (int c = 0; c < LUA_HEAP_CLASSES; c++) {
+        const lua_heap_class_stats_t* k = &s.classes[c];
+        printf("  %4lu: %3lu pages %6lu live (peak %6lu) %8lu allocs %8lu frees\n",
+               (unsigned long)k->size, (unsigned long)k->pages, (unsigned long)k->live,
+               (unsigned long)k->peak_live, (unsigned long)k->allocs, (unsigned long)k->frees);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef LUA_HEAP_H
+#define LUA_HEAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Dedicated heap for the Lua runtime, separate from the newlib heap that
+// FatFs and the SDK use.
+//
+// Small requests (up to LUA_HEAP_SMALL_MAX bytes, which is most of what
+// Lua allocates: strings, table nodes, closures) come from size-class
+// pools carved out of 1 KB pages; a page goes back to the shared page
+// list as soon as its last object is freed, so a burst of one class does
+// not strand memory for the others. Everything else, and small requests
+// once the pages run out, comes from a TLSF allocator: constant time
+// malloc and free with good-fit placement.
+//
+// Only one core may use it; Lua runs on core0.
+
+#ifndef LUA_HEAP_SIZE
+#define LUA_HEAP_SIZE       (192 * 1024)
+#endif
+#ifndef LUA_HEAP_POOL_SIZE
+#define LUA_HEAP_POOL_SIZE  (LUA_HEAP_SIZE / 4)     // part of it used for pool pages
+#endif
+#define LUA_HEAP_PAGE_SIZE  1024
+#define LUA_HEAP_SMALL_MAX  128
+#define LUA_HEAP_CLASSES    8
+
+typedef struct {
+    uint32_t size;          // object size of this class
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t live;
+    uint32_t peak_live;
+    uint32_t pages;         // pages currently assigned to this class
+} lua_heap_class_stats_t;
+
+typedef struct {
+    uint32_t in_use;        // bytes handed out, rounded up to the class or block size
+    uint32_t peak_in_use;
+    uint32_t tlsf_free;     // free bytes in the TLSF region
+    uint32_t tlsf_largest;  // largest free TLSF block
+    uint32_t tlsf_free_blocks;
+    uint32_t fragmentation; // 1 - largest / free, in 1/1000
+    uint32_t pages_free;
+    uint32_t pool_fallbacks;  // small requests served by TLSF because no page was free
+    uint32_t failures;      // requests that could not be served at all
+    lua_heap_class_stats_t classes[LUA_HEAP_CLASSES];
+} lua_heap_stats_t;
+
+// realloc/free semantics, for Lua's default allocator (see CMakeLists.txt)
+void* lua_heap_realloc(void* ptr, size_t size);
+void lua_heap_free(void* ptr);
+
+// Drop everything; only safe with no Lua state alive
+void lua_heap_reset(void);
+
+void lua_heap_stats(lua_heap_stats_t* stats);
+void lua_heap_dump(void);
+
+// Allocation trace for the host benchmark (tools/lua_heap_bench.c). While
+// on, every call is printed over stdio as "@a <ptr> <size>", "@r <old ptr>
+// <new ptr> <size>" or "@f <ptr>".
+void lua_heap_trace(bool on);
+
+#endif // LUA_HEAP_H
@@ -15,126 +15,119 @@
 
 #include "hw_config.h"
 #include "f_util.h"
+#include "f_fastseek.h"
 #include "ff.h"
 #include "i2s.h"
 #include "st7789_lcd.h"
-
-volatile bool frame_ready = false;    // Signal from core0 to core1
+#include "save.h"
+#include "storage.h"
+#include "sd_trace.h"
+#include "perf.h"
+#include "lua_heap.h"
+#include "osd.h"
+#include "pacing.h"
+#include "capture.h"
+#include "input.h"
+
+// Signal from core0 to core1. Both cores poll it, so it stays out of
+// scratch X.
+volatile bool frame_ready = false;
 
 struct TinyBitMemory tb_mem = {0};
 bool button_state[TB_BUTTON_COUNT] = {0};
 
 // frame buffer that we will use temporarity while tinybit renders a new frame
 uint8_t frame_buffer_copy[TB_SCREEN_WIDTH * TB_SCREEN_HEIGHT * 2];
+lcd_palette_t frame_palette = { .bits = 16 };
+
+#if LCD_INDEXED
+// Frames with few colours go to core1 as palette indices, see lcd_palette.h
+static bool indexed = true;
+static lcd_palette_map_t palette_map;
+#endif
+static uint32_t copy_us;
 
-// Filesystem state (kept mounted for game loading)
-static FATFS fs;
-static bool fs_mounted = false;
+// Which finished frames go to core1, see pacing.h
+pacing_t frame_pacing;
+static uint32_t logic_start_us;    // the game started on this frame
+static uint32_t handoff_us;        // core1 got the last frame
 
-// Count PNG files in root directory
+// Counted on every mount by storage.c
 int sd_gamecount(void) {
-    if (!fs_mounted) return 0;
+    return storage_game_count();
+}
+
+// Load PNG game file by index
+void sd_gameload(int index) {
+    if (!storage_mounted()) return;
 
     DIR dir;
     FILINFO fno;
     int count = 0;
 
     FRESULT fr = f_opendir(&dir, "/");
-    if (fr != FR_OK) return 0;
+    if (fr != FR_OK) {
+        storage_io_error(fr, to_ms());
+        return;
+    }
 
+    // Find the file at the given index
     while (1) {
         fr = f_readdir(&dir, &fno);
         if (fr != FR_OK || fno.fname[0] == 0) break;
 
-        // Skip directories
-        if (fno.fattrib & AM_DIR) continue;
-
-        // Check for .png extension (case insensitive)
-        size_t len = strlen(fno.fname);
-        if (len > 4) {
-            const char* ext = &fno.fname[len - 4];
-            if ((ext[0] == '.' || ext[0] == '.') &&
-                (ext[1] == 'p' || ext[1] == 'P') &&
-                (ext[2] == 'n' || ext[2] == 'N') &&
-                (ext[3] == 'g' || ext[3] == 'G')) {
-                count++;
-            }
-        }
-    }
+        if (!storage_is_game(&fno)) continue;
+        if (count++ != index) continue;
 
-    f_closedir(&dir);
-    return count;
-}
+        f_closedir(&dir);
 
-// Load PNG game file by index
-void sd_gameload(int index) {
-    if (!fs_mounted) return;
+        // Load this file. Building the link map walks the FAT once, which
+        // the reads below then skip, so it costs no more than f_open()
+        // (tools/fastseek_bench)
+        FIL fil;
+        fr = f_open_fastseek(&fil, fno.fname, FA_READ);
+        if (fr != FR_OK) {
+            printf("Failed to open: %s\n", fno.fname);
+            storage_io_error(fr, to_ms());
+            return;
+        }
 
-    DIR dir;
-    FILINFO fno;
-    int count = 0;
+        printf("Loading: %s\n", fno.fname);
 
-    FRESULT fr = f_opendir(&dir, "/");
-    if (fr != FR_OK) return;
+        // Pending saves of the previous game are flushed here
+        save_open(fno.fname);
 
-    // Find the file at the given index
-    while (1) {
-        fr = f_readdir(&dir, &fno);
-        if (fr != FR_OK || fno.fname[0] == 0) break;
+        char buffer[256];
+        UINT bytes_read;
+        while (1) {
+            fr = f_read(&fil, buffer, sizeof(buffer), &bytes_read);
+            if (fr != FR_OK || bytes_read == 0) break;
+            tinybit_feed_cartridge((uint8_t*)buffer, bytes_read);
+        }
 
-        if (fno.fattrib & AM_DIR) continue;
-
-        size_t len = strlen(fno.fname);
-        if (len > 4) {
-            const char* ext = &fno.fname[len - 4];
-            if ((ext[0] == '.') &&
-                (ext[1] == 'p' || ext[1] == 'P') &&
-                (ext[2] == 'n' || ext[2] == 'N') &&
-                (ext[3] == 'g' || ext[3] == 'G')) {
-                if (count == index) {
-                    f_closedir(&dir);
-
-                    // Load this file
-                    FIL fil;
-                    fr = f_open(&fil, fno.fname, FA_READ);
-                    if (fr != FR_OK) {
-                        printf("Failed to open: %s\n", fno.fname);
-                        return;
-                    }
-
-                    printf("Loading: %s\n", fno.fname);
-
-                    char buffer[256];
-                    UINT bytes_read;
-                    while (1) {
-                        fr = f_read(&fil, buffer, sizeof(buffer), &bytes_read);
-                        if (fr != FR_OK || bytes_read == 0) break;
-                        tinybit_feed_cartridge((uint8_t*)buffer, bytes_read);
-                    }
-
-                    f_close(&fil);
-                    return;
-                }
-                count++;
-            }
+        f_close_fastseek(&fil);
+        if (fr != FR_OK) {
+            printf("Loading %s failed: %s (%d)\n", fno.fname, FRESULT_str(fr), fr);
+            storage_io_error(fr, to_ms());
         }
+        return;
     }
 
     f_closedir(&dir);
+    if (fr != FR_OK) storage_io_error(fr, to_ms());
 }
 
-void tinybit_poll_input(void) {
-    // Update button states
-    // Example: Read GPIO pins and update button_state array
-    tb_mem.button_input[TB_BUTTON_A] = gpio_get(17); 
-    tb_mem.button_input[TB_BUTTON_B] = gpio_get(16); 
-    tb_mem.button_input[TB_BUTTON_UP] = gpio_get(21); // 21 
-    tb_mem.button_input[TB_BUTTON_DOWN] = gpio_get(19); 
-    tb_mem.button_input[TB_BUTTON_LEFT] = gpio_get(18); 
-    tb_mem.button_input[TB_BUTTON_RIGHT] = gpio_get(20); 
+// Per-frame callbacks and the core1 loop run from RAM, so a flash cache miss
+// on the other core cannot stall them; see tools/flash_audit.py
+void __not_in_flash_func(tinybit_poll_input)(void) {
+    uint32_t pressed = input_poll();
+    for (int b = 0; b < TB_BUTTON_COUNT; b++) tb_mem.button_input[b] = pressed >> b & 1;
+
+    osd_combo(tb_mem.button_input[TB_BUTTON_LEFT] && tb_mem.button_input[TB_BUTTON_RIGHT] &&
+              tb_mem.button_input[TB_BUTTON_A], to_ms());
 }
 
-int to_ms(void) {
+int __not_in_flash_func(to_ms)(void) {
     return to_ms_since_boot(get_absolute_time());
 }
 
@@ -142,20 +135,138 @@ void log_printf(const char* msg) {
     printf("%s", msg);
 }
 
-void audio_queue_handler(void) {
+void __not_in_flash_func(audio_queue_handler)(void) {
     i2s_queue_samples();
+    // The wait for the audio is over: the game's next frame starts here
+    logic_start_us = time_us_32();
 }
 
-// Signal frame ready - non-blocking for Lua
-void render_frame_handler(void) {
-    memcpy(frame_buffer_copy, tb_mem.display, TB_MEM_DISPLAY_SIZE);
+// Hand the frame to core1 when pacing.h says it is due. A frame is never
+// written under one core1 is still sending: that one would be lost when
+// core1 clears frame_ready, and an indexed frame would not match the
+// palette core1 started with. A due frame that finds core1 busy is held
+// for it briefly, or dropped.
+void __not_in_flash_func(render_frame_handler)(void) {
+    uint32_t now = time_us_32();
+    pacing_input_t in = {
+        .now_us = now,
+        .logic_us = now - logic_start_us,
+        .present_us = lcd_present_time_us() + capture_cost_us(),
+        .busy = frame_ready,
+        .busy_until_us = handoff_us + frame_pacing.present_us,
+        .audio_us = i2s_queued_us(),
+    };
+    pacing_action_t action = pacing_frame(&frame_pacing, &in);
+    if (action == PACING_HOLD) {
+        while (frame_ready && (int32_t)(time_us_32() - frame_pacing.hold_until_us) < 0)
+            tight_loop_contents();
+        action = pacing_held(&frame_pacing, frame_ready);
+    }
+    if (action != PACING_PRESENT) return;
+
+    uint32_t start = time_us_32();
+#if LCD_INDEXED
+    if (!indexed || !lcd_palette_index(&frame_palette, frame_buffer_copy, (const uint16_t *)tb_mem.display,
+                                       TB_MEM_DISPLAY_SIZE / 2, &palette_map))
+#endif
+    {
+        memcpy(frame_buffer_copy, tb_mem.display, TB_MEM_DISPLAY_SIZE);
+        frame_palette.bits = 16;
+    }
+    handoff_us = time_us_32();
+    copy_us = handoff_us - start;
+    pacing_present(&frame_pacing, handoff_us);
     frame_ready = true;
 }
 
-void core1_loop(void) {
+static void pacing_dump(void) {
+    const pacing_stats_t *s = &frame_pacing.stats;
+    printf("pacing: %lu Hz, game %lu us per frame (logic %lu us), present %lu us\n",
+           (unsigned long)frame_pacing.rate_hz, (unsigned long)frame_pacing.tempo_us,
+           (unsigned long)frame_pacing.logic_us, (unsigned long)frame_pacing.present_us);
+    printf("  frames %lu: presented %lu (held %lu), skipped %lu, dropped %lu\n",
+           (unsigned long)s->frames, (unsigned long)s->presented, (unsigned long)s->held,
+           (unsigned long)s->skipped, (unsigned long)s->dropped);
+    printf("  late %lu, judder %lu, mean deviation %lu us, rate changes %lu\n",
+           (unsigned long)s->late, (unsigned long)s->judder,
+           (unsigned long)(s->intervals ? s->deviation_us / s->intervals : 0),
+           (unsigned long)s->rate_changes);
+}
+
+// FatFs lock contention: each volume mutex, then the system mutex
+static void fatfs_lock_dump(void) {
+    for (int vol = 0; vol <= FF_VOLUMES; vol++) {
+        ff_mutex_stats_t s;
+        ff_mutex_get_stats(vol, &s);
+        printf("fatfs %s mutex %d: takes %lu, contended %lu, timeouts %lu\n",
+               vol < FF_VOLUMES ? "volume" : "system", vol, (unsigned long)s.takes,
+               (unsigned long)s.contended, (unsigned long)s.timeouts);
+    }
+}
+
+// Debug commands over USB stdio: 't' dumps the SD trace and FatFs lock
+// counters, 'p' the perf counters, 'f' the frame pacing, 'b' the buttons,
+// 'r' clears all five;
+// 's' steps through the LCD scaling modes, 'i' toggles indexed frames and
+// 'o' the overlay; 'c' starts and stops a capture, 'x' takes a
+// screenshot; 'h' dumps the Lua heap, 'l' toggles its allocation trace
+static void poll_console(void) {
+    int c = getchar_timeout_us(0);
+    if (c == 't') {
+        sd_trace_dump(printf);
+        fatfs_lock_dump();
+    }
+    else if (c == 'p') perf_dump();
+    else if (c == 'f') pacing_dump();
+    else if (c == 'b') input_dump();
+#if CAPTURE
+    else if (c == 'c') {
+        if (capture_active()) capture_stop();
+        else if (!capture_start(false)) printf("Capture: no card, or one is running\n");
+    }
+    else if (c == 'x') {
+        if (!capture_start(true)) printf("Capture: no card, or one is running\n");
+    }
+#endif
+    else if (c == 'o') osd_toggle();
+    else if (c == 's') {
+        lcd_scale_t mode = lcd_get_scale();
+        uint32_t us = lcd_build_time_us();
+        lcd_set_scale((mode + 1) % LCD_SCALE_MODES);
+        printf("LCD scaling %s -> %s (%s: %lu us of scanline building per frame)\n",
+               lcd_scale_names[mode], lcd_scale_names[lcd_get_scale()],
+               lcd_scale_names[mode], (unsigned long)us);
+    }
+#if LCD_INDEXED
+    else if (c == 'i') {
+        printf("LCD frames %s -> %s (%d bit: %lu us copying on core0, %lu us scanline building on core1)\n",
+               indexed ? "indexed" : "direct", indexed ? "direct" : "indexed", frame_palette.bits,
+               (unsigned long)copy_us, (unsigned long)lcd_build_time_us());
+        indexed = !indexed;
+    }
+#endif
+#if TINYBIT_LUA_HEAP
+    else if (c == 'h') lua_heap_dump();
+    else if (c == 'l') {
+        static bool tracing;
+        tracing = !tracing;
+        lua_heap_trace(tracing);
+    }
+#endif
+    else if (c == 'r') {
+        sd_trace_reset();
+        for (int vol = 0; vol <= FF_VOLUMES; vol++) ff_mutex_reset_stats(vol);
+        perf_reset();
+        memset(&frame_pacing.stats, 0, sizeof(frame_pacing.stats));
+        input_reset();
+    }
+}
+
+void __core1_func(core1_loop)(void) {
     while(1) {
         if(frame_ready) {
             send_frame_to_lcd();
+            capture_frame();
             frame_ready = false;
         }
     }
@@ -169,19 +280,8 @@ int main() {
     else
       printf("system clock now 200MHz\n");
 
-    gpio_init(16);
-    gpio_init(17);
-    gpio_init(18);
-    gpio_init(19);
-    gpio_init(20);
-    gpio_init(21);
-
-    gpio_set_dir(16, GPIO_IN);
-    gpio_set_dir(17, GPIO_IN);
-    gpio_set_dir(18, GPIO_IN);
-    gpio_set_dir(19, GPIO_IN);
-    gpio_set_dir(20, GPIO_IN);
-    gpio_set_dir(21, GPIO_IN);
+    // Buttons, sampled from here on
+    input_init();
 
     // Initialize and clear LCD display
     lcd_init_display();
@@ -191,14 +291,9 @@ int main() {
     // Initialize I2S audio output
     i2s_init();
 
-    // Mount SD card filesystem (keep mounted for game loading)
-    FRESULT fr = f_mount(&fs, "", 1);
-    if (FR_OK != fr) {
-        printf("f_mount error: %s (%d)\n", FRESULT_str(fr), fr);
-    } else {
-        fs_mounted = true;
-        printf("SD card mounted, found %d games\n", sd_gamecount());
-    }
+    // Mount SD card filesystem if a card is in; later swaps are picked up
+    // by storage_poll()
+    storage_init(to_ms());
 
     // Set up TinyBit callbacks
     tinybit_log_cb(log_printf);
@@ -209,6 +304,8 @@ int main() {
     tinybit_get_ticks_ms_cb(to_ms);
     tinybit_audio_queue_cb(audio_queue_handler);
 
+    pacing_init(&frame_pacing);
+
     // Initialize TinyBit (starts game selector menu)
     tinybit_init(&tb_mem);
 
@@ -220,9 +317,16 @@ int main() {
 
     while(1) {
         tinybit_loop();
+        perf_frame();
+        osd_frame();
+        storage_poll(to_ms());
+        save_poll(to_ms());
+        capture_poll(to_ms(), !frame_ready);
+        poll_console();
     }
     
     tinybit_stop();
+    save_close();
 
     return 0;
 }
@@ -2,13 +2,36 @@
 #define MAIN_H
 
 #include <stdbool.h>
+#include "pico.h"
 #include "TinyBit-lib/tinybit.h"
 #include "TinyBit-lib/cartridge.h"
 #include "TinyBit-lib/memory.h"
+#include "lcd_palette.h"
+#include "pacing.h"
+
+// SRAM placement. SRAM0-7 are striped word by word, so anything in .bss
+// shares every bank with core0's Lua heap and stack. Core1 only needs a
+// little memory of its own per frame; with TINYBIT_SCRATCH its code and
+// its scanline buffers go into scratch X (SRAM8), the bank that already
+// holds its stack and that core0 never touches. Anything both cores use
+// stays in ordinary SRAM.
+#ifndef TINYBIT_SCRATCH
+#define TINYBIT_SCRATCH 1
+#endif
+
+#if TINYBIT_SCRATCH
+#define __core1_func(func_name) __attribute__((section(".scratch_x." __STRING(func_name)))) func_name
+#define __core1_data(group) __scratch_x(group)
+#else
+#define __core1_func(func_name) __not_in_flash_func(func_name)
+#define __core1_data(group)
+#endif
 
 // TinyBit memory and state
 extern struct TinyBitMemory tb_mem;
 extern uint8_t frame_buffer_copy[TB_SCREEN_WIDTH * TB_SCREEN_HEIGHT * 2];
+extern lcd_palette_t frame_palette;    // frame_buffer_copy's format
+extern pacing_t frame_pacing;
 
 // Callback functions for TinyBit
 void tinybit_poll_input(void);
@@ -72,6 +72,9 @@ DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 #define ATA_GET_MODEL		21	/* Get model name */
 #define ATA_GET_SN			22	/* Get serial number */
 
+/* Driver specific ioctl command (not in FatFs) */
+#define CTRL_WRITE_STREAM	64	/* Announce sectors about to be written in order (LBA_t[2]: start, count) */
+
 #ifdef __cplusplus
 }
 #endif
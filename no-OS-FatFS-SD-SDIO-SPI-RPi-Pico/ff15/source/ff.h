@@ -380,6 +380,14 @@ int ff_mutex_create (int vol);		/* Create a sync object */
 void ff_mutex_delete (int vol);		/* Delete a sync object */
 int ff_mutex_take (int vol);		/* Lock sync object */
 void ff_mutex_give (int vol);		/* Unlock sync object */
+
+typedef struct {		/* Contention counters of a sync object (Pico SDK hooks) */
+	DWORD takes;		/* Successful ff_mutex_take() calls */
+	DWORD contended;	/* Takes that found the object held and had to wait */
+	DWORD timeouts;		/* Takes that gave up after FF_FS_TIMEOUT */
+} ff_mutex_stats_t;
+void ff_mutex_get_stats (int vol, ff_mutex_stats_t* stats);
+void ff_mutex_reset_stats (int vol);
 #endif
 
 
@@ -10,14 +10,46 @@
 /*------------------------------------------------------------------------*/
 /* Allocate/Free a Memory Block                                           */
 /*------------------------------------------------------------------------*/
+/* Every API function that takes a path or reads a directory allocates its
+/  LFN working buffer on entry and frees it on exit. Serve those from a
+/  static pool instead of the heap, so directory scans never fragment the
+/  heap that Lua lives in. A function never holds more than one buffer, so
+/  one slot per core that may be inside FatFs at the same time is enough.
+/  Anything else (f_mkfs work area, bitmap scratch) still goes to malloc.
+*/
 
 #include <stdlib.h>		/* with POSIX API */
+#include "pico/mutex.h"
+
+#ifndef FF_LFN_POOL_SLOTS
+#define FF_LFN_POOL_SLOTS	2	/* Number of LFN working buffers in the pool */
+#endif
+#define FF_LFN_POOL_BUF	((FF_MAX_LFN + 1) * 2 + (FF_FS_EXFAT ? (FF_MAX_LFN + 44U) / 15 * 32 : 0))
+
+static struct {
+	DWORD buf[(FF_LFN_POOL_BUF + 3) / 4];	/* Word aligned like malloc */
+	BYTE in_use;
+} LfnPool[FF_LFN_POOL_SLOTS];
+auto_init_mutex(LfnPoolMutex);
 
 
 void* ff_memalloc (	/* Returns pointer to the allocated memory block (null if not enough core) */
 	UINT msize		/* Number of bytes to allocate */
 )
 {
+	if (msize <= FF_LFN_POOL_BUF) {
+		void* mblock = 0;
+		mutex_enter_blocking(&LfnPoolMutex);
+		for (int i = 0; i < FF_LFN_POOL_SLOTS; i++) {
+			if (!LfnPool[i].in_use) {
+				LfnPool[i].in_use = 1;
+				mblock = LfnPool[i].buf;
+				break;
+			}
+		}
+		mutex_exit(&LfnPoolMutex);
+		if (mblock) return mblock;
+	}
 	return malloc((size_t)msize);	/* Allocate a new memory block */
 }
 
@@ -26,6 +58,14 @@ void ff_memfree (
 	void* mblock	/* Pointer to the memory block to free (no effect if null) */
 )
 {
+	for (int i = 0; i < FF_LFN_POOL_SLOTS; i++) {
+		if (mblock == LfnPool[i].buf) {
+			mutex_enter_blocking(&LfnPoolMutex);
+			LfnPool[i].in_use = 0;
+			mutex_exit(&LfnPoolMutex);
+			return;
+		}
+	}
 	free(mblock);	/* Free the memory block */
 }
 
@@ -39,8 +79,23 @@ void ff_memfree (
 /* Definitions of Mutex                                                   */
 /*------------------------------------------------------------------------*/
 
-#define OS_TYPE	0	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS */
-
+#define OS_TYPE	5	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS, 5:Pico SDK */
+
+
+/* Lock ordering, outermost first. Never take a lock further up this list
+/  while holding one further down.
+/
+/   1. Volume mutex (ff_mutex_take(vol)), held for the whole API call
+/   2. System mutex (ff_mutex_take(FF_VOLUMES)), file lock table, FF_FS_LOCK
+/   3. Card mutex (sd_lock()), taken by the driver around each disk_* call
+/   4. LfnPoolMutex, and clmt_pool_mutex in f_fastseek.c: leaves held only
+/      while picking a pool slot
+/
+/  Code that goes to disk_read()/disk_write() directly (f_raw_stream, the
+/  save journal) only takes the card mutex. That is safe as long as FatFs
+/  never caches the sectors involved, i.e. the file is not also open
+/  through FatFs. None of these may be taken from an interrupt handler.
+*/
 
 #if   OS_TYPE == 0	/* Win32 */
 #include <windows.h>
@@ -64,6 +119,21 @@ static SemaphoreHandle_t Mutex[FF_VOLUMES + 1];	/* Table of mutex handle */
 #include "cmsis_os.h"
 static osMutexId Mutex[FF_VOLUMES + 1];	/* Table of mutex ID */
 
+#elif OS_TYPE == 5	/* Pico SDK */
+#include "pico/mutex.h"
+static mutex_t Mutex[FF_VOLUMES + 1];	/* Table of mutexes, safe across both cores */
+static ff_mutex_stats_t MutexStats[FF_VOLUMES + 1];
+
+void ff_mutex_get_stats (int vol, ff_mutex_stats_t* stats)
+{
+	*stats = MutexStats[vol];
+}
+
+void ff_mutex_reset_stats (int vol)
+{
+	MutexStats[vol] = (ff_mutex_stats_t){0};
+}
+
 #endif
 
 
@@ -106,6 +176,10 @@ int ff_mutex_create (	/* Returns 1:Function succeeded or 0:Could not create the
 	Mutex[vol] = osMutexCreate(osMutex(cmsis_os_mutex));
 	return (int)(Mutex[vol] != NULL);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	if (!mutex_is_initialized(&Mutex[vol])) mutex_init(&Mutex[vol]);
+	return 1;
+
 #endif
 }
 
@@ -138,6 +212,9 @@ void ff_mutex_delete (	/* Returns 1:Function succeeded or 0:Could not delete due
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexDelete(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	(void)vol;	/* Static; kept for the next f_mount */
+
 #endif
 }
 
@@ -171,6 +248,19 @@ int ff_mutex_take (	/* Returns 1:Succeeded or 0:Timeout */
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	return (int)(osMutexWait(Mutex[vol], FF_FS_TIMEOUT) == osOK);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	uint32_t owner;
+
+	if (!mutex_try_enter(&Mutex[vol], &owner)) {	/* Held by the other core or thread */
+		if (!mutex_enter_timeout_ms(&Mutex[vol], FF_FS_TIMEOUT)) {
+			MutexStats[vol].timeouts++;	/* Not under the mutex; may undercount */
+			return 0;
+		}
+		MutexStats[vol].contended++;
+	}
+	MutexStats[vol].takes++;
+	return 1;
+
 #endif
 }
 
@@ -201,6 +291,9 @@ void ff_mutex_give (
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexRelease(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	mutex_exit(&Mutex[vol]);
+
 #endif
 }
 
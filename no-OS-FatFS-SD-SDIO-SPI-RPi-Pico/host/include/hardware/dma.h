@@ -0,0 +1,8 @@
+/* Host stand-in; see ../pico.h */
+#pragma once
+
+#include "pico.h"
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
@@ -0,0 +1,11 @@
+/* Host stand-in; see ../pico.h */
+#pragma once
+
+#include "pico.h"
+
+enum gpio_drive_strength {
+    GPIO_DRIVE_STRENGTH_2MA = 0,
+    GPIO_DRIVE_STRENGTH_4MA = 1,
+    GPIO_DRIVE_STRENGTH_8MA = 2,
+    GPIO_DRIVE_STRENGTH_12MA = 3
+};
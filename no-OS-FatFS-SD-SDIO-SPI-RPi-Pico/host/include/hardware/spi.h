@@ -0,0 +1,6 @@
+/* Host stand-in; see ../pico.h */
+#pragma once
+
+#include "pico.h"
+
+typedef struct spi_inst spi_inst_t;
@@ -0,0 +1,18 @@
+/* pico.h
+
+Minimal stand-in for the Pico SDK base header so that the SD card and FatFs
+headers can be compiled for the host. Only what those headers reference is
+provided; nothing here talks to hardware.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#define __compiler_memory_barrier() __asm__ volatile("" : : : "memory")
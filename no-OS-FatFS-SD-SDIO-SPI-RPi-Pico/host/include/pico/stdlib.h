@@ -0,0 +1,28 @@
+/* Host stand-in; see ../pico.h */
+#pragma once
+
+#include <time.h>
+
+#include "pico.h"
+#include "pico/types.h"
+
+typedef uint64_t absolute_time_t;
+
+static inline void tight_loop_contents(void) {}
+
+// Time since the first call stands in for time since boot
+static inline uint64_t time_us_64(void) {
+    static uint64_t boot_us;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (!boot_us) boot_us = us - 1;
+    return us - boot_us;
+}
+static inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+static inline void sleep_ms(uint32_t ms) {
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
@@ -0,0 +1,4 @@
+/* Host stand-in; see ../pico.h */
+#pragma once
+
+#include "pico.h"
@@ -0,0 +1,139 @@
+/* sd_driver_host.c
+
+Host replacements for the parts of sd_card.c, my_debug.c and my_rtc.c that
+touch Pico hardware. Together with Image/sd_card_image.c this is enough to run
+ff15 and glue.c against a disk image on Linux.
+
+As on the Pico, the application supplies sd_get_num() and sd_get_by_num()
+(see hw_config.c); its cards must use SD_IF_IMAGE.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+//
+#include "pico/mutex.h"
+//
+#include "Image/sd_card_image.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+
+static bool driver_initialized;
+
+void sd_lock(sd_card_t *sd_card_p) {
+    myASSERT(mutex_is_initialized(&sd_card_p->state.mutex));
+    mutex_enter_blocking(&sd_card_p->state.mutex);
+}
+void sd_unlock(sd_card_t *sd_card_p) {
+    myASSERT(mutex_is_initialized(&sd_card_p->state.mutex));
+    mutex_exit(&sd_card_p->state.mutex);
+}
+bool sd_is_locked(sd_card_t *sd_card_p) {
+    myASSERT(mutex_is_initialized(&sd_card_p->state.mutex));
+    uint32_t owner_out;
+    if (!mutex_try_enter(&sd_card_p->state.mutex, &owner_out)) return true;
+    mutex_exit(&sd_card_p->state.mutex);
+    return false;
+}
+
+/* A disk image is always "inserted" */
+bool sd_card_detect(sd_card_t *sd_card_p) {
+    sd_card_p->state.m_Status &= ~STA_NODISK;
+    return true;
+}
+
+bool sd_init_driver() {
+    static pthread_mutex_t initialized_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&initialized_mutex);
+    if (!driver_initialized) {
+        myASSERT(sd_get_num());
+        for (size_t i = 0; i < sd_get_num(); ++i) {
+            sd_card_t *sd_card_p = sd_get_by_num(i);
+            if (!sd_card_p) continue;
+            myASSERT(SD_IF_IMAGE == sd_card_p->type);
+            if (!mutex_is_initialized(&sd_card_p->state.mutex))
+                mutex_init(&sd_card_p->state.mutex);
+            snprintf(sd_card_p->state.drive_prefix, sizeof sd_card_p->state.drive_prefix,
+                     "%zu:", i);
+            sd_image_ctor(sd_card_p);
+        }
+        driver_initialized = true;
+    }
+    pthread_mutex_unlock(&initialized_mutex);
+    return true;
+}
+
+/* The image has no SD Status register; the AU size is configured */
+bool sd_allocation_unit(sd_card_t *sd_card_p, size_t *au_size_bytes_p) {
+    if (!sd_card_p->image_if_p->au_size_bytes) return false;
+    *au_size_bytes_p = sd_card_p->image_if_p->au_size_bytes;
+    return true;
+}
+
+void sd_write_stream_begin(sd_card_t *sd_card_p, uint32_t lba, uint32_t n_blocks) {
+    sd_lock(sd_card_p);
+    sd_card_p->state.wr_stream_lba = lba;
+    sd_card_p->state.wr_stream_blks = n_blocks;
+    sd_unlock(sd_card_p);
+}
+
+char const *sd_get_drive_prefix(sd_card_t *sd_card_p) {
+    myASSERT(driver_initialized);
+    if (!sd_card_p) return "";
+    return sd_card_p->state.drive_prefix;
+}
+
+/* my_debug.c */
+
+int error_message_printf(const char *func, int line, const char *fmt, ...) {
+    fprintf(stderr, "%s:%d: ", func, line);
+    va_list args;
+    va_start(args, fmt);
+    int cw = vfprintf(stderr, fmt, args);
+    va_end(args);
+    return cw;
+}
+int error_message_printf_plain(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int cw = vfprintf(stderr, fmt, args);
+    va_end(args);
+    return cw;
+}
+int info_message_printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int cw = vprintf(fmt, args);
+    va_end(args);
+    return cw;
+}
+int debug_message_printf(const char *func, int line, const char *fmt, ...) {
+    printf("%s:%d: ", func, line);
+    va_list args;
+    va_start(args, fmt);
+    int cw = vprintf(fmt, args);
+    va_end(args);
+    return cw;
+}
+void my_assert_func(const char *file, int line, const char *func, const char *pred) {
+    fprintf(stderr, "assertion \"%s\" failed: file \"%s\", line %d, function: %s\n", pred,
+            file, line, func);
+    abort();
+}
+
+/* my_rtc.c */
+
+DWORD get_fattime(void) {
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    return ((DWORD)(tm.tm_year - 80) << 25) | ((DWORD)(tm.tm_mon + 1) << 21) |
+           ((DWORD)tm.tm_mday << 16) | ((DWORD)tm.tm_hour << 11) | ((DWORD)tm.tm_min << 5) |
+           ((DWORD)tm.tm_sec >> 1);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,48 @@
+/* f_fastseek.h
+
+Fast seek (cluster link map table) support for files opened for random
+access: assets, music, save states.
+
+FF_USE_FASTSEEK lets f_lseek() and f_read() find clusters from an in-memory
+table (CLMT) instead of following the FAT chain, so a seek costs no FAT
+reads. The tables come from a small static pool so callers don't have to
+manage their lifetime.
+
+Note that in fast seek mode FatFs cannot grow the file: writes past the end
+stop at the current size. Preallocate writable files (e.g. with f_expand())
+before opening them with f_open_fastseek().
+*/
+#pragma once
+
+#include <stdbool.h>
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of files that can hold a link map at the same time */
+#ifndef FF_FASTSEEK_POOL_SLOTS
+#define FF_FASTSEEK_POOL_SLOTS 4
+#endif
+
+/* Table size per file in DWORDs; a file with n fragments needs 2 * n + 2 */
+#ifndef FF_FASTSEEK_TBL_SIZE
+#define FF_FASTSEEK_TBL_SIZE 64
+#endif
+
+/* Like f_open(), then build a link map for the file.
+   If no pool slot is free or the file is too fragmented for a table,
+   the file stays open in normal mode and FR_OK is still returned. */
+FRESULT f_open_fastseek(FIL *fp, const TCHAR *path, BYTE mode);
+
+/* Like f_close(), and return the link map to the pool */
+FRESULT f_close_fastseek(FIL *fp);
+
+/* True if the file has a link map, i.e. seeks do not touch the FAT */
+static inline bool f_is_fastseek(const FIL *fp) { return fp->cltbl != NULL; }
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,70 @@
+/* f_raw_stream.h
+
+Raw-sector streaming for contiguous files: music streams, large asset packs,
+replay files.
+
+f_raw_stream_open() checks once that a file occupies a single run of
+clusters and resolves the LBA of its first sector. After that,
+f_raw_stream_read() moves whole sectors from the card straight into the
+caller's buffer with one multi-block read (CMD18, DMA on SDIO). No cluster
+arithmetic, FAT lookups or copies through the FatFs sector window are
+involved.
+
+Files created with f_expand() (FF_USE_EXPAND) are always contiguous.
+
+f_raw_stream_write() goes the other way, for recordings into a preallocated
+file. The first write after opening or seeking tells the card how many
+sectors follow up to the end of the file (ACMD23), so it can erase them in
+one go, and the multi-block write (CMD25) it starts is kept open across
+calls for as long as they follow on from each other. Those sectors lose
+their old contents even if they end up not being written. The file size is
+not changed.
+
+Reading or writing the file through FatFs while it is being streamed is not
+supported.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct f_raw_stream_t {
+    BYTE pdrv;        // Physical drive hosting the file
+    LBA_t lba;        // First sector of the file
+    LBA_t n_sectors;  // Sectors holding file data (last one may be partial)
+    FSIZE_t size;     // File size in bytes
+    LBA_t pos;        // Next sector to read or write, relative to lba
+    bool writing;     // The card has been told about the sectors from pos on
+} f_raw_stream_t;
+
+/* Resolve the sector range of an open file.
+   Returns FR_DENIED if the file is fragmented or empty. The file can be
+   closed afterwards; the stream does not refer to it. */
+FRESULT f_raw_stream_open(FIL *fp, f_raw_stream_t *rs);
+
+/* Read up to count whole sectors from the current position into buff.
+   buff should be word aligned so that SDIO can DMA into it directly.
+   Sets *sectors_read to the number read; 0 at end of file. */
+FRESULT f_raw_stream_read(f_raw_stream_t *rs, void *buff, UINT count, UINT *sectors_read);
+
+/* Write up to count whole sectors from buff at the current position.
+   buff should be word aligned so that SDIO can DMA from it directly.
+   Sets *sectors_written to the number written; 0 at end of file. */
+FRESULT f_raw_stream_write(f_raw_stream_t *rs, const void *buff, UINT count,
+                           UINT *sectors_written);
+
+/* Move the position to sector index sector (clipped to the end) */
+static inline void f_raw_stream_seek(f_raw_stream_t *rs, LBA_t sector) {
+    rs->pos = sector < rs->n_sectors ? sector : rs->n_sectors;
+    rs->writing = false;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,6 +4,19 @@
 
 #define FFCONF_DEF	80286	/* Revision ID */
 
+#ifndef FF_LEAN
+#define FF_LEAN			0
+#endif
+#ifndef FF_LEAN_EXFAT
+#define FF_LEAN_EXFAT	1
+#endif
+/* FF_LEAN selects a reduced RAM profile, for applications that need the memory
+/  more than the file I/O speed. It switches to the tiny buffer configuration
+/  and cuts the number of volumes and file lock slots; see FF_FS_TINY,
+/  FF_VOLUMES and FF_FS_LOCK. With FF_LEAN_EXFAT = 0 the lean profile also drops
+/  exFAT support, which saves code and LFN working buffer space but leaves
+/  cards formatted exFAT (most of those over 32 GB) unreadable. */
+
 /*---------------------------------------------------------------------------/
 / Function Configurations
 /---------------------------------------------------------------------------*/
@@ -166,7 +179,7 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
-# define FF_VOLUMES		4
+# define FF_VOLUMES		(FF_LEAN ? 1 : 4)
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
@@ -203,7 +216,7 @@
 /  GET_SECTOR_SIZE command. */
 
 
-#define FF_LBA64		1
+#define FF_LBA64		FF_FS_EXFAT
 /* This option switches support for 64-bit LBA. (0:Disable or 1:Enable)
 /  To enable the 64-bit LBA, also exFAT needs to be enabled. (FF_FS_EXFAT == 1) */
 
@@ -224,14 +237,14 @@
 / System Configurations
 /---------------------------------------------------------------------------*/
 
-#define FF_FS_TINY		0
+#define FF_FS_TINY		FF_LEAN
 /* This option switches tiny buffer configuration. (0:Normal or 1:Tiny)
 /  At the tiny configuration, size of file object (FIL) is shrinked FF_MAX_SS bytes.
 /  Instead of private sector buffer eliminated from the file object, common sector
 /  buffer in the filesystem object (FATFS) is used for the file data transfer. */
 
 
-#define FF_FS_EXFAT		1
+#define FF_FS_EXFAT		(!FF_LEAN || FF_LEAN_EXFAT)
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)
 /  Note that enabling exFAT discards ANSI C (C89) compatibility. */
@@ -263,7 +276,7 @@
 */
 
 
-#define FF_FS_LOCK		16
+#define FF_FS_LOCK		(FF_LEAN ? 4 : 16)
 /* The option FF_FS_LOCK switches file lock function to control duplicated file open
 /  and illegal operation to open objects. This option must be 0 when FF_FS_READONLY
 /  is 1.
@@ -275,7 +288,7 @@
 /      lock control is independent of re-entrancy. */
 
 
-#define FF_FS_REENTRANT	0
+#define FF_FS_REENTRANT	1
 #define FF_FS_TIMEOUT	1000
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
@@ -289,6 +302,8 @@
 /      function, must be added to the project. Samples are available in ffsystem.c.
 /
 /  The FF_FS_TIMEOUT defines timeout period in unit of O/S time tick.
+/  With the Pico SDK hooks in ffsystem.c the tick is one millisecond, so both
+/  cores may call FatFs. See ffsystem.c for the lock ordering.
 */
 
 
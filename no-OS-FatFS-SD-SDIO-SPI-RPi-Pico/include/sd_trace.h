@@ -0,0 +1,100 @@
+/* sd_trace.h
+
+Block layer tracing.
+
+Every disk_read(), disk_write() and CTRL_SYNC that reaches a card is
+recorded: operation, LBA, sector count, duration, result, and how many
+command retries, CRC errors and data token poll bytes the driver went
+through on the way. The last SD_TRACE_RING_SIZE operations are kept in a
+RAM ring, and all of them go into log2 latency histograms per operation.
+
+sd_trace_dump() prints both, e.g. over USB stdio, to find out where a
+slow load spent its time.
+
+Define SD_TRACE as 0 to compile the tracing out.
+*/
+#pragma once
+
+#include <stdint.h>
+//
+#include "sd_card.h"
+#include "util.h"
+
+#ifndef SD_TRACE
+#define SD_TRACE 1
+#endif
+#ifndef SD_TRACE_RING_SIZE
+#define SD_TRACE_RING_SIZE 64  // Must be a power of 2
+#endif
+#define SD_TRACE_BUCKETS 24  // Bucket n counts durations in [2^n, 2^(n+1)) us
+#ifndef SD_TRACE_STALL_US
+#define SD_TRACE_STALL_US 10000  // Operations this slow count as stalls
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    SD_TRACE_READ,
+    SD_TRACE_WRITE,
+    SD_TRACE_SYNC,
+    SD_TRACE_OPS
+} sd_trace_op_t;
+
+typedef struct sd_trace_entry_t {
+    uint32_t start_us;     // Low 32 bits of the start time
+    uint32_t duration_us;
+    uint32_t lba;
+    uint16_t count;        // Sectors
+    uint16_t rc;           // block_dev_err_t
+    uint16_t token_spins;  // Saturates at 0xFFFF
+    uint8_t op;            // sd_trace_op_t
+    uint8_t pdrv;
+    uint8_t retries;
+    uint8_t crc_errors;
+} sd_trace_entry_t;
+
+// Driver event counters at the start of an operation
+typedef struct sd_trace_mark_t {
+    uint64_t start_us;
+    uint32_t retries;
+    uint32_t crc_errors;
+    uint32_t token_spins;
+} sd_trace_mark_t;
+
+#if SD_TRACE
+
+sd_trace_mark_t sd_trace_begin(sd_card_t *sd_card_p);
+void sd_trace_end(sd_card_t *sd_card_p, const sd_trace_mark_t *mark, uint8_t pdrv,
+                  sd_trace_op_t op, uint32_t lba, uint32_t count, int rc);
+void sd_trace_dump(printer_t printer);
+void sd_trace_reset(void);
+// Operations that took SD_TRACE_STALL_US or more, and the slowest of any.
+// Without the lock, so cheap enough for a frame loop; the two may be an
+// operation apart.
+uint32_t sd_trace_stalls(uint32_t *worst_us);
+
+#else
+
+static inline sd_trace_mark_t sd_trace_begin(sd_card_t *sd_card_p) {
+    (void)sd_card_p;
+    return (sd_trace_mark_t){0};
+}
+static inline void sd_trace_end(sd_card_t *sd_card_p, const sd_trace_mark_t *mark,
+                                uint8_t pdrv, sd_trace_op_t op, uint32_t lba,
+                                uint32_t count, int rc) {
+    (void)sd_card_p, (void)mark, (void)pdrv, (void)op, (void)lba, (void)count, (void)rc;
+}
+static inline void sd_trace_dump(printer_t printer) { (void)printer; }
+static inline void sd_trace_reset(void) {}
+static inline uint32_t sd_trace_stalls(uint32_t *worst_us) {
+    *worst_us = 0;
+    return 0;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,185 @@
+/* sd_card_image.c
+
+Host-side block device backed by a FAT/exFAT disk image file.
+See sd_card_image.h.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+//
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "sd_card_image.h"
+
+#define STATE sd_card_p->image_if_p->state
+
+// Charge one command moving n_bytes to the latency model
+static void sd_image_account(sd_card_t *sd_card_p, bool new_cmd, uint64_t n_bytes,
+                             uint32_t n_wr_blocks) {
+    const sd_image_timing_t *t = &sd_card_p->image_if_p->timing;
+    uint64_t ns = (new_cmd ? (uint64_t)t->cmd_latency_us * 1000 : 0) + n_bytes * t->byte_latency_ns +
+                  (uint64_t)n_wr_blocks * t->write_busy_us * 1000;
+    STATE.stats.simulated_us += ns / 1000;
+    if (sd_card_p->image_if_p->sleep && ns) {
+        struct timespec ts = {.tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000};
+        while (nanosleep(&ts, &ts) && EINTR == errno)
+            ;
+    }
+}
+
+// A simulated removal drops the card back to uninitialized, as a real one
+// would lose power
+static bool sd_image_ejected(sd_card_t *sd_card_p) {
+    if (!sd_card_p->image_if_p->ejected) return false;
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    return true;
+}
+
+static DSTATUS sd_image_init(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    if (sd_image_ejected(sd_card_p)) {
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    if (!(sd_card_p->state.m_Status & STA_NOINIT)) {
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    int flags = sd_card_p->image_if_p->read_only ? O_RDONLY : O_RDWR;
+    if (STATE.fd >= 0) close(STATE.fd);  // Left open by a simulated removal
+    STATE.fd = open(sd_card_p->image_if_p->path, flags);
+    if (STATE.fd < 0) {
+        EMSG_PRINTF("open(%s) failed: %s\n", sd_card_p->image_if_p->path, strerror(errno));
+        sd_card_p->state.m_Status |= STA_NODISK;
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    struct stat st;
+    if (fstat(STATE.fd, &st) || (uint64_t)st.st_size < sd_block_size) {
+        EMSG_PRINTF("%s: not a usable disk image\n", sd_card_p->image_if_p->path);
+        close(STATE.fd);
+        STATE.fd = -1;
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    STATE.ongoing_mlt_blk_wrt = false;
+    sd_card_p->state.sectors = st.st_size / sd_block_size;
+    sd_card_p->state.card_type = SDCARD_V2HC;
+    sd_card_p->state.m_Status &= ~(STA_NOINIT | STA_NODISK);
+    if (sd_card_p->image_if_p->read_only) sd_card_p->state.m_Status |= STA_PROTECT;
+    sd_unlock(sd_card_p);
+    return sd_card_p->state.m_Status;
+}
+
+static void sd_image_deinit(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    if (STATE.fd >= 0) close(STATE.fd);
+    STATE.fd = -1;
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_card_p->state.card_type = SDCARD_NONE;
+    sd_unlock(sd_card_p);
+}
+
+static block_dev_err_t sd_image_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
+                                            uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    if (sd_image_ejected(sd_card_p)) return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    if (sd_card_p->state.m_Status & STA_NOINIT) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if ((uint64_t)ulSectorNumber + ulSectorCount > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    sd_lock(sd_card_p);
+    size_t len = (size_t)ulSectorCount * sd_block_size;
+    ssize_t rc = pread(STATE.fd, buffer, len, (off_t)ulSectorNumber * sd_block_size);
+    STATE.stats.read_cmds++;
+    STATE.stats.blocks_read += ulSectorCount;
+    STATE.ongoing_mlt_blk_wrt = false;
+    sd_image_account(sd_card_p, true, len, 0);
+    sd_unlock(sd_card_p);
+    return (size_t)rc == len ? SD_BLOCK_DEVICE_ERROR_NONE : SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+}
+
+static block_dev_err_t sd_image_write_blocks(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                             uint32_t ulSectorNumber, uint32_t blockCnt) {
+    if (sd_image_ejected(sd_card_p)) return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    if (sd_card_p->state.m_Status & STA_NOINIT) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (sd_card_p->image_if_p->read_only) return SD_BLOCK_DEVICE_ERROR_WRITE_PROTECTED;
+    if ((uint64_t)ulSectorNumber + blockCnt > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    sd_lock(sd_card_p);
+    size_t len = (size_t)blockCnt * sd_block_size;
+    ssize_t rc = pwrite(STATE.fd, buffer, len, (off_t)ulSectorNumber * sd_block_size);
+    bool cont = STATE.ongoing_mlt_blk_wrt && STATE.cont_sector_wrt == ulSectorNumber;
+    if (!cont) {
+        STATE.stats.write_cmds++;
+        if (sd_card_p->state.wr_stream_blks && sd_card_p->state.wr_stream_lba == ulSectorNumber) {
+            STATE.stats.pre_erase_cmds++;
+            STATE.stats.pre_erase_blocks += sd_card_p->state.wr_stream_blks;
+        }
+        sd_card_p->state.wr_stream_blks = 0;
+    }
+    STATE.stats.blocks_written += blockCnt;
+    STATE.ongoing_mlt_blk_wrt = true;
+    STATE.cont_sector_wrt = ulSectorNumber + blockCnt;
+    sd_image_account(sd_card_p, !cont, len, blockCnt);
+    sd_unlock(sd_card_p);
+    return (size_t)rc == len ? SD_BLOCK_DEVICE_ERROR_NONE : SD_BLOCK_DEVICE_ERROR_WRITE;
+}
+
+// Like the SPI and SDIO drivers, only an open multi-block write costs a
+// command (STOP_TRAN)
+static block_dev_err_t sd_image_sync(sd_card_t *sd_card_p) {
+    if (sd_image_ejected(sd_card_p)) return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    if (sd_card_p->state.m_Status & STA_NOINIT) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    sd_lock(sd_card_p);
+    if (STATE.ongoing_mlt_blk_wrt) {
+        STATE.stats.sync_cmds++;
+        STATE.ongoing_mlt_blk_wrt = false;
+        sd_image_account(sd_card_p, true, 0, 0);
+    }
+    int rc = sd_card_p->image_if_p->read_only ? 0 : fdatasync(STATE.fd);
+    sd_unlock(sd_card_p);
+    return rc ? SD_BLOCK_DEVICE_ERROR_WRITE : SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static bool sd_image_write_open(sd_card_t *sd_card_p) {
+    return STATE.ongoing_mlt_blk_wrt;
+}
+
+static uint32_t sd_image_sectors(sd_card_t *sd_card_p) {
+    return sd_card_p->state.sectors;
+}
+
+// A card inside a multi-block write takes CMD13 for data and does not
+// answer, and sd_spi_test_com() then marks it uninitialized. Close the
+// write with sync first, or check write_open.
+static bool sd_image_test_com(sd_card_t *sd_card_p) {
+    if (sd_image_ejected(sd_card_p) || access(sd_card_p->image_if_p->path, R_OK)) return false;
+    sd_lock(sd_card_p);
+    bool silent = !(sd_card_p->state.m_Status & STA_NOINIT) && STATE.ongoing_mlt_blk_wrt;
+    if (silent) sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_unlock(sd_card_p);
+    return !silent;
+}
+
+void sd_image_ctor(sd_card_t *sd_card_p) {
+    myASSERT(sd_card_p->image_if_p);  // Must have an interface object
+    myASSERT(sd_card_p->image_if_p->path);
+    STATE.fd = -1;
+    sd_card_p->state.m_Status = STA_NOINIT;
+
+    sd_card_p->init = sd_image_init;
+    sd_card_p->deinit = sd_image_deinit;
+    sd_card_p->write_blocks = sd_image_write_blocks;
+    sd_card_p->read_blocks = sd_image_read_blocks;
+    sd_card_p->sync = sd_image_sync;
+    sd_card_p->write_open = sd_image_write_open;
+    sd_card_p->get_num_sectors = sd_image_sectors;
+    sd_card_p->sd_test_com = sd_image_test_com;
+}
+/* [] END OF FILE */
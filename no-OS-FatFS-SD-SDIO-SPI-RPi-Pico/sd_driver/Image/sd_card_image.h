@@ -0,0 +1,91 @@
+/* sd_card_image.h
+
+Host-side block device backed by a FAT/exFAT disk image file.
+
+This lets the FatFs stack (ff15, glue.c) and the code that sits on top of it
+run on a development machine, with a configurable latency model standing in
+for the SPI or SDIO transport. It is not built for the Pico.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Latency model applied to every block command.
+   A command costs cmd_latency_us plus byte_latency_ns for each byte moved,
+   plus write_busy_us per written block (the card's programming time).
+   Like the SPI and SDIO drivers, a write that carries on where the previous
+   one ended continues the open multi-block write and pays no command
+   latency. */
+typedef struct sd_image_timing_t {
+    uint32_t cmd_latency_us;
+    uint32_t byte_latency_ns;
+    uint32_t write_busy_us;
+} sd_image_timing_t;
+
+/* Roughly a class 10 card on the 31.25 MHz SPI bus in hw_config.c */
+#define SD_IMAGE_TIMING_SPI  ((sd_image_timing_t){.cmd_latency_us = 150, .byte_latency_ns = 256, .write_busy_us = 250})
+/* Roughly the same card on a 4-bit SDIO bus at clk_sys / 12 */
+#define SD_IMAGE_TIMING_SDIO ((sd_image_timing_t){.cmd_latency_us = 40, .byte_latency_ns = 80, .write_busy_us = 250})
+/* The same two after switching to High Speed (CMD6): SPI at 50 MHz, and
+   SDIO at clk_sys / 6 */
+#define SD_IMAGE_TIMING_SPI_HS  ((sd_image_timing_t){.cmd_latency_us = 150, .byte_latency_ns = 160, .write_busy_us = 250})
+#define SD_IMAGE_TIMING_SDIO_HS ((sd_image_timing_t){.cmd_latency_us = 40, .byte_latency_ns = 40, .write_busy_us = 250})
+/* No added latency at all */
+#define SD_IMAGE_TIMING_NONE ((sd_image_timing_t){0})
+
+typedef struct sd_image_stats_t {
+    uint32_t read_cmds;
+    uint32_t write_cmds;
+    uint32_t sync_cmds;
+    uint64_t blocks_read;
+    uint64_t blocks_written;
+    uint32_t pre_erase_cmds;     // ACMD23s that would have been sent
+    uint64_t pre_erase_blocks;
+    uint64_t simulated_us;  // Total modelled bus time
+} sd_image_stats_t;
+
+typedef struct sd_image_if_t {
+    const char *path;  // Disk image file
+    bool read_only;
+    sd_image_timing_t timing;
+    // If true, the modelled latency is also spent in real time (nanosleep).
+    // Otherwise it is only accumulated into stats.simulated_us, which keeps
+    // benchmarks deterministic.
+    bool sleep;
+    // Set to simulate pulling the card: commands fail as if nothing answered
+    // and the card needs initializing again once this is cleared.
+    volatile bool ejected;
+    // Reported by sd_allocation_unit(); 0 for unknown
+    uint32_t au_size_bytes;
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    struct {
+        int fd;
+        sd_image_stats_t stats;
+        bool ongoing_mlt_blk_wrt;
+        uint32_t cont_sector_wrt;
+    } state;
+} sd_image_if_t;
+
+void sd_image_ctor(sd_card_t *sd_card_p);  // Constructor for sd_card_t
+
+static inline sd_image_stats_t sd_image_stats(sd_card_t *sd_card_p) {
+    return sd_card_p->image_if_p->state.stats;
+}
+static inline void sd_image_reset_stats(sd_card_t *sd_card_p) {
+    sd_card_p->image_if_p->state.stats = (sd_image_stats_t){0};
+}
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -28,6 +28,7 @@
 #include "hw_config.h"
 #include "rp2040_sdio.h"
 #include "rp2040_sdio.pio.h"
+#include "sdio_crc.h"
 #include "delays.h"
 #include "sd_card.h"
 #include "sd_timeouts.h"
@@ -56,7 +57,25 @@
 
 
 // Force everything to idle state
-static sdio_status_t rp2040_sdio_stop(sd_card_t *sd_card_p);
+static sdio_status_t __not_in_flash_func(rp2040_sdio_stop)(sd_card_t *sd_card_p);
+
+// Enable or disable the completion interrupt of the second DMA channel.
+// Any pending request is cleared before enabling.
+static void __not_in_flash_func(sdio_set_chb_irq_enabled)(sd_card_t *sd_card_p, bool enabled)
+{
+    switch (sd_card_p->sdio_if_p->DMA_IRQ_num) {
+        case DMA_IRQ_0:
+            if (enabled) dma_hw->ints0 = 1 << SDIO_DMA_CHB;
+            dma_channel_set_irq0_enabled(SDIO_DMA_CHB, enabled);
+            break;
+        case DMA_IRQ_1:
+            if (enabled) dma_hw->ints1 = 1 << SDIO_DMA_CHB;
+            dma_channel_set_irq1_enabled(SDIO_DMA_CHB, enabled);
+            break;
+        default:
+            myASSERT(false);
+    }
+}
 
 /*******************************************************
  * Checksum algorithms
@@ -86,44 +105,6 @@ static const uint8_t crc7_table[256] = {
 	0x1c, 0x0e, 0x38, 0x2a, 0x54, 0x46, 0x70, 0x62,	0x8c, 0x9e, 0xa8, 0xba, 0xc4, 0xd6, 0xe0, 0xf2
 };
 
-// Calculate the CRC16 checksum for parallel 4 bit lines separately.
-// When the SDIO bus operates in 4-bit mode, the CRC16 algorithm
-// is applied to each line separately and generates total of
-// 4 x 16 = 64 bits of checksum.
-__attribute__((optimize("Ofast")))
-uint64_t sdio_crc16_4bit_checksum(uint32_t *data, uint32_t num_words)
-{
-    uint64_t crc = 0;
-    uint32_t *end = data + num_words;
-    while (data < end)
-    {
-        for (int unroll = 0; unroll < 4; unroll++)
-        {
-            // Each 32-bit word contains 8 bits per line.
-            // Reverse the bytes because SDIO protocol is big-endian.
-            uint32_t data_in = __builtin_bswap32(*data++);
-
-            // Shift out 8 bits for each line
-            uint32_t data_out = crc >> 32;
-            crc <<= 32;
-
-            // XOR outgoing data to itself with 4 bit delay
-            data_out ^= (data_out >> 16);
-
-            // XOR incoming data to outgoing data with 4 bit delay
-            data_out ^= (data_in >> 16);
-
-            // XOR outgoing and incoming data to accumulator at each tap
-            uint64_t xorred = data_out ^ data_in;
-            crc ^= xorred;
-            crc ^= xorred << (5 * 4);
-            crc ^= xorred << (12 * 4);
-        }
-    }
-
-    return crc;
-}
-
 /*******************************************************
  * Basic SDIO command execution
  *******************************************************/
@@ -358,6 +339,7 @@ sdio_status_t rp2040_sdio_rx_start(sd_card_t *sd_card_p, uint8_t *buffer, uint32
     STATE.total_blocks = num_blocks;
     STATE.blocks_checksumed = 0;
     STATE.checksum_errors = 0;
+    STATE.rx_block_size_words = block_size / sizeof(uint32_t);
 
     // Create DMA block descriptors to store each block of 512 bytes of data to buffer
     // and then 8 bytes to STATE.received_checksums.
@@ -403,6 +385,11 @@ sdio_status_t rp2040_sdio_rx_start(sd_card_t *sd_card_p, uint8_t *buffer, uint32
     // This gives more leeway for the DMA block switching
     SDIO_PIO->sm[SDIO_DATA_SM].shiftctrl |= PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS;
 
+    // Interrupt every time the second channel has reloaded the first one.
+    // The IRQ handler verifies checksums of completed blocks while the
+    // following blocks are still being received.
+    sdio_set_chb_irq_enabled(sd_card_p, true);
+
     // Start PIO and DMA
     dma_channel_start(SDIO_DMA_CHB);
     pio_sm_set_enabled(SDIO_PIO, SDIO_DATA_SM, true);
@@ -411,9 +398,12 @@ sdio_status_t rp2040_sdio_rx_start(sd_card_t *sd_card_p, uint8_t *buffer, uint32
 }
 
 // Check checksums for received blocks
-static void sdio_verify_rx_checksums(sd_card_t *sd_card_p, uint32_t maxcount, size_t block_size_words)
+// Called from the DMA IRQ handler, so errors are only recorded here and
+// reported by rp2040_sdio_rx_poll() once the transfer has completed.
+static void __not_in_flash_func(sdio_verify_rx_checksums)(sd_card_t *sd_card_p)
 {
-    while (STATE.blocks_checksumed < STATE.blocks_done && maxcount-- > 0)
+    size_t block_size_words = STATE.rx_block_size_words;
+    while (STATE.blocks_checksumed < STATE.blocks_done)
     {
         // Calculate checksum from received data
         int blockidx = STATE.blocks_checksumed++;
@@ -430,16 +420,29 @@ static void sdio_verify_rx_checksums(sd_card_t *sd_card_p, uint32_t maxcount, si
             STATE.checksum_errors++;
             if (STATE.checksum_errors == 1)
             {
-                EMSG_PRINTF("SDIO checksum error in reception: block %d calculated 0x%llx expected 0x%llx\n",
-                    blockidx, checksum, expected);
-                dump_bytes(block_size_words, (uint8_t *)STATE.data_buf + blockidx * block_size_words);
+                STATE.first_checksum_error.block = blockidx;
+                STATE.first_checksum_error.calculated = checksum;
+                STATE.first_checksum_error.expected = expected;
             }
         }
     }
 }
 
+// Compute how many complete SDIO blocks have been transferred
+static void __not_in_flash_func(sdio_update_rx_blocks_done)(sd_card_t *sd_card_p)
+{
+    // Check how many DMA control blocks have been consumed
+    uint32_t dma_ctrl_block_count = (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&STATE.dma_blocks);
+    dma_ctrl_block_count /= sizeof(STATE.dma_blocks[0]);
+
+    // When transfer ends, dma_ctrl_block_count == STATE.total_blocks * 2 + 1
+    STATE.blocks_done = (dma_ctrl_block_count - 1) / 2;
+}
+
 sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
 {
+    myASSERT(block_size_words == STATE.rx_block_size_words);
+
     // Was everything done when the previous rx_poll() finished?
     if (STATE.blocks_done >= STATE.total_blocks)
     {
@@ -447,16 +450,8 @@ sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
     }
     else
     {
-        // Use the idle time to calculate checksums
-        sdio_verify_rx_checksums(sd_card_p, 4, block_size_words);
-
-        // Check how many DMA control blocks have been consumed
-        uint32_t dma_ctrl_block_count = (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&STATE.dma_blocks);
-        dma_ctrl_block_count /= sizeof(STATE.dma_blocks[0]);
-
-        // Compute how many complete SDIO blocks have been transferred
-        // When transfer ends, dma_ctrl_block_count == STATE.total_blocks * 2 + 1
-        STATE.blocks_done = (dma_ctrl_block_count - 1) / 2;
+        // Checksums are verified by the IRQ handler as each block completes.
+        sdio_update_rx_blocks_done(sd_card_p);
 
         // NOTE: When all blocks are done, rx_poll() still returns SDIO_BUSY once.
         // This provides a chance to start the SCSI transfer before the last checksums
@@ -466,13 +461,20 @@ sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
 
     if (STATE.transfer_state == SDIO_IDLE)
     {
-        // Verify all remaining checksums.
-        sdio_verify_rx_checksums(sd_card_p, STATE.total_blocks, block_size_words);
+        sdio_set_chb_irq_enabled(sd_card_p, false);
+
+        // Verify any checksums the IRQ handler has not caught up with yet.
+        sdio_verify_rx_checksums(sd_card_p);
 
         if (STATE.checksum_errors == 0)
             return SDIO_OK;
-        else
-            return SDIO_ERR_DATA_CRC;
+
+        EMSG_PRINTF("SDIO checksum error in reception: block %lu calculated 0x%llx expected 0x%llx\n",
+            STATE.first_checksum_error.block, STATE.first_checksum_error.calculated,
+            STATE.first_checksum_error.expected);
+        dump_bytes(block_size_words,
+            (uint8_t *)(STATE.data_buf + STATE.first_checksum_error.block * block_size_words));
+        return SDIO_ERR_DATA_CRC;
     }
     else if (millis() - STATE.transfer_start_time >= sd_timeouts.rp2040_sdio_rx_poll)
     {
@@ -493,7 +495,7 @@ sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
  * Data transmission to SD card
  *******************************************************/
 
-static void sdio_start_next_block_tx(sd_card_t *sd_card_p)
+static void __not_in_flash_func(sdio_start_next_block_tx)(sd_card_t *sd_card_p)
 {
     // Initialize PIO
     pio_sm_init(SDIO_PIO, SDIO_DATA_SM, STATE.pio_data_tx_offset, &STATE.pio_cfg_data_tx);
@@ -520,20 +522,7 @@ static void sdio_start_next_block_tx(sd_card_t *sd_card_p)
         &SDIO_PIO->txf[SDIO_DATA_SM], STATE.end_token_buf, 3, false);
 
     // Enable IRQ to trigger when block is done
-    switch (sd_card_p->sdio_if_p->DMA_IRQ_num) {
-        case DMA_IRQ_0:
-            // Clear any pending interrupt service request:
-            dma_hw->ints0 = 1 << SDIO_DMA_CHB;
-            dma_channel_set_irq0_enabled(SDIO_DMA_CHB, true);
-            break;
-        case DMA_IRQ_1:
-            // Clear any pending interrupt service request:
-            dma_hw->ints1 = 1 << SDIO_DMA_CHB;
-            dma_channel_set_irq1_enabled(SDIO_DMA_CHB, true);
-            break;
-        default:
-            assert(false);
-    }
+    sdio_set_chb_irq_enabled(sd_card_p, true);
 
     // Initialize register X with nibble count and register Y with response bit count
     pio_sm_put(SDIO_PIO, SDIO_DATA_SM, 1048);
@@ -553,7 +542,7 @@ static void sdio_start_next_block_tx(sd_card_t *sd_card_p)
     pio_sm_set_enabled(SDIO_PIO, SDIO_DATA_SM, true);
 }
 
-static void sdio_compute_next_tx_checksum(sd_card_t *sd_card_p)
+static void __not_in_flash_func(sdio_compute_next_tx_checksum)(sd_card_t *sd_card_p)
 {
     assert (STATE.blocks_done < STATE.total_blocks && STATE.blocks_checksumed < STATE.total_blocks);
     int blockidx = STATE.blocks_checksumed++;
@@ -590,7 +579,7 @@ sdio_status_t rp2040_sdio_tx_start(sd_card_t *sd_card_p, const uint8_t *buffer,
     return SDIO_OK;
 }
 
-static sdio_status_t check_sdio_write_response(uint32_t card_response)
+static sdio_status_t __not_in_flash_func(check_sdio_write_response)(uint32_t card_response)
 {
     // Shift card response until top bit is 0 (the start bit)
     // The format of response is poorly documented in SDIO spec but refer to e.g.
@@ -626,7 +615,16 @@ static sdio_status_t check_sdio_write_response(uint32_t card_response)
 }
 
 // When a block finishes, this IRQ handler starts the next one
-void sdio_irq_handler(sd_card_t *sd_card_p) {
+// (transmit) or verifies the checksum of the one just received (receive).
+// It runs once per block, so it and everything it calls stay in RAM.
+void __not_in_flash_func(sdio_irq_handler)(sd_card_t *sd_card_p) {
+    if (STATE.transfer_state == SDIO_RX)
+    {
+        sdio_update_rx_blocks_done(sd_card_p);
+        sdio_verify_rx_checksums(sd_card_p);
+        return;
+    }
+
     if (STATE.transfer_state == SDIO_TX)
     {
         if (!dma_channel_is_busy(SDIO_DMA_CH) && !dma_channel_is_busy(SDIO_DMA_CHB))
@@ -728,20 +726,11 @@ sdio_status_t rp2040_sdio_tx_poll(sd_card_t *sd_card_p, uint32_t *bytes_complete
 }
 
 // Force everything to idle state
-static sdio_status_t rp2040_sdio_stop(sd_card_t *sd_card_p)
+static sdio_status_t __not_in_flash_func(rp2040_sdio_stop)(sd_card_t *sd_card_p)
 {
     dma_channel_abort(SDIO_DMA_CH);
     dma_channel_abort(SDIO_DMA_CHB);
-    switch (sd_card_p->sdio_if_p->DMA_IRQ_num) {
-    case DMA_IRQ_0:
-            dma_channel_set_irq0_enabled(SDIO_DMA_CHB, false);
-        break;
-    case DMA_IRQ_1:
-            dma_channel_set_irq1_enabled(SDIO_DMA_CHB, false);
-        break;
-    default:
-        myASSERT(false);
-    }
+    sdio_set_chb_irq_enabled(sd_card_p, false);
 
     pio_sm_set_enabled(SDIO_PIO, SDIO_DATA_SM, false);
     pio_sm_set_consecutive_pindirs(SDIO_PIO, SDIO_DATA_SM, SDIO_D0, 4, false);    
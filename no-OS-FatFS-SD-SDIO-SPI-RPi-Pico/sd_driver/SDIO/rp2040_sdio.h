@@ -63,6 +63,12 @@ typedef struct sd_sdio_if_state_t {
     uint32_t total_blocks; // Total number of blocks to transfer
     uint32_t blocks_checksumed; // Number of blocks that have had CRC calculated
     uint32_t checksum_errors; // Number of checksum errors detected
+    uint32_t rx_block_size_words; // Block size of the ongoing reception
+    struct {
+        uint32_t block;
+        uint64_t calculated;
+        uint64_t expected;
+    } first_checksum_error; // Recorded in IRQ context, reported by rx_poll()
 
     // Variables for block writes
     uint64_t next_wr_block_checksum;
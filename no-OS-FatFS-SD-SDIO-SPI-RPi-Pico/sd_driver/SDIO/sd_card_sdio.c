@@ -70,6 +70,15 @@ static char const *errstr(sdio_status_t error) {
 static bool logSDError(sd_card_t *sd_card_p, int line)
 {
     STATE.error_line = line;
+    switch (STATE.error) {
+        case SDIO_ERR_RESPONSE_CRC:
+        case SDIO_ERR_DATA_CRC:
+        case SDIO_ERR_WRITE_CRC:
+            sd_card_p->state.io_crc_errors++;
+            break;
+        default:
+            break;
+    }
     EMSG_PRINTF("%s at line %d; error code %d\n", 
         errstr(STATE.error), line, (int)STATE.error);
     return false;
@@ -90,6 +99,16 @@ static float calculate_clk_div(uint baud) {
     return div;
 }
 
+// The configured rate, as far as the card's access mode allows. Without a
+// configured rate, clk_sys / 12, or clk_sys / 6 in High Speed.
+static uint sd_sdio_baud_rate(sd_card_t *sd_card_p) {
+    uint baud_rate = sd_card_p->sdio_if_p->baud_rate;
+    if (!baud_rate)
+        baud_rate = clock_get_hz(clk_sys) / (sd_card_p->state.high_speed ? 6 : 12);
+    if (baud_rate > sd_max_clock_hz(sd_card_p)) baud_rate = sd_max_clock_hz(sd_card_p);
+    return baud_rate;
+}
+
 bool sd_sdio_begin(sd_card_t *sd_card_p)
 {
     uint32_t reply;
@@ -204,15 +223,51 @@ bool sd_sdio_begin(sd_card_t *sd_card_p)
         EMSG_PRINTF("%s,%d SDIO failed to set BLOCKLEN\n", __func__, __LINE__);
         return false;
     }
-    // Increase to high clock rate
-    if (!sd_card_p->sdio_if_p->baud_rate)
-        sd_card_p->sdio_if_p->baud_rate = clock_get_hz(clk_sys) / 12; // Default
-    if (!rp2040_sdio_init(sd_card_p, calculate_clk_div(sd_card_p->sdio_if_p->baud_rate)))
+    // Increase to high clock rate, within the Default Speed limit for now
+    if (!rp2040_sdio_init(sd_card_p, calculate_clk_div(sd_sdio_baud_rate(sd_card_p))))
         return false; 
 
+    // Switch to High Speed if the card can and raise the clock to match.
+    // If the SD Status does not read back at the new rate, go back down.
+    if (sd_switch_high_speed(sd_card_p, sd_sdio_cardCMD6)) {
+        uint32_t status[64 / 4];
+        if (!rp2040_sdio_init(sd_card_p, calculate_clk_div(sd_sdio_baud_rate(sd_card_p))))
+            return false;
+        if (!rp2040_sdio_get_sd_status(sd_card_p, (uint8_t *)status)) {
+            EMSG_PRINTF("%s: unreliable at %u Hz, falling back\n",
+                        sd_get_drive_prefix(sd_card_p), sd_sdio_baud_rate(sd_card_p));
+            sd_card_p->state.high_speed = false;
+            if (!rp2040_sdio_init(sd_card_p, calculate_clk_div(sd_sdio_baud_rate(sd_card_p))))
+                return false;
+        }
+    }
+    IMSG_PRINTF("%s %s, SDIO at %u Hz\n", sd_get_drive_prefix(sd_card_p),
+                sd_card_p->state.high_speed ? "High Speed" : "Default Speed",
+                sd_sdio_baud_rate(sd_card_p));
+
     return true;
 }
 
+bool sd_sdio_cardCMD6(sd_card_t *sd_card_p, uint32_t arg, uint8_t *status) {
+    uint32_t reply;
+    if (!checkReturnOk(rp2040_sdio_rx_start(sd_card_p, status, 1, 64)) || // Prepare for reception
+        !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD6_SWITCH_FUNC, arg, &reply)))
+    {
+        EMSG_PRINTF("CMD6 failed\n");
+        return false;
+    }
+    // Read 512 bit block on DAT bus (not CMD)
+    do {
+        STATE.error = rp2040_sdio_rx_poll(sd_card_p, 64 / 4);
+    } while (STATE.error == SDIO_BUSY);
+
+    if (STATE.error != SDIO_OK)
+    {
+        EMSG_PRINTF("CMD6 failed: %s (%d)\n", errstr(STATE.error), (int)STATE.error);
+    }
+    return STATE.error == SDIO_OK;
+}
+
 uint8_t sd_sdio_errorCode(sd_card_t *sd_card_p) // const
 {
     return STATE.error;
@@ -326,6 +381,8 @@ bool sd_sdio_writeSector(sd_card_t *sd_card_p, uint32_t sector, const uint8_t* s
     return STATE.error == SDIO_OK;
 }
 
+#define ACMD23_MAX_BLOCKS 0x7FFFFF  // [22:0] Number of blocks
+
 bool sd_sdio_writeSectors(sd_card_t *sd_card_p, uint32_t sector, const uint8_t *src, size_t n) {
     if (((uint32_t)src & 3) != 0) {
         // Unaligned write, execute sector-by-sector
@@ -346,6 +403,16 @@ bool sd_sdio_writeSectors(sd_card_t *sd_card_p, uint32_t sector, const uint8_t *
             if (!sd_sdio_stopTransmission(sd_card_p, true)) return false;
         }
         uint32_t reply;
+        // Let the card pre-erase the blocks announced by sd_write_stream_begin().
+        // ACMD23 is only a hint; if the card rejects it the write goes ahead anyway.
+        if (sd_card_p->state.wr_stream_blks && sd_card_p->state.wr_stream_lba == sector) {
+            uint32_t n_blks = sd_card_p->state.wr_stream_blks;
+            if (n_blks > ACMD23_MAX_BLOCKS) n_blks = ACMD23_MAX_BLOCKS;
+            if (SDIO_OK != rp2040_sdio_command_R1(sd_card_p, CMD55_APP_CMD, STATE.rca, &reply) ||
+                SDIO_OK != rp2040_sdio_command_R1(sd_card_p, ACMD23_SET_WR_BLK_ERASE_COUNT, n_blks, &reply))
+                DBG_PRINTF("ACMD23 failed\n");
+        }
+        sd_card_p->state.wr_stream_blks = 0;
         if (!checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD25_WRITE_MULTIPLE_BLOCK, sector, &reply)) ||
             !checkReturnOk(rp2040_sdio_tx_start(sd_card_p, src, n)))  // Start transmission
         {
@@ -462,6 +529,10 @@ bool sd_sdio_readSectors(sd_card_t *sd_card_p, uint32_t sector, uint8_t* dst, si
 
 // Get 512 bit (64 byte) SD Status
 bool rp2040_sdio_get_sd_status(sd_card_t *sd_card_p, uint8_t response[64]) {
+    if (STATE.ongoing_wr_mlt_blk)
+        // Stop any ongoing transmission
+        if (!sd_sdio_stopTransmission(sd_card_p, true)) return false;
+
     uint32_t reply;
     if (!checkReturnOk(rp2040_sdio_rx_start(sd_card_p, response, 1, 64)) || // Prepare for reception
         !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD55_APP_CMD, STATE.rca, &reply)) ||  // APP_CMD
@@ -549,6 +620,7 @@ static DSTATUS sd_sdio_init(sd_card_t *sd_card_p) {
     }
     // Initialize the member variables
     sd_card_p->state.card_type = SDCARD_NONE;
+    sd_card_p->state.high_speed = false;
 
     //        pin                             function        pup   pdown  out    state
     gpio_conf(sd_card_p->sdio_if_p->CLK_gpio, GPIO_FUNC_PIO1, true, false, true,  true);
@@ -597,7 +669,12 @@ static block_dev_err_t sd_sdio_write_blocks(sd_card_t *sd_card_p, const uint8_t
 
     sd_lock(sd_card_p);
 
-    if (1 == blockCnt)
+    // A single block that belongs to a multi-block write in progress or
+    // announced goes into that stream
+    bool streaming =
+        (STATE.ongoing_wr_mlt_blk && STATE.wr_mlt_blk_cnt_sector == ulSectorNumber) ||
+        (sd_card_p->state.wr_stream_blks > 1 && sd_card_p->state.wr_stream_lba == ulSectorNumber);
+    if (1 == blockCnt && !streaming)
         ok = sd_sdio_writeSector(sd_card_p, ulSectorNumber, buffer);
     else
         ok = sd_sdio_writeSectors(sd_card_p, ulSectorNumber, buffer, blockCnt);
@@ -636,6 +713,9 @@ static block_dev_err_t sd_sync(sd_card_t *sd_card_p) {
     sd_unlock(sd_card_p);
     return err;
 }
+static bool sd_sdio_write_open(sd_card_t *sd_card_p) {
+    return STATE.ongoing_wr_mlt_blk;
+}
 void sd_sdio_ctor(sd_card_t *sd_card_p) {
     myASSERT(sd_card_p->sdio_if_p); // Must have an interface object
     /*
@@ -659,6 +739,7 @@ void sd_sdio_ctor(sd_card_t *sd_card_p) {
     sd_card_p->write_blocks = sd_sdio_write_blocks;
     sd_card_p->read_blocks = sd_sdio_read_blocks;
     sd_card_p->sync = sd_sync;
+    sd_card_p->write_open = sd_sdio_write_open;
     sd_card_p->get_num_sectors = sd_sdio_sectorCount;
     sd_card_p->sd_test_com = sd_sdio_test_com;
 }
@@ -0,0 +1,50 @@
+// Data block checksum of the 4-bit SDIO bus. Kept apart from rp2040_sdio.c
+// so that tools/sdio_crc_bench can build it on the host.
+
+#include "pico.h"
+//
+#include "sdio_crc.h"
+
+// Calculate the CRC16 checksum for parallel 4 bit lines separately.
+// When the SDIO bus operates in 4-bit mode, the CRC16 algorithm
+// is applied to each line separately and generates total of
+// 4 x 16 = 64 bits of checksum.
+//
+// The 64-bit accumulator is kept as two 32-bit halves so that the
+// Cortex-M33 (and Hazard3) never has to synthesize 64-bit shifts.
+// This runs from the DMA IRQ while the next block is still arriving,
+// so it lives in RAM to keep XIP cache misses off the receive path.
+__attribute__((optimize("Ofast")))
+uint64_t __not_in_flash_func(sdio_crc16_4bit_checksum)(uint32_t *data, uint32_t num_words)
+{
+    uint32_t crc_hi = 0;
+    uint32_t crc_lo = 0;
+    uint32_t *end = data + num_words;
+    while (data < end)
+    {
+        for (int unroll = 0; unroll < 4; unroll++)
+        {
+            // Each 32-bit word contains 8 bits per line.
+            // Reverse the bytes because SDIO protocol is big-endian.
+            uint32_t data_in = __builtin_bswap32(*data++);
+
+            // Shift out 8 bits for each line (the top half of the accumulator)
+            uint32_t data_out = crc_hi;
+
+            // XOR outgoing data to itself with 4 bit delay
+            data_out ^= (data_out >> 16);
+
+            // XOR incoming data to outgoing data with 4 bit delay
+            data_out ^= (data_in >> 16);
+
+            // XOR outgoing and incoming data to accumulator at each tap
+            // (bit offsets 0, 5 * 4 and 12 * 4 of the 64-bit accumulator,
+            // after it has been shifted left by 32)
+            uint32_t xorred = data_out ^ data_in;
+            crc_hi = crc_lo ^ (xorred >> (32 - 5 * 4)) ^ (xorred << (12 * 4 - 32));
+            crc_lo = xorred ^ (xorred << (5 * 4));
+        }
+    }
+
+    return ((uint64_t)crc_hi << 32) | crc_lo;
+}
@@ -0,0 +1,17 @@
+// Data block checksum of the 4-bit SDIO bus. See sdio_crc.c.
+
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC16 of each of the four data lines over num_words words of block data,
+// as the card sends it after the block: line 3 to 0 in each nibble, most
+// significant nibble first. num_words must be a multiple of 4.
+uint64_t sdio_crc16_4bit_checksum(uint32_t *data, uint32_t num_words);
+
+#ifdef __cplusplus
+}
+#endif
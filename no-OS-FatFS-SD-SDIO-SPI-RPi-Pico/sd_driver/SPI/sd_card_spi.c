@@ -579,6 +579,7 @@ static block_dev_err_t sd_cmd(sd_card_t *sd_card_p, const cmdSupported cmd, uint
         if (R1_NO_RESPONSE == response) {
             DBG_PRINTF("No response CMD:%d\n", cmd);
             // Re-try command
+            sd_card_p->state.io_retries++;
             continue;
         }
         break;
@@ -594,6 +595,7 @@ static block_dev_err_t sd_cmd(sd_card_t *sd_card_p, const cmdSupported cmd, uint
     }
     if (response & R1_COM_CRC_ERROR && ACMD23_SET_WR_BLK_ERASE_COUNT != cmd) {
         DBG_PRINTF("CRC error CMD:%d response 0x%" PRIx32 "\n", cmd, response);
+        sd_card_p->state.io_crc_errors++;
         return SD_BLOCK_DEVICE_ERROR_CRC;  // CRC error
     }
     if (response & R1_ILLEGAL_COMMAND) {
@@ -616,28 +618,42 @@ static block_dev_err_t sd_cmd(sd_card_t *sd_card_p, const cmdSupported cmd, uint
         status = SD_BLOCK_DEVICE_ERROR_PARAMETER;
     }
 
-    // Get rest of the response part for other commands
-    switch (cmd) {
-        case CMD8_SEND_IF_COND:  // Response R7
-            DBG_PRINTF("V2-Version Card\n");
-            sd_card_p->state.card_type = SDCARD_V2;  // fallthrough
-            // Note: No break here, need to read rest of the response
-        case CMD58_READ_OCR:  // Response R3
-            response = (sd_spi_read(sd_card_p) << 24);
-            response |= (sd_spi_read(sd_card_p) << 16);
-            response |= (sd_spi_read(sd_card_p) << 8);
-            response |= sd_spi_read(sd_card_p);
-            DBG_PRINTF("R3/R7: 0x%" PRIx32 "\n", response);
-            break;
-        case CMD12_STOP_TRANSMISSION:  // Response R1b
-        case CMD38_ERASE:
-            sd_wait_ready(sd_card_p, sd_timeouts.sd_command);
-            break;
-        case CMD13_SEND_STATUS:  // Response R2
-            response <<= 8;
-            response |= sd_spi_read(sd_card_p);
-            if (response) status = chk_CMD13_response(response);
-        default:;
+    // Get rest of the response part for other commands. Application
+    // commands reuse the indexes of standard ones (ACMD13 and CMD13 are
+    // both 13), so they are told apart by isAcmd, not by cmd alone.
+    if (isAcmd) {
+        switch (cmd) {
+            case ACMD13_SD_STATUS:  // Response R2, then the SD Status data block
+                response <<= 8;
+                response |= sd_spi_read(sd_card_p);
+                if (response) status = chk_CMD13_response(response);
+                break;
+            default:;  // Response R1
+        }
+    } else {
+        switch (cmd) {
+            case CMD8_SEND_IF_COND:  // Response R7
+                DBG_PRINTF("V2-Version Card\n");
+                sd_card_p->state.card_type = SDCARD_V2;  // fallthrough
+                // Note: No break here, need to read rest of the response
+            case CMD58_READ_OCR:  // Response R3
+                response = (sd_spi_read(sd_card_p) << 24);
+                response |= (sd_spi_read(sd_card_p) << 16);
+                response |= (sd_spi_read(sd_card_p) << 8);
+                response |= sd_spi_read(sd_card_p);
+                DBG_PRINTF("R3/R7: 0x%" PRIx32 "\n", response);
+                break;
+            case CMD12_STOP_TRANSMISSION:  // Response R1b
+            case CMD38_ERASE:
+                sd_wait_ready(sd_card_p, sd_timeouts.sd_command);
+                break;
+            case CMD13_SEND_STATUS:  // Response R2
+                response <<= 8;
+                response |= sd_spi_read(sd_card_p);
+                if (response) status = chk_CMD13_response(response);
+                break;
+            default:;
+        }
     }
     // Pass the updated response to the command
     if (NULL != resp) {
@@ -747,6 +763,7 @@ static bool sd_wait_token(sd_card_t *sd_card_p, uint8_t token) {
         if (token == sd_spi_read(sd_card_p)) {
             return true;
         }
+        sd_card_p->state.io_token_spins++;
     } while (millis() - start < sd_timeouts.sd_command);
 
     DBG_PRINTF("sd_wait_token: timeout\n");
@@ -787,6 +804,7 @@ static block_dev_err_t read_bytes(sd_card_t *sd_card_p, uint8_t *buffer, uint32_
 
     if (!chk_crc16(buffer, length, crc)) {
         DBG_PRINTF("%s: Invalid CRC received: 0x%" PRIx16 "\n", __func__, crc);
+        sd_card_p->state.io_crc_errors++;
         return SD_BLOCK_DEVICE_ERROR_CRC;
     }
     return 0;
@@ -1103,6 +1121,8 @@ static block_dev_err_t send_all_blocks(sd_card_t *sd_card_p, const uint8_t *buff
  *                       write.
  * @return block_dev_err_t Error code indicating the status of the write operation.
  */
+#define ACMD23_MAX_BLOCKS 0x7FFFFF  // [22:0] Number of blocks
+
 static block_dev_err_t in_sd_write_blocks(sd_card_t *sd_card_p, 
                                           const uint8_t *buffer_p[],
                                           uint32_t * const data_address_p,
@@ -1125,6 +1145,17 @@ static block_dev_err_t in_sd_write_blocks(sd_card_t *sd_card_p,
         if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
     }
 
+    // Let the card pre-erase the blocks announced by sd_write_stream_begin().
+    // ACMD23 is only a hint; if the card rejects it the write goes ahead anyway.
+    if (sd_card_p->state.wr_stream_blks && sd_card_p->state.wr_stream_lba == *data_address_p) {
+        uint32_t n_blks = sd_card_p->state.wr_stream_blks;
+        if (n_blks > ACMD23_MAX_BLOCKS) n_blks = ACMD23_MAX_BLOCKS;
+        status = sd_cmd(sd_card_p, ACMD23_SET_WR_BLK_ERASE_COUNT, n_blks, true, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status)
+            DBG_PRINTF("ACMD23 failed: %d\n", status);
+    }
+    sd_card_p->state.wr_stream_blks = 0;
+
     // Send command to perform write operation
     status = sd_cmd(sd_card_p, CMD25_WRITE_MULTIPLE_BLOCK, *data_address_p, false, 0);
     if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
@@ -1260,8 +1291,13 @@ static block_dev_err_t sd_write_blocks(sd_card_t *sd_card_p, uint8_t const buffe
 
     block_dev_err_t status;
 
-    // If writing only one block, use the optimized function
-    if (1 == num_wrt_blks) {
+    // If writing only one block, use the optimized function,
+    // unless it belongs to a multi-block write in progress or announced
+    bool streaming =
+        (sd_card_p->spi_if_p->state.ongoing_mlt_blk_wrt &&
+         sd_card_p->spi_if_p->state.cont_sector_wrt == data_address) ||
+        (sd_card_p->state.wr_stream_blks > 1 && sd_card_p->state.wr_stream_lba == data_address);
+    if (1 == num_wrt_blks && !streaming) {
         status = write_block(sd_card_p, buffer, data_address);
     } else {
         // If writing multiple blocks, retry the operation until it succeeds or reaches the maximum number of retries
@@ -1306,6 +1342,41 @@ static block_dev_err_t sd_sync(sd_card_t *sd_card_p) {
     return status;
 }
 
+static bool sd_spi_write_open(sd_card_t *sd_card_p) {
+    return sd_card_p->spi_if_p->state.ongoing_mlt_blk_wrt;
+}
+
+/**
+ * @brief Read the 512 bit SD Status register (ACMD13).
+ *
+ * The response is R2, followed by the register in a data block like CMD9.
+ *
+ * @param sd_card_p Pointer to the SD card object.
+ * @param status Receives the register, most significant byte first.
+ * @return true on success
+ */
+bool sd_spi_get_sd_status(sd_card_t *sd_card_p, uint8_t status[64]) {
+    sd_acquire(sd_card_p);
+    block_dev_err_t err = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (sd_card_p->spi_if_p->state.ongoing_mlt_blk_wrt) err = stop_wr_tran(sd_card_p);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == err)
+        err = sd_cmd(sd_card_p, ACMD13_SD_STATUS, 0, true, NULL);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == err) err = read_bytes(sd_card_p, status, 64);
+    sd_release(sd_card_p);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != err) {
+        DBG_PRINTF("ACMD13 failed: %d\n", err);
+        return false;
+    }
+    return true;
+}
+
+// CMD6 for sd_switch_high_speed(): R1, then the switch status in a data block
+static bool sd_spi_cmd6(sd_card_t *sd_card_p, uint32_t arg, uint8_t status[64]) {
+    if (SD_BLOCK_DEVICE_ERROR_NONE != sd_cmd(sd_card_p, CMD6_SWITCH_FUNC, arg, false, NULL))
+        return false;
+    return SD_BLOCK_DEVICE_ERROR_NONE == read_bytes(sd_card_p, status, 64);
+}
+
 /*!< Number of retries for sending CMDO */
 #define SD_CMD0_GO_IDLE_STATE_RETRIES 10
 
@@ -1616,6 +1687,7 @@ DSTATUS sd_card_spi_init(sd_card_t *sd_card_p) {
 
     // Initialize the member variables
     sd_card_p->state.card_type = SDCARD_NONE;
+    sd_card_p->state.high_speed = false;
 
     // Acquire the SD card
     sd_spi_acquire(sd_card_p);
@@ -1636,8 +1708,8 @@ DSTATUS sd_card_spi_init(sd_card_t *sd_card_p) {
 
     DBG_PRINTF("SD card initialized\n");
 
-    // Set SCK for data transfer
-    sd_spi_go_high_frequency(sd_card_p);
+    // Set SCK for data transfer, within the Default Speed limit for now
+    uint actual = sd_spi_go_high_frequency(sd_card_p);
 
     // Get the number of sectors on the card
     sd_card_p->state.sectors = in_sd_spi_sectors(sd_card_p);
@@ -1666,6 +1738,26 @@ DSTATUS sd_card_spi_init(sd_card_t *sd_card_p) {
         return sd_card_p->state.m_Status;
     }
 
+    // Switch to High Speed if the card can and raise SCK to match. If the
+    // CSD does not read back the same at the new rate, go back down.
+    if (sd_switch_high_speed(sd_card_p, sd_spi_cmd6)) {
+        uint32_t sectors = sd_card_p->state.sectors;
+        actual = sd_spi_go_high_frequency(sd_card_p);
+        if (in_sd_spi_sectors(sd_card_p) != sectors) {
+            EMSG_PRINTF("%s: unreliable at %u Hz, falling back\n",
+                        sd_get_drive_prefix(sd_card_p), actual);
+            sd_card_p->state.high_speed = false;
+            actual = sd_spi_go_high_frequency(sd_card_p);
+            sd_card_p->state.sectors = in_sd_spi_sectors(sd_card_p);
+            if (0 == sd_card_p->state.sectors) {
+                sd_release(sd_card_p);
+                return sd_card_p->state.m_Status;
+            }
+        }
+    }
+    IMSG_PRINTF("%s %s, SPI at %u Hz\n", sd_get_drive_prefix(sd_card_p),
+                sd_card_p->state.high_speed ? "High Speed" : "Default Speed", actual);
+
     // The card is now initialized
     sd_card_p->state.m_Status &= ~STA_NOINIT;
 
@@ -1710,6 +1802,7 @@ void sd_spi_ctor(sd_card_t *sd_card_p) {
     sd_card_p->write_blocks = sd_write_blocks;
     sd_card_p->read_blocks = sd_read_blocks;
     sd_card_p->sync = sd_sync;
+    sd_card_p->write_open = sd_spi_write_open;
     sd_card_p->init = sd_card_spi_init;
     sd_card_p->deinit = sd_deinit;
     sd_card_p->get_num_sectors = sd_spi_sectors;
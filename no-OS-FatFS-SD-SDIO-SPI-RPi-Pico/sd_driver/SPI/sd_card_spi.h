@@ -22,6 +22,7 @@ extern "C" {
 
 void sd_spi_ctor(sd_card_t *sd_card_p);  // Constructor for sd_card_t
 uint32_t sd_go_idle_state(sd_card_t *sd_card_p);
+bool sd_spi_get_sd_status(sd_card_t *sd_card_p, uint8_t status[64]);  // ACMD13
 
 #ifdef __cplusplus
 }
@@ -32,9 +32,13 @@ specific language governing permissions and limitations under the License.
 // #define TRACE_PRINTF(fmt, args...)
 // #define TRACE_PRINTF printf
 
-void sd_spi_go_high_frequency(sd_card_t *sd_card_p) {
-    uint actual = spi_set_baudrate(sd_card_p->spi_if_p->spi->hw_inst, sd_card_p->spi_if_p->spi->baud_rate);
+uint sd_spi_go_high_frequency(sd_card_t *sd_card_p) {
+    // The configured rate, as far as the card's access mode allows
+    uint baud_rate = sd_card_p->spi_if_p->spi->baud_rate;
+    if (baud_rate > sd_max_clock_hz(sd_card_p)) baud_rate = sd_max_clock_hz(sd_card_p);
+    uint actual = spi_set_baudrate(sd_card_p->spi_if_p->spi->hw_inst, baud_rate);
     DBG_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    return actual;
 }
 void sd_spi_go_low_frequency(sd_card_t *sd_card_p) {
     uint actual = spi_set_baudrate(sd_card_p->spi_if_p->spi->hw_inst, 400 * 1000); // Actual frequency: 398089
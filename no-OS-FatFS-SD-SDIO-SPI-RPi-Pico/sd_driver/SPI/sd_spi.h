@@ -33,7 +33,7 @@ extern "C" {
 #endif
 
 void sd_spi_go_low_frequency(sd_card_t *this);
-void sd_spi_go_high_frequency(sd_card_t *this);
+uint sd_spi_go_high_frequency(sd_card_t *this);  // Returns the actual frequency
 
 /* 
 After power up, the host starts the clock and sends the initializing sequence on the CMD line. 
@@ -4,7 +4,7 @@
 //
 #include "dma_interrupts.h"
 
-static void dma_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p) {
+static void __not_in_flash_func(dma_irq_handler)(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p) {
     // Iterate through all of the SD cards
     for (size_t i = 0; i < sd_get_num(); ++i) {
         sd_card_t *sd_card_p = sd_get_by_num(i);
@@ -19,10 +19,12 @@ specific language governing permissions and limitations under the License.
 #include <stdio.h>
 #include <string.h>
 //
+#include "hardware/irq.h"
 #include "pico/mutex.h"
 //
 #include "SDIO/SdioCard.h"
 #include "SPI/sd_card_spi.h"
+#include "delays.h"
 #include "hw_config.h"  // Hardware Configuration of the SPI and SD Card "objects"
 #include "my_debug.h"
 #include "sd_card_constants.h"
@@ -73,6 +75,46 @@ sd_card_t *sd_get_by_drive_prefix(const char *const drive_prefix) {
     return NULL;
 }
 
+// Shared by all debounced card detect pins; only notes the time of the edge
+static void __not_in_flash_func(card_detect_irq_handler)(void) {
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *sd_card_p = sd_get_by_num(i);
+        if (!sd_card_p || !sd_card_p->use_card_detect || !sd_card_p->card_detect_debounce_ms)
+            continue;
+        uint32_t events = gpio_get_irq_event_mask(sd_card_p->card_detect_gpio);
+        if (!events) continue;
+        gpio_acknowledge_irq(sd_card_p->card_detect_gpio, events);
+        sd_card_p->state.cd_edge_ms = millis();
+        sd_card_p->state.cd_edge = true;
+    }
+}
+
+static void card_detect_irq_init(sd_card_t *sd_card_p) {
+    sd_card_p->state.cd_present =
+        gpio_get(sd_card_p->card_detect_gpio) == sd_card_p->card_detected_true;
+    sd_card_p->state.cd_edge = false;
+    gpio_add_raw_irq_handler(sd_card_p->card_detect_gpio, card_detect_irq_handler);
+    gpio_set_irq_enabled(sd_card_p->card_detect_gpio, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL,
+                         true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+// Debounced pin state. Never waits: while the pin is bouncing the last
+// stable state is returned.
+static bool card_detect_debounced(sd_card_t *sd_card_p) {
+    if (sd_card_p->state.cd_edge) {
+        if (millis() - sd_card_p->state.cd_edge_ms < sd_card_p->card_detect_debounce_ms)
+            return sd_card_p->state.cd_present;
+        sd_card_p->state.cd_edge = false;
+    }
+    bool present = gpio_get(sd_card_p->card_detect_gpio) == sd_card_p->card_detected_true;
+    if (present != sd_card_p->state.cd_present) {
+        sd_card_p->state.cd_present = present;
+        sd_card_p->state.cd_changes++;
+    }
+    return present;
+}
+
 /* Return non-zero if the SD-card is present. */
 bool sd_card_detect(sd_card_t *sd_card_p) {
     TRACE_PRINTF("> %s\r\n", __FUNCTION__);
@@ -80,8 +122,13 @@ bool sd_card_detect(sd_card_t *sd_card_p) {
         sd_card_p->state.m_Status &= ~STA_NODISK;
         return true;
     }
-    /*!< Check GPIO to detect SD */
-    if (gpio_get(sd_card_p->card_detect_gpio) == sd_card_p->card_detected_true) {
+    bool present;
+    if (sd_card_p->card_detect_debounce_ms)
+        present = card_detect_debounced(sd_card_p);
+    else
+        /*!< Check GPIO to detect SD */
+        present = gpio_get(sd_card_p->card_detect_gpio) == sd_card_p->card_detected_true;
+    if (present) {
         // The socket is now occupied
         sd_card_p->state.m_Status &= ~STA_NODISK;
         TRACE_PRINTF("SD card detected!\r\n");
@@ -152,6 +199,7 @@ bool sd_init_driver() {
                     }
                 }
                 gpio_init(sd_card_p->card_detect_gpio);
+                if (sd_card_p->card_detect_debounce_ms) card_detect_irq_init(sd_card_p);
             }
 
             switch (sd_card_p->type) {
@@ -320,10 +368,15 @@ void csdDmp(sd_card_t *sd_card_p, printer_t printer) {
 is a physical boundary of the card and consists of one or more blocks and its
 size depends on each card. */
 bool sd_allocation_unit(sd_card_t *sd_card_p, size_t *au_size_bytes_p) {
-    if (SD_IF_SPI == sd_card_p->type) return false;  // SPI can't do full SD Status
-
     uint8_t status[64] = {0};
-    bool ok = rp2040_sdio_get_sd_status(sd_card_p, status);
+    bool ok;
+    if (SD_IF_SPI == sd_card_p->type) {
+        ok = sd_spi_get_sd_status(sd_card_p, status);
+    } else {
+        sd_lock(sd_card_p);
+        ok = rp2040_sdio_get_sd_status(sd_card_p, status);
+        sd_unlock(sd_card_p);
+    }
     if (!ok) return false;
     // 431:428 AU_SIZE
     uint8_t au_size = ext_bits(64, status, 431, 428);
@@ -383,4 +436,44 @@ bool sd_allocation_unit(sd_card_t *sd_card_p, size_t *au_size_bytes_p) {
     return true;
 }
 
+/* CMD6 arguments for function group 1, access mode.
+   Groups 2 to 6 are left alone (0xF). */
+#define CMD6_CHECK_HIGH_SPEED 0x00FFFFF1
+#define CMD6_SWITCH_HIGH_SPEED 0x80FFFFF1
+
+bool sd_switch_high_speed(sd_card_t *sd_card_p,
+                          bool (*cmd6)(sd_card_t *sd_card_p, uint32_t arg, uint8_t status[64])) {
+    sd_card_p->state.high_speed = false;
+
+    // Switch functions are command class 10: CSD CCC [95:84]
+    if (!ext_bits16(sd_card_p->state.CSD, 94, 94)) {
+        DBG_PRINTF("Card has no switch function commands\n");
+        return false;
+    }
+    uint32_t status[64 / 4];  // Word aligned for SDIO DMA
+    uint8_t *s = (uint8_t *)status;
+
+    // Mode 0 asks without switching. [415:400] function group 1 support
+    // bits, [379:376] the function that would be selected (0xF: none)
+    if (!cmd6(sd_card_p, CMD6_CHECK_HIGH_SPEED, s)) return false;
+    if (!ext_bits(64, s, 401, 401) || 1 != ext_bits(64, s, 379, 376)) {
+        DBG_PRINTF("High Speed not supported\n");
+        return false;
+    }
+    if (!cmd6(sd_card_p, CMD6_SWITCH_HIGH_SPEED, s)) return false;
+    if (1 != ext_bits(64, s, 379, 376)) {
+        EMSG_PRINTF("Switch to High Speed refused\n");
+        return false;
+    }
+    sd_card_p->state.high_speed = true;
+    return true;
+}
+
+void sd_write_stream_begin(sd_card_t *sd_card_p, uint32_t lba, uint32_t n_blocks) {
+    sd_lock(sd_card_p);
+    sd_card_p->state.wr_stream_lba = lba;
+    sd_card_p->state.wr_stream_blks = n_blocks;
+    sd_unlock(sd_card_p);
+}
+
 /* [] END OF FILE */
@@ -40,7 +40,10 @@ specific language governing permissions and limitations under the License.
 extern "C" {
 #endif
 
-typedef enum { SD_IF_NONE, SD_IF_SPI, SD_IF_SDIO } sd_if_t;
+typedef enum { SD_IF_NONE, SD_IF_SPI, SD_IF_SDIO, SD_IF_IMAGE } sd_if_t;
+
+// Host-side disk image interface; see Image/sd_card_image.h
+typedef struct sd_image_if_t sd_image_if_t;
 
 typedef struct sd_spi_if_state_t {
     bool ongoing_mlt_blk_wrt;
@@ -98,10 +101,26 @@ typedef struct sd_card_state_t {
     CSD_t CSD;              // Card-Specific Data register.
     CID_t CID;              // Card IDentification register
     uint32_t sectors;       // Assigned dynamically
+    bool high_speed;        // Switched to High Speed (CMD6) by init
 
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+
+    // Card detect debouncing; see card_detect_debounce_ms
+    volatile uint32_t cd_edge_ms;  // Time of the last edge seen by the IRQ handler
+    volatile bool cd_edge;         // An edge is waiting to settle
+    bool cd_present;               // Debounced pin state
+    uint32_t cd_changes;           // Number of debounced insertions and removals
+
+    // Driver event counters, sampled by sd_trace around each operation
+    uint32_t io_retries;      // Commands sent again after getting no response
+    uint32_t io_crc_errors;   // Command or data CRC mismatches
+    uint32_t io_token_spins;  // Bytes polled while waiting for a data token (SPI)
+
+    // Pre-erase hint for the next multi-block write; see sd_write_stream_begin()
+    uint32_t wr_stream_lba;
+    uint32_t wr_stream_blks;  // 0 if none
 #if FF_STR_VOLUME_ID
     char drive_prefix[32];
 #else
@@ -117,12 +136,17 @@ struct sd_card_t {
     union {
         sd_spi_if_t *spi_if_p;
         sd_sdio_if_t *sdio_if_p;
+        sd_image_if_t *image_if_p;
     };
     bool use_card_detect;
     uint card_detect_gpio;    // Card detect; ignored if !use_card_detect
     uint card_detected_true;  // Varies with card socket; ignored if !use_card_detect
     bool card_detect_use_pull;
     bool card_detect_pull_hi;
+    // If non-zero, edges on the card detect pin are caught by an interrupt and
+    // the pin must be stable this long before sd_card_detect() reports a change.
+    // A card swap between two calls still shows up in state.cd_changes.
+    uint card_detect_debounce_ms;
 
     /* The following fields are state variables and not part of the configuration.
     They are dynamically assigned. */
@@ -135,6 +159,9 @@ struct sd_card_t {
     block_dev_err_t (*read_blocks)(sd_card_t *sd_card_p, uint8_t *buffer,
                                    uint32_t ulSectorNumber, uint32_t ulSectorCount);
     block_dev_err_t (*sync)(sd_card_t *sd_card_p);
+    // True while a multi-block write is open, until sync or any other
+    // command stops it. The card answers nothing else in the meantime.
+    bool (*write_open)(sd_card_t *sd_card_p);
     uint32_t (*get_num_sectors)(sd_card_t *sd_card_p);
 
     // Useful when use_card_detect is false - call periodically to check for presence of SD card
@@ -142,6 +169,14 @@ struct sd_card_t {
     bool (*sd_test_com)(sd_card_t *sd_card_p);
 };
 
+// Bus clock limits of the SD access modes
+#define SD_DEFAULT_SPEED_MAX_HZ (25 * 1000 * 1000)
+#define SD_HIGH_SPEED_MAX_HZ (50 * 1000 * 1000)
+
+static inline uint32_t sd_max_clock_hz(sd_card_t *sd_card_p) {
+    return sd_card_p->state.high_speed ? SD_HIGH_SPEED_MAX_HZ : SD_DEFAULT_SPEED_MAX_HZ;
+}
+
 void sd_lock(sd_card_t *sd_card_p);
 void sd_unlock(sd_card_t *sd_card_p);
 bool sd_is_locked(sd_card_t *sd_card_p);
@@ -151,6 +186,17 @@ bool sd_card_detect(sd_card_t *sd_card_p);
 void cidDmp(sd_card_t *sd_card_p, printer_t printer);
 void csdDmp(sd_card_t *sd_card_p, printer_t printer);
 bool sd_allocation_unit(sd_card_t *sd_card_p, size_t *au_size_bytes_p);
+// Switch the card to High Speed if it supports it, using the transport's
+// CMD6, which sends arg and reads the 512 bit switch status. Sets
+// state.high_speed. Called by init, before raising the bus clock.
+bool sd_switch_high_speed(sd_card_t *sd_card_p,
+                          bool (*cmd6)(sd_card_t *sd_card_p, uint32_t arg, uint8_t status[64]));
+// Announce that n_blocks blocks starting at lba are about to be written in
+// order, possibly over several write_blocks calls. The multi-block write that
+// starts at lba first tells the card the count (ACMD23), so it can erase them
+// up front instead of block by block. Blocks announced but then not written
+// may lose their old contents. Any other multi-block write drops the hint.
+void sd_write_stream_begin(sd_card_t *sd_card_p, uint32_t lba, uint32_t n_blocks);
 sd_card_t *sd_get_by_drive_prefix(const char *const name);
 
 // sd_init_driver() must be called before this:
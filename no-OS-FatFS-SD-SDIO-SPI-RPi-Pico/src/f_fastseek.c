@@ -0,0 +1,88 @@
+/* f_fastseek.c
+
+Pool of cluster link map tables for FatFs fast seek. See f_fastseek.h.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+//
+#include "ff.h"
+#include "my_debug.h"
+#include "pico/mutex.h"
+//
+#include "f_fastseek.h"
+
+static struct {
+    DWORD tbl[FF_FASTSEEK_TBL_SIZE];
+    bool in_use;
+} clmt_pool[FF_FASTSEEK_POOL_SLOTS];
+/* Both cores may open files (FF_FS_REENTRANT); a leaf lock like
+   LfnPoolMutex in ffsystem.c, held only while picking a slot */
+auto_init_mutex(clmt_pool_mutex);
+
+static DWORD *clmt_alloc(void) {
+    DWORD *tbl = NULL;
+    mutex_enter_blocking(&clmt_pool_mutex);
+    for (size_t i = 0; i < FF_FASTSEEK_POOL_SLOTS; ++i) {
+        if (!clmt_pool[i].in_use) {
+            clmt_pool[i].in_use = true;
+            tbl = clmt_pool[i].tbl;
+            break;
+        }
+    }
+    mutex_exit(&clmt_pool_mutex);
+    if (tbl) tbl[0] = FF_FASTSEEK_TBL_SIZE;
+    return tbl;
+}
+
+static void clmt_free(DWORD *tbl) {
+    for (size_t i = 0; i < FF_FASTSEEK_POOL_SLOTS; ++i) {
+        if (clmt_pool[i].tbl == tbl) {
+            mutex_enter_blocking(&clmt_pool_mutex);
+            myASSERT(clmt_pool[i].in_use);
+            clmt_pool[i].in_use = false;
+            mutex_exit(&clmt_pool_mutex);
+            return;
+        }
+    }
+}
+
+FRESULT f_open_fastseek(FIL *fp, const TCHAR *path, BYTE mode) {
+    FRESULT fr = f_open(fp, path, mode);
+    if (FR_OK != fr) return fr;
+
+    /* An empty file has no chain to map */
+    if (0 == f_size(fp)) return FR_OK;
+
+    DWORD *tbl = clmt_alloc();
+    if (!tbl) {
+        DBG_PRINTF("%s: link map pool exhausted, %s stays in normal mode\n", __func__, path);
+        return FR_OK;
+    }
+
+    /* Walk the chain now so that later seeks don't have to */
+    FSIZE_t fptr = f_tell(fp);  // Non-zero for FA_OPEN_APPEND
+    fp->cltbl = tbl;
+    fr = f_lseek(fp, CREATE_LINKMAP);
+    if (FR_OK == fr) fr = f_lseek(fp, fptr);
+    if (FR_OK != fr) {
+        DBG_PRINTF("%s: %s needs %lu table items, stays in normal mode\n", __func__,
+                   path, (unsigned long)tbl[0]);
+        fp->cltbl = NULL;
+        clmt_free(tbl);
+        /* FR_NOT_ENOUGH_CORE just means the table was too small */
+        if (FR_NOT_ENOUGH_CORE != fr) {
+            f_close(fp);
+            return fr;
+        }
+        fr = f_lseek(fp, fptr);
+    }
+    return fr;
+}
+
+FRESULT f_close_fastseek(FIL *fp) {
+    DWORD *tbl = fp->cltbl;
+    fp->cltbl = NULL;
+    FRESULT fr = f_close(fp);
+    if (tbl) clmt_free(tbl);
+    return fr;
+}
@@ -0,0 +1,72 @@
+/* f_raw_stream.c
+
+Raw-sector streaming for contiguous files. See f_raw_stream.h.
+*/
+#include "diskio.h"
+#include "ff.h"
+#include "my_debug.h"
+//
+#include "f_raw_stream.h"
+
+FRESULT f_raw_stream_open(FIL *fp, f_raw_stream_t *rs) {
+    FATFS *fs = fp->obj.fs;
+    if (!fs) return FR_INVALID_OBJECT;
+    if (0 == fp->obj.sclust || 0 == f_size(fp)) return FR_DENIED;
+
+    /* A link map with room for exactly one fragment can only be built for a
+       contiguous file. This works the same for FAT and exFAT. */
+    DWORD tbl[4] = {4};
+    DWORD *saved_cltbl = fp->cltbl;
+    FSIZE_t saved_fptr = f_tell(fp);
+    fp->cltbl = tbl;
+    FRESULT fr = f_lseek(fp, CREATE_LINKMAP);
+    fp->cltbl = saved_cltbl;
+    if (FR_NOT_ENOUGH_CORE == fr) {
+        DBG_PRINTF("%s: file is fragmented (%lu table items)\n", __func__, (unsigned long)tbl[0]);
+        return FR_DENIED;
+    }
+    if (FR_OK != fr) return fr;
+    fr = f_lseek(fp, saved_fptr);
+    if (FR_OK != fr) return fr;
+
+    UINT ss = FF_MAX_SS;  // FF_MIN_SS == FF_MAX_SS
+    rs->pdrv = fs->pdrv;
+    rs->lba = fs->database + (LBA_t)fs->csize * (fp->obj.sclust - 2);
+    rs->size = f_size(fp);
+    rs->n_sectors = (rs->size + ss - 1) / ss;
+    rs->pos = 0;
+    rs->writing = false;
+    return FR_OK;
+}
+
+FRESULT f_raw_stream_read(f_raw_stream_t *rs, void *buff, UINT count, UINT *sectors_read) {
+    *sectors_read = 0;
+    LBA_t remain = rs->n_sectors - rs->pos;
+    if (count > remain) count = remain;
+    if (!count) return FR_OK;
+    if (RES_OK != disk_read(rs->pdrv, buff, rs->lba + rs->pos, count)) return FR_DISK_ERR;
+    rs->pos += count;
+    rs->writing = false;
+    *sectors_read = count;
+    return FR_OK;
+}
+
+FRESULT f_raw_stream_write(f_raw_stream_t *rs, const void *buff, UINT count,
+                           UINT *sectors_written) {
+    *sectors_written = 0;
+    LBA_t remain = rs->n_sectors - rs->pos;
+    if (count > remain) count = remain;
+    if (!count) return FR_OK;
+    if (!rs->writing) {
+        LBA_t range[2] = {rs->lba + rs->pos, remain};
+        disk_ioctl(rs->pdrv, CTRL_WRITE_STREAM, range);  // Only a hint
+        rs->writing = true;
+    }
+    if (RES_OK != disk_write(rs->pdrv, buff, rs->lba + rs->pos, count)) {
+        rs->writing = false;
+        return FR_DISK_ERR;
+    }
+    rs->pos += count;
+    *sectors_written = count;
+    return FR_OK;
+}
@@ -24,6 +24,7 @@ specific language governing permissions and limitations under the License.
 #include "hw_config.h"
 #include "my_debug.h"
 #include "sd_card.h"
+#include "sd_trace.h"
 //
 #include "diskio.h" /* Declarations of disk functions */
 
@@ -99,7 +100,9 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive number to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
+    sd_trace_mark_t mark = sd_trace_begin(sd_card_p);
     int rc = sd_card_p->read_blocks(sd_card_p, buff, sector, count);
+    sd_trace_end(sd_card_p, &mark, pdrv, SD_TRACE_READ, sector, count, rc);
     return sdrc2dresult(rc);
 }
 
@@ -117,7 +120,9 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive number to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
+    sd_trace_mark_t mark = sd_trace_begin(sd_card_p);
     int rc = sd_card_p->write_blocks(sd_card_p, buff, sector, count);
+    sd_trace_end(sd_card_p, &mark, pdrv, SD_TRACE_WRITE, sector, count, rc);
     return sdrc2dresult(rc);
 }
 
@@ -157,13 +162,28 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive number (0..) */
                                 // f_mkfs function and it attempts to align data
                                 // area on the erase block boundary. It is
                                 // required when FF_USE_MKFS == 1.
-            static DWORD bs = 1;
+            // Use the SD allocation unit, so f_mkfs puts the data area on an AU boundary
+            size_t au_bytes = 0;
+            DWORD bs = 1;
+            if (sd_allocation_unit(sd_card_p, &au_bytes) && au_bytes) {
+                bs = au_bytes / FF_MIN_SS;
+                if (bs > 32768) bs = 32768;
+            }
             *(DWORD *)buff = bs;
             return RES_OK;
         }
-        case CTRL_SYNC:
-            sd_card_p->sync(sd_card_p);
+        case CTRL_WRITE_STREAM: {  // Sectors LBA_t[0].. LBA_t[0] + LBA_t[1] - 1
+                                   // are about to be written, in order
+            const LBA_t *range = buff;
+            sd_write_stream_begin(sd_card_p, range[0], range[1]);
+            return RES_OK;
+        }
+        case CTRL_SYNC: {
+            sd_trace_mark_t mark = sd_trace_begin(sd_card_p);
+            int rc = sd_card_p->sync(sd_card_p);
+            sd_trace_end(sd_card_p, &mark, pdrv, SD_TRACE_SYNC, 0, 0, rc);
             return RES_OK;
+        }
         default:
             return RES_PARERR;
     }
@@ -0,0 +1,142 @@
+/* sd_trace.c
+
+Block layer tracing. See sd_trace.h.
+*/
+#include <inttypes.h>
+#include <string.h>
+//
+#include "pico/mutex.h"
+//
+#include "delays.h"
+//
+#include "sd_trace.h"
+
+#if SD_TRACE
+
+static struct {
+    sd_trace_entry_t ring[SD_TRACE_RING_SIZE];
+    uint32_t next;  // Total entries ever written; ring index is next % size
+    uint32_t histogram[SD_TRACE_OPS][SD_TRACE_BUCKETS];
+    uint64_t total_us[SD_TRACE_OPS];
+    uint32_t max_us[SD_TRACE_OPS];
+    uint32_t errors[SD_TRACE_OPS];
+    uint32_t retries;
+    uint32_t crc_errors;
+    uint32_t token_spins;
+    volatile uint32_t stalls;
+    volatile uint32_t worst_us;
+} trace;
+auto_init_mutex(trace_mutex);  // Both cores may be doing I/O
+
+static const char *const op_names[SD_TRACE_OPS] = {"read", "write", "sync"};
+
+static unsigned bucket(uint32_t us) {
+    unsigned b = 0;
+    while (us > 1 && b < SD_TRACE_BUCKETS - 1) {
+        us >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+sd_trace_mark_t sd_trace_begin(sd_card_t *sd_card_p) {
+    sd_trace_mark_t mark = {
+        .start_us = micros(),
+        .retries = sd_card_p->state.io_retries,
+        .crc_errors = sd_card_p->state.io_crc_errors,
+        .token_spins = sd_card_p->state.io_token_spins,
+    };
+    return mark;
+}
+
+void sd_trace_end(sd_card_t *sd_card_p, const sd_trace_mark_t *mark, uint8_t pdrv,
+                  sd_trace_op_t op, uint32_t lba, uint32_t count, int rc) {
+    uint64_t now = micros();
+    uint32_t duration = (uint32_t)(now - mark->start_us);
+    uint32_t retries = sd_card_p->state.io_retries - mark->retries;
+    uint32_t crc_errors = sd_card_p->state.io_crc_errors - mark->crc_errors;
+    uint32_t spins = sd_card_p->state.io_token_spins - mark->token_spins;
+
+    mutex_enter_blocking(&trace_mutex);
+    sd_trace_entry_t *e = &trace.ring[trace.next++ % SD_TRACE_RING_SIZE];
+    e->start_us = (uint32_t)mark->start_us;
+    e->duration_us = duration;
+    e->lba = lba;
+    e->count = count > UINT16_MAX ? UINT16_MAX : count;
+    e->rc = (uint16_t)rc;
+    e->token_spins = spins > UINT16_MAX ? UINT16_MAX : spins;
+    e->op = op;
+    e->pdrv = pdrv;
+    e->retries = retries > UINT8_MAX ? UINT8_MAX : retries;
+    e->crc_errors = crc_errors > UINT8_MAX ? UINT8_MAX : crc_errors;
+
+    trace.histogram[op][bucket(duration)]++;
+    trace.total_us[op] += duration;
+    if (duration > trace.max_us[op]) trace.max_us[op] = duration;
+    if (rc) trace.errors[op]++;
+    if (duration >= SD_TRACE_STALL_US) trace.stalls++;
+    if (duration > trace.worst_us) trace.worst_us = duration;
+    trace.retries += retries;
+    trace.crc_errors += crc_errors;
+    trace.token_spins += spins;
+    mutex_exit(&trace_mutex);
+}
+
+void sd_trace_dump(printer_t printer) {
+    // Copy under the lock, print without it: printing over USB is slow
+    static sd_trace_entry_t ring[SD_TRACE_RING_SIZE];
+    static uint32_t histogram[SD_TRACE_OPS][SD_TRACE_BUCKETS];
+    mutex_enter_blocking(&trace_mutex);
+    memcpy(ring, trace.ring, sizeof ring);
+    memcpy(histogram, trace.histogram, sizeof histogram);
+    uint32_t next = trace.next;
+    uint64_t total_us[SD_TRACE_OPS];
+    uint32_t max_us[SD_TRACE_OPS], errors[SD_TRACE_OPS];
+    memcpy(total_us, trace.total_us, sizeof total_us);
+    memcpy(max_us, trace.max_us, sizeof max_us);
+    memcpy(errors, trace.errors, sizeof errors);
+    uint32_t retries = trace.retries, crc_errors = trace.crc_errors,
+             token_spins = trace.token_spins;
+    mutex_exit(&trace_mutex);
+
+    printer("SD trace: %" PRIu32 " operations, %" PRIu32 " retries, %" PRIu32
+            " CRC errors, %" PRIu32 " token poll bytes\n",
+            next, retries, crc_errors, token_spins);
+
+    for (int op = 0; op < SD_TRACE_OPS; ++op) {
+        uint32_t n = 0;
+        for (int b = 0; b < SD_TRACE_BUCKETS; ++b) n += histogram[op][b];
+        if (!n) continue;
+        printer("%s: %" PRIu32 " ops, avg %" PRIu32 " us, max %" PRIu32 " us, %" PRIu32
+                " errors\n",
+                op_names[op], n, (uint32_t)(total_us[op] / n), max_us[op], errors[op]);
+        for (int b = 0; b < SD_TRACE_BUCKETS; ++b) {
+            if (!histogram[op][b]) continue;
+            printer("  %8lu us.. %8" PRIu32 "\n", 1UL << b, histogram[op][b]);
+        }
+    }
+
+    uint32_t n = next < SD_TRACE_RING_SIZE ? next : SD_TRACE_RING_SIZE;
+    printer("Last %" PRIu32 " operations:\n", n);
+    printer("    start_us op    drv       lba count   dur_us retry crc spins rc\n");
+    for (uint32_t i = next - n; i != next; ++i) {
+        const sd_trace_entry_t *e = &ring[i % SD_TRACE_RING_SIZE];
+        printer("  %10" PRIu32 " %-5s %3u %9" PRIu32 " %5u %8" PRIu32 " %5u %3u %5u %u\n",
+                e->start_us, op_names[e->op], e->pdrv, e->lba, e->count, e->duration_us,
+                e->retries, e->crc_errors, e->token_spins, e->rc);
+    }
+}
+
+uint32_t __not_in_flash_func(sd_trace_stalls)(uint32_t *worst_us) {
+    *worst_us = trace.worst_us;
+    return trace.stalls;
+}
+
+void sd_trace_reset(void) {
+    mutex_enter_blocking(&trace_mutex);
+    memset(&trace, 0, sizeof trace);
+    mutex_exit(&trace_mutex);
+}
+
+#endif
+/* [] END OF FILE */
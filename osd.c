@@ -0,0 +1,196 @@
+/**
+ * On-screen performance overlay, see osd.h
+ */
+
+#include "pico/stdlib.h"
+#include "osd.h"
+#include "i2s.h"
+#include "sd_trace.h"
+#include "main.h"
+
+#define HISTORY     64          // frames in the sparkline and the frame rate
+#define SPARK_Y     44          // sparkline's top row
+#define SPARK_H     10
+#define SPARK_FULL  33333       // frame time at full height, two 60 Hz frames
+
+uint32_t osd_mask[OSD_ROWS][OSD_WORDS];
+
+// Written by core0, read by core1 without a lock: a torn read shows one
+// wrong number for a frame
+static struct {
+    uint32_t last_us;
+    uint32_t frames;
+    uint32_t frame_us[HISTORY];
+} stats;
+
+static volatile bool visible;
+static uint32_t combo_since;    // when the combo was pressed, 0 if it is not held
+static bool combo_done;         // toggled already on this press
+static uint32_t cost_us;        // the overlay's last frame on core1
+
+// 3x5 glyphs, top row in bits 14-12 with the left column in the high bit:
+// 0-9, A-Z, then the punctuation in glyph_punct. In RAM so core1 does not
+// read flash for them.
+static const char glyph_punct[] = ".:-/%";
+static const uint16_t __not_in_flash("osd") font[] = {
+    0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249,
+    0x7bef, 0x7bcf, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4,
+    0x396b, 0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d,
+    0x2b6a, 0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a,
+    0x5bfd, 0x5aad, 0x5a92, 0x72a7, 0x0002, 0x0410, 0x01c0, 0x12a4,
+    0x52a5,
+};
+
+void __not_in_flash_func(osd_frame)(void) {
+    uint32_t now = time_us_32();
+    if (stats.last_us) {
+        stats.frame_us[stats.frames % HISTORY] = now - stats.last_us;
+        stats.frames++;
+    }
+    stats.last_us = now;
+}
+
+void __not_in_flash_func(osd_combo)(bool held, uint32_t now_ms) {
+    if (!held) {
+        combo_since = 0;
+        combo_done = false;
+    } else if (!combo_since) {
+        combo_since = now_ms | 1;
+    } else if (!combo_done && now_ms - combo_since >= OSD_COMBO_MS) {
+        osd_toggle();
+        combo_done = true;
+    }
+}
+
+void __not_in_flash_func(osd_toggle)(void) {
+    visible = !visible;
+}
+
+static inline void plot(int x, int y) {
+    osd_mask[y][x >> 5] |= 1u << (x & 31);
+}
+
+static void __not_in_flash_func(draw_char)(int x, int y, char c) {
+    int g;
+    if (c >= '0' && c <= '9') g = c - '0';
+    else if (c >= 'A' && c <= 'Z') g = c - 'A' + 10;
+    else {
+        for (g = 0; glyph_punct[g] && glyph_punct[g] != c; g++)
+            ;
+        if (!glyph_punct[g]) return;        // space, or no glyph
+        g += 36;
+    }
+    for (int r = 0; r < 5; r++)
+        for (int col = 0; col < 3; col++)
+            if (font[g] >> (14 - r * 3 - col) & 1) plot(x + col, y + r);
+}
+
+// Text line n of the box, up to 16 characters
+static void __not_in_flash_func(draw_line)(int n, const char *text, const char *end) {
+    for (int i = 0; text + i < end && i < 16; i++)
+        draw_char(1 + i * 4, 1 + n * 6, text[i]);
+}
+
+static char *__not_in_flash_func(put_str)(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *__not_in_flash_func(put_uint)(char *p, uint32_t v) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+// v in tenths, with one decimal
+static char *__not_in_flash_func(put_tenths)(char *p, uint32_t v) {
+    p = put_uint(p, v / 10);
+    *p++ = '.';
+    *p++ = '0' + v % 10;
+    return p;
+}
+
+static void __not_in_flash_func(draw_sparkline)(uint32_t frames) {
+    for (int i = 0; i < HISTORY; i++) {
+        // Oldest on the left; nothing yet for frames before the first
+        uint32_t f = frames - HISTORY + i;
+        if (frames < HISTORY && i < HISTORY - (int)frames) continue;
+        uint32_t us = stats.frame_us[f % HISTORY];
+        int h = us >= SPARK_FULL ? SPARK_H : (int)((us * SPARK_H + SPARK_FULL / 2) / SPARK_FULL);
+        if (h < 1) h = 1;
+        for (int y = 0; y < h; y++) plot(1 + i, SPARK_Y + SPARK_H - 1 - y);
+    }
+    // Dotted line at one 60 Hz frame
+    for (int i = 0; i < HISTORY; i += 2) plot(1 + i, SPARK_Y + SPARK_H / 2 - 1);
+}
+
+bool __not_in_flash_func(osd_begin)(uint32_t build_us) {
+    if (!visible) return false;
+
+    for (int y = 0; y < OSD_ROWS; y++)
+        for (int w = 0; w < OSD_WORDS; w++) osd_mask[y][w] = 0;
+
+    uint32_t frames = stats.frames;
+    uint32_t n = frames < HISTORY ? frames : HISTORY, total = 0;
+    for (uint32_t i = 0; i < n; i++) total += stats.frame_us[(frames - 1 - i) % HISTORY];
+    uint32_t last = n ? stats.frame_us[(frames - 1) % HISTORY] : 0;
+    uint32_t sd_worst;
+    uint32_t sd_stalls = sd_trace_stalls(&sd_worst);
+
+    // Only 16 characters are drawn, but put_*() do not stop there: the
+    // longest line, "DROP " and " LATE " with two 10 digit counts, is 31
+    char text[32], *p;
+    p = put_str(text, "FPS ");
+    // n is at most HISTORY, so this fits in 32 bits; a 64 bit divide would
+    // call __aeabi_uldivmod in flash
+    p = put_tenths(p, total ? n * 10000000u / total : 0);
+    p = put_str(p, " ");
+    p = put_tenths(p, last / 100);
+    p = put_str(p, "MS");
+    draw_line(0, text, p);
+
+    p = put_str(text, "LCD ");
+    p = put_tenths(p, build_us / 100);
+    p = put_str(p, "MS");
+    draw_line(1, text, p);
+
+    p = put_str(text, "AUDIO XRUN ");
+    p = put_uint(p, i2s_underruns());
+    draw_line(2, text, p);
+
+    p = put_str(text, "SD STALL ");
+    p = put_uint(p, sd_stalls);
+    p = put_str(p, " ");
+    p = put_uint(p, sd_worst / 1000);
+    p = put_str(p, "MS");
+    draw_line(3, text, p);
+
+    const pacing_stats_t *pacing = &frame_pacing.stats;
+    p = put_uint(text, frame_pacing.rate_hz);
+    p = put_str(p, "HZ JUDDER ");
+    p = put_uint(p, pacing->judder);
+    draw_line(4, text, p);
+
+    p = put_str(text, "DROP ");
+    p = put_uint(p, pacing->dropped);
+    p = put_str(p, " LATE ");
+    p = put_uint(p, pacing->late);
+    draw_line(5, text, p);
+
+    p = put_str(text, "OSD ");
+    p = put_uint(p, cost_us);
+    p = put_str(p, "US");
+    draw_line(6, text, p);
+
+    draw_sparkline(frames);
+    return true;
+}
+
+void __not_in_flash_func(osd_end)(uint32_t us) {
+    cost_us = us;
+}
@@ -0,0 +1,43 @@
+#ifndef OSD_H
+#define OSD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// On-screen performance overlay: frame rate and frame time, the LCD's
+// scanline time, audio underruns, SD stalls, the frame pacing's rate,
+// judder, dropped and late frames, a frame time sparkline and what the
+// overlay itself cost, in a box in the top left corner.
+//
+// Core0 samples the counters once per frame; core1 draws the text into
+// osd_mask at the start of each frame it sends, and st7789_lcd.c draws
+// the mask over the scanlines it covers as it builds them. The game's
+// framebuffer is never touched, and while the overlay is off it costs a
+// flag test per frame.
+//
+// Hold left + right + A for OSD_COMBO_MS to show or hide it.
+
+#define OSD_COMBO_MS    500
+
+// Mask size in overlay pixels: 16 characters of 4x6 across, 7 lines of
+// text and the sparkline down, with a 1 pixel border
+#define OSD_COLS        66
+#define OSD_ROWS        55
+#define OSD_WORDS       ((OSD_COLS + 31) / 32)
+
+// Bit x of row y is set for text, clear for the box behind it
+extern uint32_t osd_mask[OSD_ROWS][OSD_WORDS];
+
+// Core0: once per pass of the frame loop, and with the combo's buttons on
+// every input poll
+void osd_frame(void);
+void osd_combo(bool held, uint32_t now_ms);
+void osd_toggle(void);
+
+// Core1: draw the mask for this frame and return true if the overlay is
+// on. build_us is the last frame's scanline time. Report what the overlay
+// cost with osd_end().
+bool osd_begin(uint32_t build_us);
+void osd_end(uint32_t cost_us);
+
+#endif // OSD_H
@@ -0,0 +1,221 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Frame pacing: which of the frames the game finishes go to the LCD.
+//
+// The game loop runs at the audio rate: every pass queues one audio frame
+// and waits while the one before is still queued, so the game keeps its
+// tempo whatever the LCD does. What can be chosen is which frames core1
+// sends. pacing_frame() picks a target rate, 60 or 30 Hz, and keeps to it:
+//
+// - A frame before its slot is skipped: every other frame at 30 Hz.
+// - A frame due while core1 is still sending the last one is held (core0
+//   waits for core1) if core1 will be done within PACING_HOLD_US, the
+//   queued audio lasts that long and the wait leaves the game's logic
+//   time for the next frame; otherwise it is dropped.
+// - Slots follow the game's own tempo and phase, so a game running a
+//   little off 60 Hz does not drift through them.
+//
+// The rate goes down to 30 Hz when core1's present time no longer fits a
+// 60 Hz frame, when most of the game's frames take longer than that, or
+// after PACING_DROP_LIMIT drops in the last 32 due frames. It goes back up
+// after PACING_UP_FRAMES frames with room to spare.
+//
+// Statistics: a late frame went out more than a quarter period after its
+// slot; judder counts intervals between presented frames that are off the
+// period by more than a quarter.
+//
+// Header only, like lcd_scale.h, so tools/pacing_sim.c can run it on
+// synthetic timing traces and the firmware inlines it into the render
+// callback in RAM. Times are time_us_32() values and wrap.
+
+#define PACING_PERIOD_60        16667
+#define PACING_HOLD_US          4000    // longest core0 waits for core1
+#define PACING_AUDIO_MARGIN_US  4000    // audio left when core0 stops waiting
+#define PACING_FIT_US           (PACING_PERIOD_60 - 500)        // present time for 60 Hz
+#define PACING_ROOM_US          (PACING_PERIOD_60 * 7 / 8)      // ...and to go back up
+#define PACING_SLOW_US          (PACING_PERIOD_60 * 9 / 8)      // a slow game frame
+#define PACING_DROP_LIMIT       4
+#define PACING_UP_FRAMES        120
+
+typedef enum {
+    PACING_PRESENT,
+    PACING_HOLD,            // wait until hold_until_us for core1, then pacing_held()
+    PACING_SKIP,
+} pacing_action_t;
+
+typedef struct {
+    uint32_t now_us;
+    uint32_t logic_us;      // the game's time for this frame
+    uint32_t present_us;    // core1's time for the last frame it sent, 0 if none
+    bool busy;              // core1 still sending
+    uint32_t busy_until_us; // when it should be done, if busy
+    uint32_t audio_us;      // audio queued, how long core0 can stop
+} pacing_input_t;
+
+typedef struct {
+    uint32_t frames;        // finished by the game
+    uint32_t presented;
+    uint32_t skipped;       // not due at the target rate
+    uint32_t dropped;       // due, but core1 was still busy
+    uint32_t held;          // presented after core0 waited for core1
+    uint32_t late;
+    uint32_t judder;
+    uint32_t intervals;     // between presented frames
+    uint64_t deviation_us;  // of those intervals from the period, in total
+    uint32_t rate_changes;
+} pacing_stats_t;
+
+typedef struct {
+    uint32_t rate_hz;
+    uint32_t next_slot_us;
+    uint32_t hold_until_us;
+    uint32_t last_frame_us;
+    uint32_t last_present_us;
+    uint32_t tempo_us;      // the game's frame interval, averaged
+    uint32_t present_us;    // core1's present time, averaged
+    uint32_t logic_us;      // the game's logic time, averaged
+    uint32_t drops;         // last 32 due frames, 1 for dropped
+    uint32_t slow;          // last 32 game frames, 1 for slow
+    uint32_t drop_count;    // ones in drops
+    uint32_t slow_count;    // ones in slow
+    uint32_t room_frames;   // frames in a row that would fit 60 Hz
+    bool started;
+    pacing_stats_t stats;
+} pacing_t;
+
+static inline void pacing_init(pacing_t *p) {
+    memset(p, 0, sizeof(*p));
+    p->rate_hz = 60;
+    p->tempo_us = PACING_PERIOD_60;
+}
+
+// Time between slots at the target rate
+static inline uint32_t pacing_period(const pacing_t *p) {
+    return p->rate_hz == 60 ? p->tempo_us : 2 * p->tempo_us;
+}
+
+static inline uint32_t pacing_average(uint32_t avg, uint32_t v) {
+    return avg ? (uint32_t)((int32_t)avg + ((int32_t)(v - avg) >> 3)) : v;
+}
+
+// Shift bit into a 32 frame window and keep its count of ones, rather than
+// __builtin_popcount(), which is a libgcc call in flash on the M33
+static inline void pacing_shift(uint32_t *window, uint32_t *count, bool bit) {
+    *count += (uint32_t)bit - (*window >> 31);
+    *window = *window << 1 | bit;
+}
+
+static inline void pacing_set_rate(pacing_t *p, uint32_t hz) {
+    p->rate_hz = hz;
+    p->drops = 0;
+    p->drop_count = 0;
+    p->room_frames = 0;
+    p->stats.rate_changes++;
+}
+
+static inline void pacing_update_rate(pacing_t *p) {
+    uint32_t drops = p->drop_count;
+    uint32_t slow = p->slow_count;
+    if (p->rate_hz == 60) {
+        if (p->present_us > PACING_FIT_US || slow >= 16 || drops >= PACING_DROP_LIMIT)
+            pacing_set_rate(p, 30);
+    } else if (p->present_us < PACING_ROOM_US && slow <= 2 && !drops) {
+        if (++p->room_frames >= PACING_UP_FRAMES)
+            pacing_set_rate(p, 60);
+    } else {
+        p->room_frames = 0;
+    }
+}
+
+static inline void pacing_drop(pacing_t *p) {
+    // The slot stays: the next frame is due, late
+    p->stats.dropped++;
+    pacing_shift(&p->drops, &p->drop_count, true);
+}
+
+// The game finished a frame: present it, hold it or skip it
+static inline pacing_action_t pacing_frame(pacing_t *p, const pacing_input_t *in) {
+    uint32_t now = in->now_us;
+    p->stats.frames++;
+    if (in->present_us)
+        p->present_us = pacing_average(p->present_us, in->present_us);
+    p->logic_us = pacing_average(p->logic_us, in->logic_us);
+    if (p->started) {
+        uint32_t interval = now - p->last_frame_us;
+        pacing_shift(&p->slow, &p->slow_count, interval > PACING_SLOW_US);
+        // Stalls say nothing about the tempo
+        if (interval > PACING_PERIOD_60 / 2 && interval < PACING_PERIOD_60 * 3 / 2)
+            p->tempo_us = pacing_average(p->tempo_us, interval);
+    } else {
+        p->started = true;
+        p->next_slot_us = now;
+    }
+    p->last_frame_us = now;
+    pacing_update_rate(p);
+
+    // Half a game frame early is on time: the game's tempo jitters
+    if ((int32_t)(now - p->next_slot_us) < -(int32_t)(p->tempo_us / 2)) {
+        p->stats.skipped++;
+        return PACING_SKIP;
+    }
+    if (!in->busy)
+        return PACING_PRESENT;
+
+    uint32_t limit = PACING_HOLD_US;
+    uint32_t audio = in->audio_us > PACING_AUDIO_MARGIN_US ? in->audio_us - PACING_AUDIO_MARGIN_US : 0;
+    uint32_t spare = p->tempo_us > p->logic_us ? p->tempo_us - p->logic_us : 0;
+    if (audio < limit)
+        limit = audio;
+    if (spare < limit)
+        limit = spare;
+    if ((int32_t)(in->busy_until_us - (now + limit)) <= 0) {
+        p->hold_until_us = now + limit;
+        return PACING_HOLD;
+    }
+    pacing_drop(p);
+    return PACING_SKIP;
+}
+
+// After PACING_HOLD: present if core1 finished in time
+static inline pacing_action_t pacing_held(pacing_t *p, bool busy) {
+    if (busy) {
+        pacing_drop(p);
+        return PACING_SKIP;
+    }
+    p->stats.held++;
+    return PACING_PRESENT;
+}
+
+// The frame went to core1 at now
+static inline void pacing_present(pacing_t *p, uint32_t now) {
+    uint32_t period = pacing_period(p);
+    int32_t behind = (int32_t)(now - p->next_slot_us);
+    p->stats.presented++;
+    pacing_shift(&p->drops, &p->drop_count, false);
+    if (behind > (int32_t)(period / 4))
+        p->stats.late++;
+    // Far behind: start again from here rather than rush the next ones.
+    // Otherwise pull the slots a quarter of the way to when frames come,
+    // so they settle on the game's phase.
+    if (behind > (int32_t)(period / 2))
+        p->next_slot_us = now + period;
+    else
+        p->next_slot_us += period + behind / 4;
+
+    if (p->stats.presented > 1) {
+        int32_t off = (int32_t)(now - p->last_present_us - period);
+        uint32_t deviation = off < 0 ? -off : off;
+        p->stats.intervals++;
+        p->stats.deviation_us += deviation;
+        if (deviation > period / 4)
+            p->stats.judder++;
+    }
+    p->last_present_us = now;
+}
+
+#endif // PACING_H
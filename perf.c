@@ -0,0 +1,120 @@
+/**
+ * Per-frame performance counters, see perf.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hardware/structs/busctrl.h"
+#include "perf.h"
+
+static struct {
+    uint32_t frames;
+    perf_xip_t xip_last_sample;     // raw counter values at the last frame
+    perf_xip_t xip_total;
+    perf_xip_t xip_frame;           // last frame
+    perf_xip_t xip_worst;           // frame with the most misses
+    perf_bus_t bus[PERF_BUS_EVENTS];
+    uint32_t bus_group;             // events the counters are set up for
+} perf;
+
+// PERFSEL values. Each arbiter has four events (stall upstream, stall
+// downstream, contested, access); FASTPERI starts at 0x0c, SRAM9 at 0x10
+// and the banks count down to SRAM0 at 0x34, followed by XIP_MAIN1 and
+// XIP_MAIN0.
+#define BUS_CONTESTED           2
+#define BUS_ACCESS              3
+#define BUS_FASTPERI(ev)        (0x0c + (ev))
+#define BUS_SRAM(n, ev)         (0x10 + (9 - (n)) * 4 + (ev))
+#define BUS_XIP(n, ev)          (0x38 + (1 - (n)) * 4 + (ev))
+
+static uint32_t __not_in_flash_func(bus_event_sel)(uint32_t event) {
+    if (event < 10) return BUS_SRAM(event, BUS_CONTESTED);
+    if (event < 12) return BUS_XIP(event - 10, BUS_CONTESTED);
+    if (event < 14) return BUS_SRAM(event - 4, BUS_ACCESS);
+    return BUS_FASTPERI(event == 14 ? BUS_CONTESTED : BUS_ACCESS);
+}
+
+static const char* const bus_event_names[PERF_BUS_EVENTS] = {
+    "sram0 contested", "sram1 contested", "sram2 contested", "sram3 contested",
+    "sram4 contested", "sram5 contested", "sram6 contested", "sram7 contested",
+    "sram8 contested", "sram9 contested", "xip0 contested", "xip1 contested",
+    "sram8 accesses", "sram9 accesses", "fastperi contested", "fastperi accesses",
+};
+
+// Point the counters at the next group of events; writing a counter
+// clears it
+static void __not_in_flash_func(bus_select)(uint32_t group) {
+    for (int i = 0; i < PERF_BUS_COUNTERS; i++) {
+        bus_ctrl_hw->counter[i].sel = bus_event_sel(group * PERF_BUS_COUNTERS + i);
+        bus_ctrl_hw->counter[i].value = 0;
+    }
+    perf.bus_group = group;
+}
+
+static void __not_in_flash_func(bus_sample)(void) {
+    for (int i = 0; i < PERF_BUS_COUNTERS; i++) {
+        perf_bus_t* b = &perf.bus[perf.bus_group * PERF_BUS_COUNTERS + i];
+        uint32_t n = bus_ctrl_hw->counter[i].value;
+        b->total += n;
+        b->frames++;
+        if (n > b->worst) b->worst = n;
+    }
+    bus_select((perf.bus_group + 1) % PERF_BUS_GROUPS);
+}
+
+// The counters are left running and differenced, so nothing is lost
+// between reading and clearing them
+static perf_xip_t xip_sample(void) {
+    perf_xip_t s = { xip_ctrl_hw->ctr_hit, xip_ctrl_hw->ctr_acc };
+    return s;
+}
+
+void __not_in_flash_func(perf_frame)(void) {
+    perf_xip_t now = xip_sample();
+    perf_xip_t d = {
+        now.hits - perf.xip_last_sample.hits,
+        now.accesses - perf.xip_last_sample.accesses,
+    };
+    perf.xip_last_sample = now;
+    if (perf.frames++ == 0) {           // first call only sets the baseline
+        bus_ctrl_hw->perfctr_en = 1;
+        bus_select(0);
+        return;
+    }
+    bus_sample();
+
+    perf.xip_frame = d;
+    perf.xip_total.hits += d.hits;
+    perf.xip_total.accesses += d.accesses;
+    if (d.accesses - d.hits > perf.xip_worst.accesses - perf.xip_worst.hits)
+        perf.xip_worst = d;
+}
+
+static void print_xip(const char* name, perf_xip_t x) {
+    uint32_t misses = x.accesses - x.hits;
+    printf("  %-6s %10lu accesses %10lu misses (%lu.%02lu%% hit)\n", name,
+           (unsigned long)x.accesses, (unsigned long)misses,
+           x.accesses ? (unsigned long)((uint64_t)x.hits * 100 / x.accesses) : 0,
+           x.accesses ? (unsigned long)((uint64_t)x.hits * 10000 / x.accesses % 100) : 0);
+}
+
+void perf_dump(void) {
+    printf("Perf: %lu frames\n", (unsigned long)(perf.frames ? perf.frames - 1 : 0));
+    printf("XIP cache:\n");
+    print_xip("total", perf.xip_total);
+    print_xip("last", perf.xip_frame);
+    print_xip("worst", perf.xip_worst);
+    printf("Bus events per frame:\n");
+    for (int i = 0; i < PERF_BUS_EVENTS; i++) {
+        const perf_bus_t* b = &perf.bus[i];
+        printf("  %-18s avg %8lu worst %8lu (%lu frames)\n", bus_event_names[i],
+               b->frames ? (unsigned long)(b->total / b->frames) : 0,
+               (unsigned long)b->worst, (unsigned long)b->frames);
+    }
+}
+
+void perf_reset(void) {
+    memset(&perf, 0, sizeof(perf));
+}
@@ -0,0 +1,42 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+// Per-frame performance counters. perf_frame() samples the hardware
+// counters once per pass of the main loop; perf_dump() prints totals,
+// the last frame and the worst frame over stdio.
+//
+// XIP cache: the hit and access counters in XIP_CTRL count flash
+// accesses from both cores through the cache. Misses are accesses that
+// had to go out to the QSPI flash, which is what stalls code running
+// from flash.
+//
+// Bus contention: the bus fabric has four event counters. They count
+// contested accesses (a master had to wait for another one) on SRAM
+// banks 0-9 and the two XIP ports, and the total traffic on the scratch
+// banks and the fast peripheral port (the LCD DMA reads its scanlines
+// from scratch X and writes them to the PIO). They are set up for four
+// events per frame in rotation, so every event is sampled one frame in
+// PERF_BUS_GROUPS.
+
+typedef struct {
+    uint32_t hits;
+    uint32_t accesses;
+} perf_xip_t;
+
+#define PERF_BUS_EVENTS     16
+#define PERF_BUS_COUNTERS   4
+#define PERF_BUS_GROUPS     (PERF_BUS_EVENTS / PERF_BUS_COUNTERS)
+
+typedef struct {
+    uint64_t total;
+    uint32_t frames;        // frames this event was sampled in
+    uint32_t worst;
+} perf_bus_t;
+
+void perf_frame(void);
+void perf_dump(void);
+void perf_reset(void);
+
+#endif // PERF_H
@@ -0,0 +1,321 @@
+/**
+ * Write-behind save data journal, see save.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "save.h"
+
+#include "ff.h"
+#include "diskio.h"
+#include "f_util.h"
+#include "f_raw_stream.h"
+
+#define SAVE_MAGIC          0x56534254  // "TBSV"
+#define SECTOR_SIZE         512
+#define PAYLOAD_SECTORS     ((SAVE_DATA_SIZE + SECTOR_SIZE - 1) / SECTOR_SIZE)
+#define SLOT_SECTORS        (1 + PAYLOAD_SECTORS)   // header + payload
+#define JOURNAL_BYTES       ((FSIZE_t)SAVE_SLOTS * SLOT_SECTORS * SECTOR_SIZE)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t size;
+    uint32_t crc;       // over seq, size and payload
+} save_header_t;
+
+// RAM copy the game reads and writes, and the snapshot being committed.
+// Word aligned so SDIO can DMA straight from them.
+static uint32_t save_data[PAYLOAD_SECTORS * SECTOR_SIZE / 4];
+static uint32_t save_staging[PAYLOAD_SECTORS * SECTOR_SIZE / 4];
+static uint32_t save_header_sector[SECTOR_SIZE / 4];
+
+static struct {
+    bool open;              // a cartridge is loaded
+    bool loaded;            // save_data holds its newest record, if any
+    bool attached;          // its journal file exists and lba is valid
+    bool failed;            // the journal could not be created
+    char path[FF_LFN_BUF + 1];
+    BYTE pdrv;
+    LBA_t lba;              // first sector of the journal file
+    uint32_t seq;           // sequence number of the newest record
+    uint32_t slot;          // slot the next record goes to
+    bool dirty;
+    uint32_t first_dirty_ms;
+    uint32_t last_write_ms;
+    int step;               // sectors of the current record written, -1 if idle
+} journal = { .step = -1 };
+
+static uint32_t crc32_update(uint32_t crc, const void* data, uint32_t len) {
+    static const uint32_t nibble_table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t* p = data;
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ nibble_table[crc & 0x0F];
+    }
+    return crc;
+}
+
+static uint32_t record_crc(uint32_t seq, const void* payload) {
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t size = SAVE_DATA_SIZE;
+    crc = crc32_update(crc, &seq, sizeof(seq));
+    crc = crc32_update(crc, &size, sizeof(size));
+    crc = crc32_update(crc, payload, SAVE_DATA_SIZE);
+    return ~crc;
+}
+
+static LBA_t slot_lba(uint32_t slot) {
+    return journal.lba + (LBA_t)slot * SLOT_SECTORS;
+}
+
+// Find the newest record whose checksum verifies and load it
+static void journal_recover(void) {
+    uint32_t seqs[SAVE_SLOTS];
+    save_header_t* hdr = (save_header_t*)save_header_sector;
+
+    for (uint32_t i = 0; i < SAVE_SLOTS; i++) {
+        seqs[i] = 0;
+        if (disk_read(journal.pdrv, (BYTE*)save_header_sector, slot_lba(i), 1) != RES_OK) continue;
+        if (hdr->magic == SAVE_MAGIC && hdr->size == SAVE_DATA_SIZE) seqs[i] = hdr->seq;
+    }
+
+    while (1) {
+        uint32_t best = SAVE_SLOTS;
+        for (uint32_t i = 0; i < SAVE_SLOTS; i++) {
+            if (seqs[i] && (best == SAVE_SLOTS || seqs[i] > seqs[best])) best = i;
+        }
+        if (best == SAVE_SLOTS) {
+            printf("Save: no valid record, starting empty\n");
+            return;
+        }
+
+        // Headers were overwritten by the scan; read this one again
+        if (disk_read(journal.pdrv, (BYTE*)save_header_sector, slot_lba(best), 1) == RES_OK &&
+            disk_read(journal.pdrv, (BYTE*)save_staging, slot_lba(best) + 1, PAYLOAD_SECTORS) == RES_OK &&
+            hdr->crc == record_crc(seqs[best], save_staging)) {
+            memcpy(save_data, save_staging, SAVE_DATA_SIZE);
+            journal.seq = seqs[best];
+            journal.slot = (best + 1) % SAVE_SLOTS;
+            printf("Save: recovered record %lu from slot %lu\n",
+                   (unsigned long)journal.seq, (unsigned long)best);
+            return;
+        }
+
+        // Torn or corrupt record, fall back to the one before it
+        printf("Save: record %lu in slot %lu is corrupt\n",
+               (unsigned long)seqs[best], (unsigned long)best);
+        seqs[best] = 0;
+    }
+}
+
+// Make sure the journal file exists, is contiguous and has the right size.
+// Resolves its first sector so records can be written without FatFs.
+static bool journal_create(const char* path) {
+    FRESULT fr = f_mkdir(SAVE_DIR);
+    if (fr != FR_OK && fr != FR_EXIST) {
+        printf("Save: f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+
+    FIL fil;
+    fr = f_open(&fil, path, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+    if (fr != FR_OK) {
+        printf("Save: f_open(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+        return false;
+    }
+
+    bool fresh = false;
+    if (f_size(&fil) != JOURNAL_BYTES) {
+        // Allocate the whole ring up front so commits never touch the FAT
+        fr = f_truncate(&fil);
+        if (fr == FR_OK) fr = f_expand(&fil, JOURNAL_BYTES, 1);
+        fresh = true;
+    }
+
+    f_raw_stream_t rs;
+    if (fr == FR_OK) fr = f_raw_stream_open(&fil, &rs);
+    FRESULT fr_close = f_close(&fil);
+    if (fr == FR_OK) fr = fr_close;
+    if (fr != FR_OK) {
+        printf("Save: journal %s unusable: %s (%d)\n", path, FRESULT_str(fr), fr);
+        return false;
+    }
+
+    journal.pdrv = rs.pdrv;
+    journal.lba = rs.lba;
+
+    if (fresh) {
+        // f_expand does not clear the clusters; wipe the headers so stale
+        // data can never pass for a record
+        memset(save_header_sector, 0, sizeof(save_header_sector));
+        for (uint32_t i = 0; i < SAVE_SLOTS; i++) {
+            if (disk_write(journal.pdrv, (BYTE*)save_header_sector, slot_lba(i), 1) != RES_OK) {
+                printf("Save: failed to initialise %s\n", path);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Load the newest record of a journal that already exists. Cartridges
+// that never save never get a file.
+static void journal_load(void) {
+    if (!journal.open || journal.loaded) return;
+    journal.loaded = true;
+
+    FILINFO fno;
+    if (f_stat(journal.path, &fno) != FR_OK) return;
+    if (!journal_create(journal.path)) {
+        journal.failed = true;
+        return;
+    }
+    journal.attached = true;
+    journal_recover();
+}
+
+// Create the journal on the first write
+static void journal_attach(void) {
+    journal_load();
+    if (!journal.open || journal.attached || journal.failed) return;
+    if (journal_create(journal.path)) journal.attached = true;
+    else journal.failed = true;
+}
+
+bool save_open(const char* cart_name) {
+    save_close();
+
+    memset(save_data, 0, sizeof(save_data));
+    journal.seq = 0;
+    journal.slot = 0;
+    journal.dirty = false;
+    journal.step = -1;
+    journal.loaded = false;
+    journal.attached = false;
+    journal.failed = false;
+
+    // "/saves/<cartridge name without extension>.sav"
+    const char* dot = strrchr(cart_name, '.');
+    int name_len = dot ? (int)(dot - cart_name) : (int)strlen(cart_name);
+    snprintf(journal.path, sizeof(journal.path), SAVE_DIR "/%.*s.sav", name_len, cart_name);
+
+    journal.open = true;
+    return true;
+}
+
+void save_close(void) {
+    if (!journal.open) return;
+    save_flush();
+    journal.open = false;
+    journal.attached = false;
+}
+
+void save_discard(void) {
+    if (journal.open && (journal.dirty || journal.step >= 0))
+        printf("Save: card removed, record %lu not committed\n", (unsigned long)journal.seq);
+    journal.open = false;
+    journal.attached = false;
+    journal.dirty = false;
+    journal.step = -1;
+}
+
+uint32_t save_read(uint32_t offset, void* buf, uint32_t len) {
+    journal_load();
+    if (offset >= SAVE_DATA_SIZE) return 0;
+    if (len > SAVE_DATA_SIZE - offset) len = SAVE_DATA_SIZE - offset;
+    memcpy(buf, (uint8_t*)save_data + offset, len);
+    return len;
+}
+
+uint32_t save_write(uint32_t offset, const void* buf, uint32_t len, uint32_t now_ms) {
+    if (offset >= SAVE_DATA_SIZE) return 0;
+    if (len > SAVE_DATA_SIZE - offset) len = SAVE_DATA_SIZE - offset;
+
+    // Before the RAM copy changes, as it may load the newest record
+    journal_attach();
+    uint8_t* dst = (uint8_t*)save_data + offset;
+    if (memcmp(dst, buf, len) == 0) return len;    // nothing changed
+    memcpy(dst, buf, len);
+
+    if (!journal.dirty) journal.first_dirty_ms = now_ms;
+    journal.dirty = true;
+    journal.last_write_ms = now_ms;
+    return len;
+}
+
+// Snapshot the save data into a new record for the next slot
+static void commit_begin(void) {
+    memcpy(save_staging, save_data, sizeof(save_staging));
+    journal.dirty = false;
+    journal.seq++;
+
+    save_header_t* hdr = (save_header_t*)save_header_sector;
+    memset(save_header_sector, 0, sizeof(save_header_sector));
+    hdr->magic = SAVE_MAGIC;
+    hdr->seq = journal.seq;
+    hdr->size = SAVE_DATA_SIZE;
+    hdr->crc = record_crc(journal.seq, save_staging);
+    journal.step = 0;
+}
+
+// Write the next few sectors of the record in flight. The header goes
+// last: until it lands, the slot does not verify and recovery uses the
+// previous record.
+static void commit_continue(void) {
+    LBA_t lba = slot_lba(journal.slot);
+    DRESULT dr;
+
+    if (journal.step < PAYLOAD_SECTORS) {
+        UINT count = PAYLOAD_SECTORS - journal.step;
+        if (count > SAVE_SECTORS_PER_POLL) count = SAVE_SECTORS_PER_POLL;
+        dr = disk_write(journal.pdrv, (BYTE*)save_staging + journal.step * SECTOR_SIZE,
+                        lba + 1 + journal.step, count);
+        journal.step += count;
+    } else {
+        dr = disk_write(journal.pdrv, (BYTE*)save_header_sector, lba, 1);
+        journal.step = SLOT_SECTORS;
+    }
+
+    if (dr != RES_OK) {
+        // Leave the slot as it is and retry with a fresh record later
+        printf("Save: disk_write error %d, commit of record %lu abandoned\n",
+               dr, (unsigned long)journal.seq);
+        journal.dirty = true;
+        journal.step = -1;
+        return;
+    }
+
+    if (journal.step == SLOT_SECTORS) {
+        journal.slot = (journal.slot + 1) % SAVE_SLOTS;
+        journal.step = -1;
+    }
+}
+
+void save_poll(uint32_t now_ms) {
+    if (!journal.attached) return;
+
+    if (journal.step < 0) {
+        if (!journal.dirty) return;
+        // Coalesce bursts of writes into one record
+        if (now_ms - journal.last_write_ms < SAVE_COALESCE_MS &&
+            now_ms - journal.first_dirty_ms < SAVE_MAX_DELAY_MS) return;
+        commit_begin();
+    }
+    commit_continue();
+}
+
+void save_flush(void) {
+    if (!journal.attached) return;
+
+    for (int attempt = 0; attempt < 3 && (journal.dirty || journal.step >= 0); attempt++) {
+        if (journal.step < 0) commit_begin();
+        while (journal.step >= 0 && journal.step < SLOT_SECTORS) commit_continue();
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cartridge save data lives in RAM; writes return immediately and are
+// committed to the SD card in the background by save_poll().
+//
+// On the card each cartridge gets a preallocated, contiguous journal
+// file of SAVE_SLOTS record slots. A commit appends one record holding
+// the whole save image: the data sectors are written first and the
+// checksummed header sector last, so a power loss at any point leaves
+// the previous record intact. The newest record with a valid checksum
+// is recovered on the first save_read() or save_write(), and the journal
+// is only created on the first save_write().
+
+#define SAVE_DATA_SIZE      2048    // bytes of save data per cartridge
+#define SAVE_SLOTS          64      // records in the journal ring
+#define SAVE_COALESCE_MS    250     // commit after this long without writes...
+#define SAVE_MAX_DELAY_MS   2000    // ...or at most this long after the first one
+#define SAVE_SECTORS_PER_POLL 1     // SD sectors written per save_poll() call
+
+#define SAVE_DIR            "/saves"
+
+// Select the journal of a cartridge; nothing is read from the card until
+// it is used. Any pending data of the previous cartridge is flushed first.
+bool save_open(const char* cart_name);
+void save_close(void);
+// Close without committing, for when the card has gone away
+void save_discard(void);
+
+// Access the RAM copy of the save data
+uint32_t save_read(uint32_t offset, void* buf, uint32_t len);
+uint32_t save_write(uint32_t offset, const void* buf, uint32_t len, uint32_t now_ms);
+
+// Do a bounded slice of background commit work; call once per frame
+void save_poll(uint32_t now_ms);
+
+// Commit any pending data before returning
+void save_flush(void);
+
+#endif // SAVE_H
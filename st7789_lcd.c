@@ -15,48 +15,126 @@
 
 #include "st7789_lcd.pio.h"
 #include "main.h"
-
-#define SCREEN_WIDTH 240
-#define SCREEN_HEIGHT 240
+#include "st7789_lcd.h"
+#include "lcd_pixel.h"
+#include "lcd_scale.h"
+#include "lcd_palette.h"
+#include "osd.h"
+
+// Panel size, rotation and where the scaled screen goes on it, with row
+// kernels unrolled for that size; generated at configure time from
+// TINYBIT_LCD_PANEL, TINYBIT_LCD_ROTATION and TINYBIT_LCD_FIT by
+// tools/gen_lcd_geometry.py
+#include "lcd_geometry.h"
 
 #define RENDER_WIDTH 128
 #define RENDER_HEIGHT 128
 
-// LCD rotation: 0, 90, 180, or 270 degrees
-#ifndef LCD_ROTATION
-#define LCD_ROTATION 0
+// Pixel format on the bus: 16 bit RGB565, or 12 bit RGB444 with two pixels
+// in three bytes. The framebuffer only has 4 bits per channel, so 12 bit
+// loses nothing and sends a quarter fewer bytes per frame.
+#ifndef LCD_PIXEL_BITS
+#define LCD_PIXEL_BITS 16
 #endif
 
-#if LCD_ROTATION == 0
-  #define MADCTL_VAL  0x00
-  #define COL_START   0
-  #define ROW_START   0
-#elif LCD_ROTATION == 90
-  #define MADCTL_VAL  0x60
-  #define COL_START   0
-  #define ROW_START   0
+#if LCD_PIXEL_BITS == 16
+  #define COLMOD_VAL  0x55
+#elif LCD_PIXEL_BITS == 12
+  #define COLMOD_VAL  0x53
+  #if LCD_IMAGE_WIDTH % 2
+    #error "12 bit pixels need an even LCD_IMAGE_WIDTH"
+  #endif
 #else
-  #error "LCD_ROTATION must be 0 or 90"
+  #error "LCD_PIXEL_BITS must be 16 or 12"
 #endif
 
-#define COL_END   (COL_START + SCREEN_WIDTH - 1)
-#define ROW_END   (ROW_START + SCREEN_HEIGHT - 1)
-#define PTLAR_START (COL_START > 0 || ROW_START > 0 ? 80 : 0)
-#define PTLAR_END   (COL_START > 0 || ROW_START > 0 ? 319 : 239)
+// Horizontal scaling in the PIO: with LCD_PIO_SCALE each line is sent as
+// RENDER_WIDTH pixels, and the st7789_lcd_rep program sends the columns
+// the scaler doubles twice. The CPU converts and the DMA moves 128 pixels
+// a line instead of LCD_IMAGE_WIDTH.
+#ifndef LCD_PIO_SCALE
+#define LCD_PIO_SCALE 0
+#endif
+
+#if LCD_PIO_SCALE
+  #if LCD_PIXEL_BITS != 16
+    #error "LCD_PIO_SCALE needs 16 bit pixels"
+  #endif
+  #if LCD_IMAGE_WIDTH < RENDER_WIDTH || LCD_IMAGE_WIDTH > 2 * RENDER_WIDTH
+    #error "LCD_PIO_SCALE can only send each column once or twice"
+  #endif
+  #define LINE_BYTES (RENDER_WIDTH * 2)
+  #define LCD_WORD_DMA 0
+#else
+  #define LINE_BYTES (LCD_IMAGE_WIDTH * LCD_PIXEL_BITS / 8)
+  // Pixels go to the PIO a word at a time when the lines allow it: a
+  // quarter of the DMA transfers of byte writes. Commands always go out a
+  // byte at a time.
+  #define LCD_WORD_DMA (LINE_BYTES % 4 == 0)
+#endif
 
-// Fixed-point fractional bits for scaling
-#define FRAC_BITS 16
+// Indexed frames (lcd_palette.h): core0 hands over frames with few enough
+// colours as 4 or 8 bit indices, and the scanline builder looks each
+// source pixel up in a palette converted once per frame
+#ifndef LCD_INDEXED
+#define LCD_INDEXED 0
+#endif
 
-// Scaling factor: RENDER_WIDTH / SCREEN_WIDTH in fixed-point
-// 128/240 = 0.5333... -> (128 << 16) / 240 = 34952
-#define SCALE_X ((RENDER_WIDTH << FRAC_BITS) / SCREEN_WIDTH)
-#define SCALE_Y ((RENDER_HEIGHT << FRAC_BITS) / SCREEN_HEIGHT)
+// Overlay (osd.h) in line pixels: mask pixels doubled where the line is
+// wide enough, clipped to the image
+#if LCD_PIO_SCALE
+  #define LINE_PIXELS RENDER_WIDTH
+#else
+  #define LINE_PIXELS LCD_IMAGE_WIDTH
+#endif
+#define OSD_SHIFT       (LINE_PIXELS >= 2 * OSD_COLS ? 1 : 0)
+#define OSD_WIDTH       ((OSD_COLS << OSD_SHIFT) < LINE_PIXELS ? (OSD_COLS << OSD_SHIFT) : LINE_PIXELS)
+#define OSD_HEIGHT      ((OSD_ROWS << OSD_SHIFT) < LCD_IMAGE_HEIGHT ? (OSD_ROWS << OSD_SHIFT) : LCD_IMAGE_HEIGHT)
 
-// Double buffer for DMA transfers - each scanline is SCREEN_WIDTH pixels * 2 bytes
-static uint8_t scanline_buf[2][SCREEN_WIDTH * 2];
+// Controller RAM window the frames go to
+#define COL_END   (COL_START + SCREEN_WIDTH - 1)
+#define ROW_END   (ROW_START + SCREEN_HEIGHT - 1)
+#define IMAGE_COL_START (COL_START + LCD_IMAGE_X)
+#define IMAGE_ROW_START (ROW_START + LCD_IMAGE_Y)
+#define IMAGE_COL_END   (IMAGE_COL_START + LCD_IMAGE_WIDTH - 1)
+#define IMAGE_ROW_END   (IMAGE_ROW_START + LCD_IMAGE_HEIGHT - 1)
+
+// Double buffer for DMA transfers - each scanline is LINE_BYTES
+static uint8_t __core1_data("scanline") __aligned(4) scanline_buf[2][LINE_BYTES];
 static int dma_chan;
 static dma_channel_config dma_cfg;
 
+#if LCD_PIO_SCALE
+// 1 for the source columns the scaler shows twice
+static uint16_t __core1_data("scanline") column_repeat[RENDER_WIDTH];
+static const uint8_t column_map[LCD_IMAGE_WIDTH] = LCD_COLUMN_MAP;
+#endif
+
+#if !LCD_PIO_SCALE
+// Filtered scaling (lcd_scale.h): where each output column and row
+// samples, rebuilt by core1 when the mode changes, and the current pair of
+// source rows blended together. Not in scratch X, which has no room left
+// next to core1's stack.
+static lcd_scale_tap_t x_taps[LCD_IMAGE_WIDTH];
+static lcd_scale_tap_t y_taps[LCD_IMAGE_HEIGHT];
+static uint32_t blend_row[RENDER_WIDTH];
+static int blend_row_tap;       // y tap blend_row holds, -1 for none
+#endif
+static volatile lcd_scale_t scale_request = LCD_SCALE_NEAREST;
+static lcd_scale_t scale_mode = LCD_SCALE_NEAREST;
+static volatile uint32_t build_us;
+static volatile uint32_t present_us;
+
+#if LCD_INDEXED
+// The frame's bits per pixel and its palette as the bus wants it: RGB565
+// in bus byte order, or as the PIO takes it with LCD_PIO_SCALE. 12 bit
+// lines pack the palette's framebuffer pixels directly.
+static int frame_bits = 16;
+#if LCD_PIXEL_BITS == 16
+static uint16_t palette_lut[LCD_PALETTE_SIZE];
+#endif
+#endif
+
 // Double buffer for frame data (128x128 RGBA4444 = 32KB each)
 static volatile int display_buffer_idx = 0;  // Buffer being displayed by core1
 static volatile int render_buffer_idx = 1;   // Buffer being rendered to by core0
@@ -72,15 +150,21 @@ static volatile int render_buffer_idx = 1;   // Buffer being rendered to by core
 
 static PIO pio = pio0;
 static uint sm = 0;
+static uint cmd_offset;
+static pio_sm_config cmd_cfg;
+#if LCD_PIO_SCALE
+static uint rep_offset;
+static pio_sm_config rep_cfg;
+#endif
 
 // Format: cmd length (including cmd byte), post delay in units of 5 ms, then cmd payload
 static const uint8_t st7789_init_seq[] = {
         1, 20, 0x01,                        // Software reset
         1, 10, 0x11,                        // Exit sleep mode
-        2, 2, 0x3a, 0x55,                   // Set colour mode to 16 bit
+        2, 2, 0x3a, COLMOD_VAL,             // Set colour mode to LCD_PIXEL_BITS
         2, 0, 0x36, MADCTL_VAL,              // Set MADCTL for rotation
-        5, 0, 0x2a, COL_START >> 8, COL_START & 0xff, COL_END >> 8, COL_END & 0xff,     // CASET
-        5, 0, 0x2b, ROW_START >> 8, ROW_START & 0xff, ROW_END >> 8, ROW_END & 0xff,     // RASET
+        5, 0, 0x2a, IMAGE_COL_START >> 8, IMAGE_COL_START & 0xff, IMAGE_COL_END >> 8, IMAGE_COL_END & 0xff, // CASET
+        5, 0, 0x2b, IMAGE_ROW_START >> 8, IMAGE_ROW_START & 0xff, IMAGE_ROW_END >> 8, IMAGE_ROW_END & 0xff, // RASET
         5, 0, 0x30, PTLAR_START >> 8, PTLAR_START & 0xff, PTLAR_END >> 8, PTLAR_END & 0xff, // PTLAR
         1, 2, 0x21,                         // Inversion on, then 10 ms delay
         1, 2, 0x12,                         // Partial display mode on, then 10 ms delay
@@ -101,8 +185,24 @@ static inline void st7789_lcd_program_init(PIO pio, uint sm, uint offset, uint d
     sm_config_set_out_shift(&c, false, true, 8);
     pio_sm_init(pio, sm, offset, &c);
     pio_sm_set_enabled(pio, sm, true);
+    cmd_offset = offset;
+    cmd_cfg = c;
 }
 
+#if LCD_PIO_SCALE
+static inline void st7789_lcd_rep_program_init(uint offset, uint data_pin, uint clk_pin, float clk_div) {
+    pio_sm_config c = st7789_lcd_rep_program_get_default_config(offset);
+    sm_config_set_sideset_pins(&c, clk_pin);
+    sm_config_set_out_pins(&c, data_pin, 1);
+    sm_config_set_set_pins(&c, data_pin, 1);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+    sm_config_set_clkdiv(&c, clk_div);
+    sm_config_set_out_shift(&c, false, false, 32);
+    rep_offset = offset;
+    rep_cfg = c;
+}
+#endif
+
 // Making use of the narrow store replication behaviour on RP2040 to get the
 // data left-justified (as we are using shift-to-left to get MSB-first serial)
 
@@ -121,14 +221,67 @@ static inline void st7789_lcd_wait_idle(PIO pio, uint sm) {
         ;
 }
 
-static inline void lcd_set_dc_cs(bool dc, bool cs) {
-    sleep_us(1);
+// At least 1 us. Not sleep_us(): that is busy_wait_us() in flash, and
+// core1 switches DC and CS several times per frame.
+static __force_inline void lcd_delay_1us(void) {
+    uint32_t start = time_us_32();
+    while (time_us_32() - start < 2)
+        tight_loop_contents();
+}
+
+static __force_inline void lcd_set_dc_cs(bool dc, bool cs) {
+    lcd_delay_1us();
     gpio_put_masked((1u << PIN_DC) | (1u << PIN_CS), !!dc << PIN_DC | !!cs << PIN_CS);
-    sleep_us(1);
+    lcd_delay_1us();
+}
+
+// Set how many bits the SM pulls from the FIFO at a time: 8 for commands,
+// 32 for pixel data. Only call with the SM idle.
+static inline void st7789_lcd_set_pull_bits(PIO pio, uint sm, uint bits) {
+    hw_write_masked(&pio->sm[sm].shiftctrl,
+                    (bits & 0x1f) << PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB,
+                    PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS);
+    // After a byte the shift count is 8: empty for a threshold of 8, but
+    // 24 bits still to go for 32. Shift those out so the next pull starts
+    // on a fresh FIFO entry. (An empty OSR at 32 is empty at 8 as well, and
+    // an OUT there would wait for and swallow the next byte.)
+    if (bits == 32)
+        pio_sm_exec(pio, sm, pio_encode_out(pio_null, 32));
+}
+
+#if LCD_PIO_SCALE
+// Switch between st7789_lcd for commands and st7789_lcd_rep for pixels.
+// Only call with the SM idle and CS high. Core1 does this twice a frame,
+// so rather than pio_sm_init(), which is in flash, load the registers
+// that differ from the configs made at init, restart the SM to empty its
+// shift registers and jump to the program. All of it inlines. The SM then
+// waits for data, but wait for it anyway so no stray bits can go out once
+// CS is low.
+static __force_inline void st7789_lcd_use_program(PIO pio, uint sm, bool pixels) {
+    const pio_sm_config *c = pixels ? &rep_cfg : &cmd_cfg;
+    pio_sm_set_enabled(pio, sm, false);
+    pio->sm[sm].execctrl = c->execctrl;
+    pio->sm[sm].shiftctrl = c->shiftctrl;
+    pio->sm[sm].pinctrl = c->pinctrl;
+    pio_sm_restart(pio, sm);
+    pio_sm_exec(pio, sm, pio_encode_jmp(pixels ? rep_offset : cmd_offset));
+    pio_sm_set_enabled(pio, sm, true);
+    st7789_lcd_wait_idle(pio, sm);
+}
+#endif
+
+// Get the idle SM ready for command bytes or for pixel data
+static inline void st7789_lcd_begin(PIO pio, uint sm, bool pixels) {
+#if LCD_PIO_SCALE
+    st7789_lcd_use_program(pio, sm, pixels);
+#else
+    st7789_lcd_set_pull_bits(pio, sm, pixels && LCD_WORD_DMA ? 32 : 8);
+#endif
 }
 
 static inline void lcd_write_cmd(PIO pio, uint sm, const uint8_t *cmd, size_t count) {
     st7789_lcd_wait_idle(pio, sm);
+    st7789_lcd_begin(pio, sm, false);
     lcd_set_dc_cs(0, 0);
     st7789_lcd_put(pio, sm, *cmd++);
     if (count >= 2) {
@@ -153,12 +306,45 @@ static inline void lcd_init(PIO pio, uint sm, const uint8_t *init_seq) {
 static inline void st7789_start_pixels(PIO pio, uint sm) {
     uint8_t cmd = 0x2c; // RAMWR
     lcd_write_cmd(pio, sm, &cmd, 1);
+    st7789_lcd_begin(pio, sm, true);
     lcd_set_dc_cs(1, 0);
 }
 
+#if LCD_IMAGE_WIDTH < SCREEN_WIDTH || LCD_IMAGE_HEIGHT < SCREEN_HEIGHT
+// Black out the whole panel once: the frames only cover the image window
+static void lcd_clear_borders(PIO pio, uint sm) {
+    static const uint8_t window[] = {
+        0x2a, COL_START >> 8, COL_START & 0xff, COL_END >> 8, COL_END & 0xff,
+        0x2b, ROW_START >> 8, ROW_START & 0xff, ROW_END >> 8, ROW_END & 0xff,
+        0x2a, IMAGE_COL_START >> 8, IMAGE_COL_START & 0xff, IMAGE_COL_END >> 8, IMAGE_COL_END & 0xff,
+        0x2b, IMAGE_ROW_START >> 8, IMAGE_ROW_START & 0xff, IMAGE_ROW_END >> 8, IMAGE_ROW_END & 0xff,
+    };
+    uint8_t cmd = 0x2c; // RAMWR
+    lcd_write_cmd(pio, sm, &window[0], 5);
+    lcd_write_cmd(pio, sm, &window[5], 5);
+    lcd_write_cmd(pio, sm, &cmd, 1);
+    lcd_set_dc_cs(1, 0);
+    for (uint32_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT * LCD_PIXEL_BITS / 8; i++)
+        st7789_lcd_put(pio, sm, 0);
+    st7789_lcd_wait_idle(pio, sm);
+    lcd_set_dc_cs(1, 1);
+    lcd_write_cmd(pio, sm, &window[10], 5);
+    lcd_write_cmd(pio, sm, &window[15], 5);
+}
+#endif
+
 void lcd_init_display(void) {
     uint offset = pio_add_program(pio, &st7789_lcd_program);
     st7789_lcd_program_init(pio, sm, offset, PIN_DIN, PIN_CLK, SERIAL_CLK_DIV);
+#if LCD_PIO_SCALE
+    st7789_lcd_rep_program_init(pio_add_program(pio, &st7789_lcd_rep_program),
+                                PIN_DIN, PIN_CLK, SERIAL_CLK_DIV);
+
+    for (int x = 1; x < LCD_IMAGE_WIDTH; x++) {
+        if (column_map[x] == column_map[x - 1])
+            column_repeat[column_map[x]] = 1;
+    }
+#endif
 
     gpio_init(PIN_CS);
     gpio_init(PIN_DC);
@@ -172,72 +358,278 @@ void lcd_init_display(void) {
     gpio_put(PIN_CS, 1);
     gpio_put(PIN_RESET, 1);
     lcd_init(pio, sm, st7789_init_seq);
+#if LCD_IMAGE_WIDTH < SCREEN_WIDTH || LCD_IMAGE_HEIGHT < SCREEN_HEIGHT
+    lcd_clear_borders(pio, sm);
+#endif
     gpio_put(PIN_BL, 1);
 
     // Initialize DMA channel for scanline transfers
     dma_chan = dma_claim_unused_channel(true);
     dma_cfg = dma_channel_get_default_config(dma_chan);
+#if LCD_PIO_SCALE
+    // Halfword writes, replicated into both halves of the FIFO entry
+    channel_config_set_transfer_data_size(&dma_cfg, DMA_SIZE_16);
+#elif LCD_WORD_DMA
+    channel_config_set_transfer_data_size(&dma_cfg, DMA_SIZE_32);
+    // The SM shifts out MSB first; swap so the first byte in memory goes first
+    channel_config_set_bswap(&dma_cfg, true);
+#else
     channel_config_set_transfer_data_size(&dma_cfg, DMA_SIZE_8);
+#endif
     channel_config_set_dreq(&dma_cfg, pio_get_dreq(pio, sm, true));
     channel_config_set_read_increment(&dma_cfg, true);
     channel_config_set_write_increment(&dma_cfg, false);
 }
 
-static inline void build_scanline_from_buffer(uint8_t *dest, const uint8_t *src_buffer, uint32_t src_y) {
+// Nearest neighbour line, with the kernel lcd_geometry.h unrolled for the
+// panel. In RAM but not in scratch X: unrolled, it is a few KB.
+static void __not_in_flash_func(build_scanline_from_buffer)(uint8_t *dest, const uint8_t *src_buffer, uint32_t src_y) {
     const uint16_t *row_base = (const uint16_t *)&src_buffer[src_y * RENDER_WIDTH * 2];
 
-    interp0->accum[0] = 0;
-    interp0->base[0] = SCALE_X;
+#if LCD_PIO_SCALE
+    // One halfword per source pixel; bit 0 tells the PIO to send it twice
+    uint16_t *out = (uint16_t *)dest;
+    for (int x = 0; x < RENDER_WIDTH; x++)
+        out[x] = lcd_rgb565(row_base[x]) | column_repeat[x];
+#elif LCD_PIXEL_BITS == 16
+    lcd_scale_row_565((uint16_t *)dest, row_base);
+#else
+    lcd_scale_row_444(dest, row_base);
+#endif
+}
 
-    for (int x = 0; x < SCREEN_WIDTH; x++) {
-        uint32_t src_x = interp0->accum[0] >> FRAC_BITS;
-        (void)interp0->pop[0];
+#if LCD_INDEXED
+// Nearest neighbour line from an indexed frame
+static void __not_in_flash_func(build_indexed_scanline)(uint8_t *dest, const uint8_t *src_buffer, uint32_t src_y) {
+    const uint8_t *row = &src_buffer[src_y * RENDER_WIDTH * frame_bits / 8];
+
+#if LCD_PIO_SCALE
+    uint16_t *out = (uint16_t *)dest;
+    for (int x = 0; x < RENDER_WIDTH; x++)
+        out[x] = palette_lut[lcd_palette_at(row, x, frame_bits)] | column_repeat[x];
+#elif LCD_PIXEL_BITS == 16
+    if (frame_bits == 8)
+        lcd_scale_row_565_i8((uint16_t *)dest, row, palette_lut);
+    else
+        lcd_scale_row_565_i4((uint16_t *)dest, row, palette_lut);
+#else
+    if (frame_bits == 8)
+        lcd_scale_row_444_i8(dest, row, frame_palette.colours);
+    else
+        lcd_scale_row_444_i4(dest, row, frame_palette.colours);
+#endif
+}
 
-        uint16_t pixel = row_base[src_x];
+// Once per frame, before the first line
+static void __not_in_flash_func(load_palette)(void) {
+    frame_bits = frame_palette.bits;
+#if LCD_PIXEL_BITS == 16
+    if (frame_bits == 16) return;
+    for (int i = 0; i < frame_palette.count; i++) {
+        uint16_t rgb565 = lcd_rgb565(frame_palette.colours[i]);
+        palette_lut[i] = LCD_PIO_SCALE ? rgb565 : __builtin_bswap16(rgb565);
+    }
+#endif
+}
+#endif
 
-        uint8_t r = (pixel >> 0) & 0xf0;
-        uint8_t g = (pixel << 4) & 0xf0;
-        uint8_t b = (pixel >> 8) & 0xf0;
+#if !LCD_PIO_SCALE
+// Source pixel x of row y as an lcd_rgb_spread() value
+static inline uint32_t source_spread(const uint8_t *src_buffer, int y, int x) {
+#if LCD_INDEXED
+    if (frame_bits != 16) {
+        const uint8_t *row = &src_buffer[y * RENDER_WIDTH * frame_bits / 8];
+        return lcd_rgb_spread(frame_palette.colours[lcd_palette_at(row, x, frame_bits)]);
+    }
+#endif
+    return lcd_rgb_spread(((const uint16_t *)src_buffer)[y * RENDER_WIDTH + x]);
+}
 
-        uint16_t rgb565 = ((r & 0xF0) << 8) |
-                          ((g & 0xF0) << 3) |
-                          ((b & 0xF0) >> 3);
+// lcd_rgb_spread() values a and b blended by alpha / 16, on interp0 in blend
+// mode. Exact, see lcd_pixel.h.
+static inline uint32_t interp_blend(uint32_t a, uint32_t b, uint alpha) {
+    interp0->base[0] = a;
+    interp0->base[1] = b;
+    interp0->accum[1] = alpha << 4;
+    return interp0->peek[1];
+}
 
+static inline uint32_t blend_row_sample(lcd_scale_tap_t t) {
+    uint32_t v = blend_row[t.index];
+    return t.alpha ? interp_blend(v, blend_row[t.index + 1], t.alpha) : v;
+}
+
+// Filtered line: blend the two source rows into blend_row, unless the last
+// line used the same ones, then blend across it
+static void __not_in_flash_func(build_filtered_scanline)(uint8_t *dest, const uint8_t *src_buffer, int y) {
+    lcd_scale_tap_t ty = y_taps[y];
+    int key = ty.index << 8 | ty.alpha;
+    if (key != blend_row_tap) {
+        int y0 = ty.index;
+        if (ty.alpha) {
+            for (int x = 0; x < RENDER_WIDTH; x++)
+                blend_row[x] = interp_blend(source_spread(src_buffer, y0, x),
+                                            source_spread(src_buffer, y0 + 1, x), ty.alpha);
+        } else {
+            for (int x = 0; x < RENDER_WIDTH; x++)
+                blend_row[x] = source_spread(src_buffer, y0, x);
+        }
+        blend_row_tap = key;
+    }
+
+#if LCD_PIXEL_BITS == 16
+    for (int x = 0; x < LCD_IMAGE_WIDTH; x++) {
+        uint16_t rgb565 = lcd_spread_to_565(blend_row_sample(x_taps[x]));
         dest[x * 2 + 0] = rgb565 >> 8;
         dest[x * 2 + 1] = rgb565 & 0xFF;
     }
+#else
+    for (int x = 0; x < LCD_IMAGE_WIDTH; x += 2) {
+        lcd_pack_rgb444(dest, lcd_spread_to_fb(blend_row_sample(x_taps[x])),
+                        lcd_spread_to_fb(blend_row_sample(x_taps[x + 1])));
+        dest += 3;
+    }
+#endif
 }
 
-// Send frame buffer to LCD with scanline double-buffering
-void send_frame_to_lcd() {
+// Only runs when the mode changes, so it can stay in flash
+static void set_scale_mode(lcd_scale_t mode) {
+    if (mode != LCD_SCALE_NEAREST) {
+        lcd_scale_taps(x_taps, RENDER_WIDTH, LCD_IMAGE_WIDTH, mode);
+        lcd_scale_taps(y_taps, RENDER_HEIGHT, LCD_IMAGE_HEIGHT, mode);
+    }
+    scale_mode = mode;
+}
+#endif
+
+// Draw the overlay's row y over a built line: white text on black
+static void __not_in_flash_func(compose_osd)(uint8_t *dest, int y) {
+    const uint32_t *mask = osd_mask[y >> OSD_SHIFT];
+    for (int x = 0; x < OSD_WIDTH; x++) {
+        int m = x >> OSD_SHIFT;
+        bool on = mask[m >> 5] >> (m & 31) & 1;
+#if LCD_PIO_SCALE
+        ((uint16_t *)dest)[x] = (on ? lcd_rgb565(0xf0ff) : 0) | column_repeat[x];
+#elif LCD_PIXEL_BITS == 16
+        ((uint16_t *)dest)[x] = on ? __builtin_bswap16(lcd_rgb565(0xf0ff)) : 0;
+#else
+        // RGB444: pixel pairs share the middle byte
+        uint8_t v = on ? 0xff : 0;
+        uint8_t *pair = dest + x / 2 * 3;
+        if (x & 1) {
+            pair[1] = (pair[1] & 0xf0) | (v & 0x0f);
+            pair[2] = v;
+        } else {
+            pair[0] = v;
+            pair[1] = (pair[1] & 0x0f) | (v & 0xf0);
+        }
+#endif
+    }
+}
+
+static inline void build_line(uint8_t *dest, int y) {
+#if !LCD_PIO_SCALE
+    if (scale_mode != LCD_SCALE_NEAREST) {
+        build_filtered_scanline(dest, frame_buffer_copy, y);
+        return;
+    }
+#endif
+#if LCD_INDEXED
+    if (frame_bits != 16) {
+        build_indexed_scanline(dest, frame_buffer_copy, ((uint32_t)y * LCD_STEP_Y) >> 16);
+        return;
+    }
+#endif
+    build_scanline_from_buffer(dest, frame_buffer_copy, ((uint32_t)y * LCD_STEP_Y) >> 16);
+}
+
+void lcd_set_scale(lcd_scale_t mode) {
+#if LCD_PIO_SCALE
+    mode = LCD_SCALE_NEAREST;   // the PIO repeats whole pixels
+#endif
+    if (mode < LCD_SCALE_MODES)
+        scale_request = mode;
+}
+
+lcd_scale_t lcd_get_scale(void) {
+    return scale_request;
+}
+
+uint32_t lcd_build_time_us(void) {
+    return build_us;
+}
+
+uint32_t __not_in_flash_func(lcd_present_time_us)(void) {
+    return present_us;
+}
+
+// Send frame buffer to LCD with scanline double-buffering. Runs from RAM
+// so core0 missing in the XIP cache does not stall the scanline builder.
+void __core1_func(send_frame_to_lcd)() {
+    uint32_t began = time_us_32();
+
+#if !LCD_PIO_SCALE
+    if (scale_request != scale_mode)
+        set_scale_mode(scale_request);
+    blend_row_tap = -1;
+#endif
+#if LCD_INDEXED
+    load_palette();
+#endif
+
+    // Rows the overlay covers this frame, none while it is off
+    uint32_t start = time_us_32();
+    int osd_rows = osd_begin(build_us) ? OSD_HEIGHT : 0;
+    uint32_t overlay = time_us_32() - start;
 
     st7789_start_pixels(pio, sm);
 
-    interp_config cfg = interp_default_config();
-    interp_config_set_add_raw(&cfg, true);
-    interp_set_config(interp0, 0, &cfg);
+    if (scale_mode != LCD_SCALE_NEAREST) {
+        // Lane 1 gives base0 + (base1 - base0) * accum1[7:0] / 256, with
+        // base0 and base1 unsigned: lcd_rgb_spread() uses all 32 bits
+        interp_config cfg = interp_default_config();
+        interp_set_config(interp0, 1, &cfg);
+        interp_config_set_blend(&cfg, true);
+        interp_set_config(interp0, 0, &cfg);
+    }
 
     int current_buf = 0;
-    uint32_t src_y = 0;
-    build_scanline_from_buffer(scanline_buf[current_buf], frame_buffer_copy, src_y);
+    start = time_us_32();
+    build_line(scanline_buf[current_buf], 0);
+    uint32_t done = time_us_32();
+    uint32_t building = done - start;
+    if (osd_rows) {
+        compose_osd(scanline_buf[current_buf], 0);
+        overlay += time_us_32() - done;
+    }
 
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    for (int y = 0; y < LCD_IMAGE_HEIGHT; y++) {
         dma_channel_configure(
             dma_chan,
             &dma_cfg,
             &pio->txf[sm],
             scanline_buf[current_buf],
-            SCREEN_WIDTH * 2,
+            LCD_PIO_SCALE ? RENDER_WIDTH : LCD_WORD_DMA ? LINE_BYTES / 4 : LINE_BYTES,
             true
         );
 
         current_buf = 1 - current_buf;
 
-        if (y < SCREEN_HEIGHT - 1) {
-            src_y = ((y + 1) * SCALE_Y) >> FRAC_BITS;
-            build_scanline_from_buffer(scanline_buf[current_buf], frame_buffer_copy, src_y);
+        if (y < LCD_IMAGE_HEIGHT - 1) {
+            uint32_t t = time_us_32();
+            build_line(scanline_buf[current_buf], y + 1);
+            done = time_us_32();
+            building += done - t;
+            if (y + 1 < osd_rows) {
+                compose_osd(scanline_buf[current_buf], y + 1);
+                overlay += time_us_32() - done;
+            }
         }
 
         dma_channel_wait_for_finish_blocking(dma_chan);
     }
+    build_us = building;
+    if (osd_rows)
+        osd_end(overlay);
+    present_us = time_us_32() - began;
 }
\ No newline at end of file
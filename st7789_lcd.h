@@ -1,6 +1,20 @@
 #ifndef ST7789_LCD_H
 #define ST7789_LCD_H
 
+#include <stdint.h>
+#include "lcd_scale.h"
+
 void send_frame_to_lcd();
 
+// Scaling mode, applied from the next frame. Only nearest with
+// LCD_PIO_SCALE.
+void lcd_set_scale(lcd_scale_t mode);
+lcd_scale_t lcd_get_scale(void);
+
+// Time core1 spent building scanlines for the last frame
+uint32_t lcd_build_time_us(void);
+
+// Time core1 took to send the last frame, start to finish
+uint32_t lcd_present_time_us(void);
+
 #endif // ST7789_LCD_H
\ No newline at end of file
@@ -0,0 +1,181 @@
+/**
+ * SD card hot-plug state machine, see storage.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "storage.h"
+
+#include "hw_config.h"
+#include "f_util.h"
+#include "save.h"
+#include "capture.h"
+
+static struct {
+    storage_state_t state;
+    uint32_t since_ms;          // entered the current state
+    uint32_t next_probe_ms;
+    uint32_t cd_changes;        // card detect changes seen at mount time
+    uint32_t generation;
+    int game_count;
+} storage;
+
+bool storage_is_game(const FILINFO* fno) {
+    if (fno->fattrib & AM_DIR) return false;
+
+    // Check for .png extension (case insensitive)
+    size_t len = strlen(fno->fname);
+    if (len <= 4) return false;
+    const char* ext = &fno->fname[len - 4];
+    return (ext[0] == '.') &&
+           (ext[1] == 'p' || ext[1] == 'P') &&
+           (ext[2] == 'n' || ext[2] == 'N') &&
+           (ext[3] == 'g' || ext[3] == 'G');
+}
+
+// Count PNG files in root directory
+static int scan_games(void) {
+    DIR dir;
+    FILINFO fno;
+    int count = 0;
+
+    FRESULT fr = f_opendir(&dir, "/");
+    if (fr != FR_OK) return 0;
+
+    while (1) {
+        fr = f_readdir(&dir, &fno);
+        if (fr != FR_OK || fno.fname[0] == 0) break;
+        if (storage_is_game(&fno)) count++;
+    }
+
+    f_closedir(&dir);
+    return count;
+}
+
+// Cheap presence check: a GPIO read with a card detect pin, otherwise a
+// single command on the bus that fails fast when nothing answers. A card
+// in the middle of a multi-block write (capture, the save journal) does
+// not answer it and would be taken for gone, and closing the write would
+// split the stream and lose its pre-erase, so leave it be: a pulled card
+// then shows up as a failed write, through storage_io_error().
+static bool card_present(sd_card_t* sd_card_p) {
+    if (sd_card_p->use_card_detect) return sd_card_detect(sd_card_p);
+    if (sd_card_p->write_open(sd_card_p)) return true;
+    return sd_card_p->sd_test_com(sd_card_p);
+}
+
+// A card that stopped answering, or was pulled and put back between two
+// probes, has dropped back to uninitialized
+static bool card_lost(sd_card_t* sd_card_p) {
+    return !card_present(sd_card_p) || (sd_card_p->state.m_Status & STA_NOINIT);
+}
+
+static void enter(storage_state_t state, uint32_t now_ms) {
+    storage.state = state;
+    storage.since_ms = now_ms;
+}
+
+static void storage_mount(uint32_t now_ms) {
+    sd_card_t* sd_card_p = sd_get_by_num(0);
+
+    // The driver already reserves a FATFS object for each card
+    FRESULT fr = f_mount(&sd_card_p->state.fatfs, "", 1);
+    if (fr != FR_OK) {
+        printf("f_mount error: %s (%d)\n", FRESULT_str(fr), fr);
+        f_unmount("");
+        enter(STORAGE_NO_CARD, now_ms);
+        storage.next_probe_ms = now_ms + STORAGE_RETRY_MS;
+        return;
+    }
+
+    storage.cd_changes = sd_card_p->state.cd_changes;
+    storage.game_count = scan_games();
+    storage.generation++;
+    storage.next_probe_ms = now_ms + STORAGE_PROBE_MS;
+    enter(STORAGE_MOUNTED, now_ms);
+    printf("SD card mounted, found %d games\n", storage.game_count);
+}
+
+static void storage_unmount(uint32_t now_ms) {
+    sd_card_t* sd_card_p = sd_get_by_num(0);
+
+    // The card is gone; anything not yet committed cannot be written
+    save_discard();
+    capture_discard();
+    f_unmount("");
+
+    // Make the next mount initialize the card from scratch
+    sd_lock(sd_card_p);
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_unlock(sd_card_p);
+
+    storage.game_count = 0;
+    storage.generation++;
+    storage.next_probe_ms = now_ms + STORAGE_PROBE_MS;
+    enter(STORAGE_NO_CARD, now_ms);
+    printf("SD card removed\n");
+}
+
+void storage_init(uint32_t now_ms) {
+    sd_init_driver();
+    enter(STORAGE_NO_CARD, now_ms);
+    if (card_present(sd_get_by_num(0))) storage_mount(now_ms);
+}
+
+void storage_poll(uint32_t now_ms) {
+    sd_card_t* sd_card_p = sd_get_by_num(0);
+
+    switch (storage.state) {
+        case STORAGE_NO_CARD:
+            // With a card detect pin this is only a GPIO read, so do it every frame
+            if (!sd_card_p->use_card_detect && (int32_t)(now_ms - storage.next_probe_ms) < 0)
+                break;
+            storage.next_probe_ms = now_ms + STORAGE_PROBE_MS;
+            if (card_present(sd_card_p)) enter(STORAGE_SETTLING, now_ms);
+            break;
+
+        case STORAGE_SETTLING:
+            if (!card_present(sd_card_p)) {
+                enter(STORAGE_NO_CARD, now_ms);
+            } else if (now_ms - storage.since_ms >= STORAGE_SETTLE_MS) {
+                storage_mount(now_ms);
+            }
+            break;
+
+        case STORAGE_MOUNTED:
+            if (sd_card_p->use_card_detect) {
+                // A swap between two polls still changes cd_changes
+                if (!sd_card_detect(sd_card_p) || sd_card_p->state.cd_changes != storage.cd_changes)
+                    storage_unmount(now_ms);
+            } else if ((int32_t)(now_ms - storage.next_probe_ms) >= 0) {
+                storage.next_probe_ms = now_ms + STORAGE_PROBE_MS;
+                if (card_lost(sd_card_p)) storage_unmount(now_ms);
+            }
+            break;
+    }
+}
+
+storage_state_t storage_state(void) {
+    return storage.state;
+}
+
+bool storage_mounted(void) {
+    return storage.state == STORAGE_MOUNTED;
+}
+
+void storage_io_error(FRESULT fr, uint32_t now_ms) {
+    if (storage.state != STORAGE_MOUNTED) return;
+    if (fr != FR_DISK_ERR && fr != FR_NOT_READY) return;
+
+    // Probe right away, so that callers stop before piling up timeouts
+    // against an empty socket
+    if (card_lost(sd_get_by_num(0))) storage_unmount(now_ms);
+}
+
+int storage_game_count(void) {
+    return storage.game_count;
+}
+
+uint32_t storage_generation(void) {
+    return storage.generation;
+}
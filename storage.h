@@ -0,0 +1,38 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ff.h"
+
+// SD card hot-plug handling. storage_poll() runs a small state machine
+// from the frame loop: it notices insertion and removal without blocking,
+// mounts the card once it has settled, and keeps the game catalog in step.
+
+typedef enum {
+    STORAGE_NO_CARD,
+    STORAGE_SETTLING,       // card seen, waiting for contacts to settle
+    STORAGE_MOUNTED,
+} storage_state_t;
+
+#define STORAGE_SETTLE_MS   250     // delay between insertion and mounting
+#define STORAGE_PROBE_MS    500     // presence check interval without a card detect pin
+#define STORAGE_RETRY_MS    2000    // back-off after a failed mount
+
+// Mount the card if one is present; called once at boot
+void storage_init(uint32_t now_ms);
+void storage_poll(uint32_t now_ms);
+
+storage_state_t storage_state(void);
+bool storage_mounted(void);
+
+// Report a failed FatFs call. Errors that mean the card is gone unmount it.
+void storage_io_error(FRESULT fr, uint32_t now_ms);
+
+// Game catalog, rebuilt on every mount. The generation changes on every
+// mount and unmount, so callers can tell their view is stale.
+int storage_game_count(void);
+uint32_t storage_generation(void);
+bool storage_is_game(const FILINFO* fno);
+
+#endif // STORAGE_H
@@ -0,0 +1,252 @@
+/**
+ * Check the capture encoder of capture_codec.h and time it.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/capture_check [sample.tbc]
+ *
+ * Encodes sequences of frames the way capture_frame() does, into a queue
+ * the firmware's size at positions that wrap round it, from RGBA4444 and
+ * from 8 and 4 bit indexed frames. Decodes them again with a decoder of
+ * its own and checks every pixel, and checks that no frame takes more
+ * than CAPTURE_FRAME_WORDS, including the patterns the run length coding
+ * does worst on. Checks that a frame that does not fit returns 0 and that
+ * a key frame after it decodes. Then prints the benchmark: host time and
+ * bytes per frame for each kind of frame, and the card bandwidth that
+ * makes at 60 frames a second. Exits non-zero if any check fails.
+ *
+ * With a file name, also writes a capture of scrolling and sprite frames
+ * in the firmware's file format, for tools/capture_convert.py.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture_codec.h"
+
+#define WIDTH           128
+#define HEIGHT          128
+#define PIXELS          (WIDTH * HEIGHT)
+#define QUEUE_WORDS     (80 * 512 / 2)      // CAPTURE_QUEUE_BYTES
+#define FRAMES          120
+
+typedef enum { STATIC, SPRITES, SCROLL, NOISE, ALTERNATE, PAIRS, KINDS } kind_t;
+static const char *kind_names[KINDS] = {
+    "static", "sprites", "scrolling", "noise", "alternating", "pair runs",
+};
+
+static uint16_t display[PIXELS];            // tb_mem.display
+static uint8_t frame[PIXELS * 2];           // frame_buffer_copy
+static lcd_palette_t palette = { .bits = 16 };
+static lcd_palette_map_t map;
+static uint16_t prev[PIXELS];               // the encoder's
+static uint16_t decoded[PIXELS];            // the decoder's
+static uint16_t ring[QUEUE_WORDS];
+
+static uint32_t rng = 0x9e3779b9;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Frame n of a kind. Up to 16 colours except for noise.
+static void make_frame(kind_t kind, int n) {
+    static const uint16_t colours[16] = {
+        0x0f00, 0x1f11, 0x2f2f, 0x3ff3, 0x4f4a, 0x5f5c, 0x6f06, 0x7f77,
+        0x8f8e, 0x9fa9, 0xaf0b, 0xbfcb, 0xcf3c, 0xdf0d, 0xef7e, 0xffff,
+    };
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            uint16_t p;
+            switch (kind) {
+            case STATIC: p = colours[(x / 16 + y / 16) & 3]; break;
+            case SCROLL: p = colours[((x + n * 2) / 8 * 5 + y / 8 * 3) & 15]; break;
+            case NOISE: p = rand32(); break;
+            case ALTERNATE: p = colours[(x + y + n) & 1]; break;
+            // One odd pixel between runs of three: a token every few pixels
+            case PAIRS: p = (x & 3) ? colours[(n + y) & 15] : colours[(x / 4 + n + y) & 15]; break;
+            default: {
+                p = colours[(x / 16 + y / 16) & 3];
+                for (int s = 0; s < 8; s++) {
+                    int sx = (s * 37 + n * (s + 1)) % (WIDTH - 8), sy = (s * 53 + n * 2) % (HEIGHT - 8);
+                    if (x >= sx && x < sx + 8 && y >= sy && y < sy + 8) p = colours[8 + s];
+                }
+            }
+            }
+            display[y * WIDTH + x] = p;
+        }
+    }
+}
+
+// Copy the frame for core1 as render_frame_handler() does
+static void hand_over(bool indexed) {
+    if (!indexed || !lcd_palette_index(&palette, frame, display, PIXELS, &map)) {
+        memcpy(frame, display, sizeof(display));
+        palette.bits = 16;
+    }
+}
+
+static uint32_t encode_from(const uint8_t *src, const lcd_palette_t *pal, uint32_t pos, uint32_t space) {
+    if (pal->bits == 4) return capture_encode(ring, QUEUE_WORDS, pos, space, prev, src, pal, PIXELS, 4);
+    if (pal->bits == 8) return capture_encode(ring, QUEUE_WORDS, pos, space, prev, src, pal, PIXELS, 8);
+    return capture_encode(ring, QUEUE_WORDS, pos, space, prev, src, pal, PIXELS, 16);
+}
+
+static uint32_t encode(uint32_t pos, uint32_t space) {
+    return encode_from(frame, &palette, pos, space);
+}
+
+// Decode words words from pos against decoded, the way a reader does
+static bool decode(uint32_t pos, uint32_t words) {
+    int i = 0;
+    uint32_t end = pos + words;
+#define NEXT() ring[pos++ % QUEUE_WORDS]
+    while (pos < end) {
+        uint16_t token = NEXT();
+        if (!token) continue;
+        uint32_t count = token & CAPTURE_MAX_COUNT;
+        if (i + count > PIXELS || pos + (token & CAPTURE_RUN ? 1 : count) > end) return false;
+        if (token & CAPTURE_RUN) {
+            uint16_t v = NEXT();
+            while (count--) decoded[i++] ^= v;
+        } else {
+            while (count--) decoded[i++] ^= NEXT();
+        }
+    }
+#undef NEXT
+    return i == PIXELS;
+}
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *message) {
+    if (!ok) {
+        printf("%s: %s\n", what, message);
+        failures++;
+    }
+}
+
+static void check_kind(kind_t kind, bool indexed) {
+    char what[64];
+    snprintf(what, sizeof(what), "%s%s", kind_names[kind], indexed ? " indexed" : "");
+    // Start near the end of the queue so frames wrap round it
+    uint32_t pos = QUEUE_WORDS - 1000;
+    memset(prev, 0, sizeof(prev));
+    memset(decoded, 0, sizeof(decoded));
+
+    for (int n = 0; n < 8; n++) {
+        make_frame(kind, n);
+        hand_over(indexed);
+        uint32_t words = encode(pos, QUEUE_WORDS);
+        check(words && !(words & 1), what, "no frame, or an odd number of words");
+        check(words <= CAPTURE_FRAME_WORDS(PIXELS), what, "frame longer than CAPTURE_FRAME_WORDS");
+        check(decode(pos, words), what, "frame does not decode");
+        for (int i = 0; i < PIXELS; i++) {
+            if (decoded[i] != (display[i] & 0xf0ff) || prev[i] != decoded[i]) {
+                check(false, what, "decoded frame differs");
+                break;
+            }
+        }
+        pos = (pos + words) % QUEUE_WORDS;
+    }
+}
+
+// A frame that does not fit returns 0, and a key frame after it decodes
+static void check_full(void) {
+    memset(prev, 0, sizeof(prev));
+    make_frame(NOISE, 0);
+    hand_over(false);
+    check(!encode(0, 1000), "full queue", "frame returned although it did not fit");
+
+    memset(prev, 0, sizeof(prev));
+    memset(decoded, 0, sizeof(decoded));
+    make_frame(SPRITES, 1);
+    hand_over(false);
+    uint32_t words = encode(0, QUEUE_WORDS);
+    check(words && decode(0, words) && !memcmp(decoded, prev, sizeof(prev)), "full queue",
+          "key frame after it does not decode");
+}
+
+static double ns_since(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+static void time_kind(kind_t kind, bool indexed) {
+    static uint8_t frames[FRAMES][PIXELS * 2];
+    static lcd_palette_t palettes[FRAMES];
+    memset(prev, 0, sizeof(prev));
+    for (int n = 0; n < FRAMES; n++) {
+        make_frame(kind, n);
+        hand_over(indexed);
+        memcpy(frames[n], frame, sizeof(frame));
+        palettes[n] = palette;
+    }
+
+    uint64_t words = 0;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int n = 0; n < FRAMES; n++)
+        words += encode_from(frames[n], &palettes[n], 0, QUEUE_WORDS);
+    double ns = ns_since(&t0) / FRAMES;
+    // The key frame included, as in a capture this long
+    double bytes = (double)(words * 2) / FRAMES + sizeof(capture_record_t);
+    printf("%-12s %-8s %2d bit  %8.0f  %8.0f  %9.0f\n", kind_names[kind], indexed ? "indexed" : "direct",
+           palettes[FRAMES - 1].bits, ns, bytes, bytes * 60 / 1024);
+}
+
+// The scrolling frames as a capture file
+static bool write_sample(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    memset(prev, 0, sizeof(prev));
+    uint32_t seq = 0;
+    for (int n = 0; n <= FRAMES; n++) {
+        uint32_t words = 0;
+        if (n < FRAMES) {
+            make_frame(n < FRAMES / 2 ? SCROLL : SPRITES, n);
+            hand_over(n & 1);
+            words = encode(0, QUEUE_WORDS);
+        }
+        capture_record_t record = {
+            .magic = CAPTURE_MAGIC, .session = 0x5eed, .seq = seq++, .time_us = n * 16667,
+            .width = WIDTH, .height = HEIGHT, .flags = n == 0 ? CAPTURE_KEY : n == FRAMES ? CAPTURE_END : 0,
+            .words = words,
+        };
+        fwrite(&record, sizeof(record), 1, f);
+        fwrite(ring, 2, words, f);
+    }
+    // Stale data after the end, as in a file that was not shrunk
+    for (int i = 0; i < 512; i++) fputc(rand32(), f);
+    return fclose(f) == 0;
+}
+
+int main(int argc, char **argv) {
+    for (int kind = 0; kind < KINDS; kind++) {
+        check_kind(kind, false);
+        if (kind != NOISE) check_kind(kind, true);
+    }
+    check_full();
+    if (failures) return 1;
+    printf("captured frames decode to the frames sent\n\n");
+
+    printf("frame        handed   format    ns/frame  bytes/frame  KB/s at 60 fps  (host)\n");
+    for (int kind = 0; kind < KINDS; kind++) {
+        time_kind(kind, false);
+        if (kind != NOISE) time_kind(kind, true);
+    }
+
+    if (argc > 1) {
+        if (!write_sample(argv[1])) {
+            printf("could not write %s\n", argv[1]);
+            return 1;
+        }
+        printf("\nwrote %s\n", argv[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""
+Turn a capture from the SD card (/captures/*.tbc, see capture.h) into PNG
+or GIF.
+
+Usage: capture_convert.py [--scale N] [--first N] [--count N] capture output
+
+The output's extension picks the format:
+  .png  one PNG per frame, output with the frame number added; a capture
+        of one frame, a screenshot, goes to output as it is
+  .gif  one animated GIF, each frame shown for as long as it was on the
+        unit
+
+--scale repeats each pixel N times across and down. --first and --count
+pick frames out of a long capture.
+
+The file format is in capture_codec.h. Reading stops at the end record,
+or at the first record that does not follow on, which is where a capture
+that never got its end record stops.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = 0x50434254
+KEY = 0x0001
+END = 0x0002
+RUN = 0x8000
+RECORD = struct.Struct("<IIIIHHHHI")
+
+
+def read_frames(data):
+    """Yield (time_us, width, height, pixels) for each frame"""
+    pos = 0
+    session = None
+    seq = 0
+    pixels = None
+    while pos + RECORD.size <= len(data):
+        magic, sess, s, time_us, width, height, flags, _, words = RECORD.unpack_from(data, pos)
+        if magic != MAGIC or s != seq or (session is not None and sess != session):
+            break
+        session = sess
+        pos += RECORD.size
+        if flags & END:
+            return
+        if pos + words * 2 > len(data):
+            break
+        payload = struct.unpack_from("<%dH" % words, data, pos)
+        pos += words * 2
+
+        count = width * height
+        if flags & KEY or pixels is None or len(pixels) != count:
+            pixels = [0] * count
+        i = 0
+        w = 0
+        while w < words:
+            token = payload[w]
+            w += 1
+            n = token & 0x7FFF
+            if token & RUN:
+                v = payload[w]
+                w += 1
+                if v:
+                    for k in range(i, i + n):
+                        pixels[k] ^= v
+            else:
+                for k in range(n):
+                    pixels[i + k] ^= payload[w + k]
+                w += n
+            i += n
+        if i != count:
+            print("frame %d is damaged, stopping there" % seq, file=sys.stderr)
+            return
+        yield time_us, width, height, list(pixels)
+        seq += 1
+    print("no end record: the capture was cut short", file=sys.stderr)
+
+
+def rgb(pixel):
+    """0xBARG with 4 bits each to 8 bit R, G, B"""
+    return ((pixel >> 4) & 0xF) * 17, (pixel & 0xF) * 17, (pixel >> 12) * 17
+
+
+def scaled_rows(width, height, pixels, scale, convert):
+    for y in range(height):
+        row = []
+        for p in pixels[y * width:(y + 1) * width]:
+            row.extend([convert(p)] * scale)
+        for _ in range(scale):
+            yield row
+
+
+def write_png(path, width, height, pixels, scale):
+    raw = bytearray()
+    for row in scaled_rows(width, height, pixels, scale, rgb):
+        raw.append(0)
+        for r, g, b in row:
+            raw += bytes((r, g, b))
+
+    def chunk(kind, body):
+        return struct.pack(">I", len(body)) + kind + body + struct.pack(">I", zlib.crc32(kind + body))
+
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width * scale, height * scale, 8, 2, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(bytes(raw), 9)))
+        f.write(chunk(b"IEND", b""))
+
+
+def lzw(indices, min_size=8):
+    """GIF LZW with variable code sizes, as data sub-blocks"""
+    clear = 1 << min_size
+    out = bytearray()
+    bits = 0
+    nbits = 0
+
+    def emit(code, size):
+        nonlocal bits, nbits
+        bits |= code << nbits
+        nbits += size
+        while nbits >= 8:
+            out.append(bits & 0xFF)
+            bits >>= 8
+            nbits -= 8
+
+    size = min_size + 1
+    table = {}
+    next_code = clear + 2
+    emit(clear, size)
+    prefix = indices[0]
+    for k in indices[1:]:
+        code = table.get((prefix, k))
+        if code is not None:
+            prefix = code
+            continue
+        emit(prefix, size)
+        if next_code == 4096:
+            emit(clear, size)
+            table = {}
+            next_code = clear + 2
+            size = min_size + 1
+        else:
+            table[(prefix, k)] = next_code
+            if next_code == 1 << size:
+                size += 1
+            next_code += 1
+        prefix = k
+    emit(prefix, size)
+    emit(clear + 1, size)
+    if nbits:
+        out.append(bits & 0xFF)
+
+    blocks = bytearray([min_size])
+    for i in range(0, len(out), 255):
+        block = out[i:i + 255]
+        blocks.append(len(block))
+        blocks += block
+    blocks.append(0)
+    return bytes(blocks)
+
+
+def gif_palette(pixels):
+    """Up to 256 colours for a frame: its own if it has that few, else RGB 3-3-2"""
+    colours = sorted(set(pixels))
+    if len(colours) <= 256:
+        index = {c: i for i, c in enumerate(colours)}
+        table = [rgb(c) for c in colours]
+        return table, lambda p: index[p]
+
+    def reduce(p):
+        r, g, b = (p >> 4) & 0xF, p & 0xF, p >> 12
+        return (r >> 1) << 5 | (g >> 1) << 2 | b >> 2
+
+    table = [((i >> 5) * 255 // 7, (i >> 2 & 7) * 255 // 7, (i & 3) * 255 // 3) for i in range(256)]
+    return table, reduce
+
+
+def write_gif(path, frames, scale):
+    _, width, height, _ = frames[0]
+    with open(path, "wb") as f:
+        f.write(b"GIF89a" + struct.pack("<HHBBB", width * scale, height * scale, 0, 0, 0))
+        # Loop forever
+        f.write(b"\x21\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00")
+
+        shown_cs = 0
+        for n, (time_us, _, _, pixels) in enumerate(frames):
+            # Until the next frame, in whole hundredths, rounding errors carried over
+            end_us = frames[n + 1][0] if n + 1 < len(frames) else time_us + 16667
+            end_cs = (end_us - frames[0][0] + 5000) // 10000
+            delay = max(end_cs - shown_cs, 1)
+            shown_cs += delay
+
+            table, to_index = gif_palette(pixels)
+            indices = []
+            for row in scaled_rows(width, height, pixels, scale, to_index):
+                indices.extend(row)
+            f.write(struct.pack("<BBBBHBB", 0x21, 0xF9, 4, 0, delay, 0, 0))
+            f.write(struct.pack("<BHHHHB", 0x2C, 0, 0, width * scale, height * scale, 0x87))
+            for i in range(256):
+                f.write(bytes(table[i] if i < len(table) else (0, 0, 0)))
+            f.write(lzw(indices))
+        f.write(b"\x3b")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a TinyBit capture to PNG or GIF")
+    parser.add_argument("capture")
+    parser.add_argument("output")
+    parser.add_argument("--scale", type=int, default=1)
+    parser.add_argument("--first", type=int, default=0)
+    parser.add_argument("--count", type=int, default=None)
+    args = parser.parse_args()
+
+    with open(args.capture, "rb") as f:
+        data = f.read()
+    frames = []
+    for n, frame in enumerate(read_frames(data)):
+        if n < args.first:
+            continue
+        if args.count is not None and len(frames) == args.count:
+            break
+        frames.append(frame)
+    if not frames:
+        sys.exit("%s: no frames" % args.capture)
+
+    ext = os.path.splitext(args.output)[1].lower()
+    if ext == ".gif":
+        write_gif(args.output, frames, args.scale)
+        seconds = (frames[-1][0] - frames[0][0]) / 1e6
+        print("%s: %d frames, %.1f s" % (args.output, len(frames), seconds))
+    elif ext == ".png":
+        if len(frames) == 1:
+            write_png(args.output, frames[0][1], frames[0][2], frames[0][3], args.scale)
+            print(args.output)
+        else:
+            stem = os.path.splitext(args.output)[0]
+            for n, (_, width, height, pixels) in enumerate(frames):
+                write_png("%s_%04d.png" % (stem, args.first + n), width, height, pixels, args.scale)
+            print("%s_%04d.png ... %s_%04d.png" % (stem, args.first, stem, args.first + len(frames) - 1))
+    else:
+        sys.exit("%s: the output has to be .png or .gif" % args.output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,202 @@
+/**
+ * Time seeks in a fragmented file with and without a fast seek link map
+ * (f_fastseek.h), on a disk image with the SPI timing preset.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/fastseek_bench
+ *
+ * Writes two 4 MB files in alternating 256 KB pieces on a FAT32 image
+ * with 4 KB clusters, so each is in 16 fragments. Then, opened with
+ * f_open() and with f_open_fastseek(), does 1000 random seeks each
+ * followed by a 1 byte read, and opens and reads the whole file in 256
+ * byte chunks as the cartridge loader does. Prints the card commands and modelled
+ * time of each, and checks every byte read.
+ *
+ * Also checks the link map pool: a file beyond FF_FASTSEEK_POOL_SLOTS
+ * stays in normal mode, and threads opening and closing files at the same
+ * time never get the same table. Exits non-zero if any check fails.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "f_fastseek.h"
+#include "sd_host.h"
+
+#define IMAGE       "fastseek_bench.img"
+#define FILE_BYTES  (4 << 20)
+#define PIECE       (256 << 10)
+#define SEEKS       1000
+#define THREADS     FF_FASTSEEK_POOL_SLOTS
+#define ROUNDS      200
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *message) {
+    if (!ok) {
+        printf("%s: %s\n", what, message);
+        failures++;
+    }
+}
+
+static uint8_t pattern(uint32_t i, uint32_t seed) {
+    return (uint8_t)((i * 2654435761u + seed * 40503u) >> 11);
+}
+
+static uint32_t rng = 0x1d872b41;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static uint8_t buf[PIECE];
+
+// Two files written a piece of each at a time, so their clusters alternate
+static bool write_fragmented(void) {
+    FIL f[2];
+    UINT bw;
+    if (f_open(&f[0], "a.bin", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK ||
+        f_open(&f[1], "b.bin", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        return false;
+    for (uint32_t at = 0; at < FILE_BYTES; at += PIECE) {
+        for (int k = 0; k < 2; k++) {
+            for (uint32_t i = 0; i < PIECE; i++) buf[i] = pattern(at + i, k);
+            if (f_write(&f[k], buf, PIECE, &bw) != FR_OK || bw != PIECE) return false;
+            // Allocate now, not when the file is closed
+            if (f_sync(&f[k]) != FR_OK) return false;
+        }
+    }
+    return f_close(&f[0]) == FR_OK && f_close(&f[1]) == FR_OK;
+}
+
+typedef struct {
+    double cmds_per_seek, us_per_seek;
+    uint32_t load_cmds;
+    double load_ms;
+} result_t;
+
+static void run(const char *what, bool fast, result_t *r) {
+    FIL f;
+    UINT br;
+    // The open, building the link map, counts towards the load
+    sd_host_if.timing = SD_IMAGE_TIMING_SPI;
+    sd_image_reset_stats(&sd_host_card);
+    FRESULT fr = fast ? f_open_fastseek(&f, "a.bin", FA_READ) : f_open(&f, "a.bin", FA_READ);
+    check(fr == FR_OK, what, "cannot open the file");
+    check(f_is_fastseek(&f) == fast, what, fast ? "no link map" : "link map in normal mode");
+    for (uint32_t at = 0; at < FILE_BYTES; at += br) {
+        if (f_read(&f, buf, 256, &br) != FR_OK || br == 0) break;
+        for (uint32_t i = 0; i < br; i++)
+            if (buf[i] != pattern(at + i, 0)) {
+                check(false, what, "sequential read gave the wrong data");
+                at = FILE_BYTES;
+                break;
+            }
+    }
+    sd_image_stats_t s = sd_image_stats(&sd_host_card);
+    r->load_cmds = s.read_cmds;
+    r->load_ms = s.simulated_us / 1000.0;
+
+    rng = 0x1d872b41;
+    sd_image_reset_stats(&sd_host_card);
+    for (int n = 0; n < SEEKS; n++) {
+        uint32_t at = rand32() % FILE_BYTES;
+        uint8_t b = 0;
+        if (f_lseek(&f, at) != FR_OK || f_read(&f, &b, 1, &br) != FR_OK || br != 1 || b != pattern(at, 0)) {
+            check(false, what, "seek and read gave the wrong byte");
+            break;
+        }
+    }
+    s = sd_image_stats(&sd_host_card);
+    r->cmds_per_seek = (double)s.read_cmds / SEEKS;
+    r->us_per_seek = (double)s.simulated_us / SEEKS;
+
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+    check((fast ? f_close_fastseek(&f) : f_close(&f)) == FR_OK, what, "cannot close the file");
+}
+
+static void check_pool(void) {
+    const char *what = "pool";
+    FIL f[FF_FASTSEEK_POOL_SLOTS + 1];
+    for (int k = 0; k <= FF_FASTSEEK_POOL_SLOTS; k++) {
+        check(f_open_fastseek(&f[k], k & 1 ? "b.bin" : "a.bin", FA_READ) == FR_OK, what, "cannot open");
+        check(f_is_fastseek(&f[k]) == (k < FF_FASTSEEK_POOL_SLOTS), what,
+              k < FF_FASTSEEK_POOL_SLOTS ? "no link map with slots free" : "link map beyond the pool");
+    }
+    f_close_fastseek(&f[0]);
+    FIL again;
+    check(f_open_fastseek(&again, "a.bin", FA_READ) == FR_OK && f_is_fastseek(&again), what,
+          "closed file's slot not given out again");
+    f_close_fastseek(&again);
+    for (int k = 1; k <= FF_FASTSEEK_POOL_SLOTS; k++) f_close_fastseek(&f[k]);
+}
+
+// Tables held by the threads, to catch two holding the same one
+static pthread_mutex_t held_lock = PTHREAD_MUTEX_INITIALIZER;
+static DWORD *held[THREADS];
+static int shared_tables;
+
+static void *pool_thread(void *arg) {
+    int id = (int)(intptr_t)arg;
+    for (int n = 0; n < ROUNDS; n++) {
+        FIL f;
+        UINT br;
+        if (f_open_fastseek(&f, id & 1 ? "b.bin" : "a.bin", FA_READ) != FR_OK) continue;
+        pthread_mutex_lock(&held_lock);
+        for (int k = 0; k < THREADS; k++)
+            if (f.cltbl && held[k] == f.cltbl) shared_tables++;
+        held[id] = f.cltbl;
+        pthread_mutex_unlock(&held_lock);
+
+        uint32_t at = (uint32_t)(n * 2654435761u) % FILE_BYTES;
+        uint8_t b = 0;
+        if (f_lseek(&f, at) != FR_OK || f_read(&f, &b, 1, &br) != FR_OK || b != pattern(at, id & 1)) {
+            pthread_mutex_lock(&held_lock);
+            shared_tables++;
+            pthread_mutex_unlock(&held_lock);
+        }
+
+        pthread_mutex_lock(&held_lock);
+        held[id] = NULL;
+        pthread_mutex_unlock(&held_lock);
+        f_close_fastseek(&f);
+    }
+    return NULL;
+}
+
+static void check_threads(void) {
+    pthread_t threads[THREADS];
+    for (int k = 0; k < THREADS; k++) pthread_create(&threads[k], NULL, pool_thread, (void *)(intptr_t)k);
+    for (int k = 0; k < THREADS; k++) pthread_join(threads[k], NULL);
+    check(!shared_tables, "threads", "two files got the same link map, or read the wrong data");
+}
+
+int main(void) {
+    if (!sd_host_format(IMAGE, 512, FM_FAT32, 4096)) return 1;
+    check(write_fragmented(), "setup", "cannot write the files");
+    // Nothing of the files left in FatFs's buffers
+    sd_host_unmount();
+    check(sd_host_mount(), "setup", "cannot mount again");
+
+    result_t normal, fast;
+    run("normal", false, &normal);
+    run("fast seek", true, &fast);
+    check_pool();
+    check_threads();
+
+    printf("4 MB file in %d fragments, FAT32, 4 KB clusters, SPI timing (modelled)\n", FILE_BYTES / PIECE);
+    printf("            seek + 1 byte read      open and read, 256 B chunks\n");
+    printf("            reads     ms            reads     ms\n");
+    printf("normal      %5.1f  %6.2f            %5lu  %6.1f\n", normal.cmds_per_seek,
+           normal.us_per_seek / 1000, (unsigned long)normal.load_cmds, normal.load_ms);
+    printf("fast seek   %5.1f  %6.2f            %5lu  %6.1f\n", fast.cmds_per_seek,
+           fast.us_per_seek / 1000, (unsigned long)fast.load_cmds, fast.load_ms);
+
+    sd_host_unmount();
+    remove(IMAGE);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * Run FatFs from several threads at once on a disk image, as both cores
+ * do on the device, and report the lock counters of ffsystem.c.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/ffmutex_stress
+ *
+ * Each thread works in its own directory: it creates a file, writes it in
+ * odd sized pieces, reads it back and checks every byte, and now and then
+ * lists the root directory, all through the same volume. Checks that no
+ * FatFs call fails and no data differs, and that the volume mutex saw
+ * every take. Then prints takes, contended takes and timeouts per mutex
+ * (ff_mutex_get_stats()). Exits non-zero if any check fails.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "sd_host.h"
+
+#define IMAGE       "ffmutex_stress.img"
+#define THREADS     4
+#define ROUNDS      200
+#define FILE_BYTES  12000
+
+static uint8_t pattern(uint32_t i, uint32_t seed) {
+    return (uint8_t)((i * 2654435761u + seed * 40503u) >> 11);
+}
+
+typedef struct {
+    int id;
+    int errors;
+    int mismatches;
+} worker_t;
+
+static bool fail(worker_t *w, const char *call, FRESULT fr) {
+    if (fr == FR_OK) return false;
+    if (w->errors++ < 5) printf("thread %d: %s: %s (%d)\n", w->id, call, FRESULT_str(fr), fr);
+    return true;
+}
+
+static void round_trip(worker_t *w, int round) {
+    static const UINT pieces[] = { 1, 37, 512, 700, 4096 };
+    uint8_t buf[4096];
+    char path[32];
+    FIL f;
+    UINT n;
+    uint32_t seed = w->id * ROUNDS + round;
+    snprintf(path, sizeof(path), "t%d/f%d.bin", w->id, round % 8);
+
+    if (fail(w, "f_open", f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS))) return;
+    for (uint32_t at = 0, k = round; at < FILE_BYTES; at += n, k++) {
+        UINT len = pieces[k % 5];
+        if (len > FILE_BYTES - at) len = FILE_BYTES - at;
+        for (UINT i = 0; i < len; i++) buf[i] = pattern(at + i, seed);
+        if (fail(w, "f_write", f_write(&f, buf, len, &n)) || n != len) break;
+    }
+    if (fail(w, "f_close", f_close(&f))) return;
+
+    if (fail(w, "f_open", f_open(&f, path, FA_READ))) return;
+    for (uint32_t at = 0; at < FILE_BYTES; at += n) {
+        if (fail(w, "f_read", f_read(&f, buf, sizeof(buf), &n)) || !n) break;
+        for (UINT i = 0; i < n; i++)
+            if (buf[i] != pattern(at + i, seed)) {
+                w->mismatches++;
+                break;
+            }
+    }
+    fail(w, "f_close", f_close(&f));
+}
+
+static void scan_root(worker_t *w) {
+    DIR dir;
+    FILINFO fno;
+    if (fail(w, "f_opendir", f_opendir(&dir, "/"))) return;
+    while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0]) continue;
+    fail(w, "f_closedir", f_closedir(&dir));
+}
+
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    char path[8];
+    snprintf(path, sizeof(path), "t%d", w->id);
+    FRESULT fr = f_mkdir(path);
+    if (fr != FR_EXIST) fail(w, "f_mkdir", fr);
+    for (int round = 0; round < ROUNDS; round++) {
+        round_trip(w, round);
+        if (round % 10 == w->id) scan_root(w);
+    }
+    return NULL;
+}
+
+int main(void) {
+    if (!sd_host_format(IMAGE, 64, FM_EXFAT, 4096)) return 1;
+    for (int vol = 0; vol <= FF_VOLUMES; vol++) ff_mutex_reset_stats(vol);
+
+    pthread_t threads[THREADS];
+    worker_t workers[THREADS];
+    for (int k = 0; k < THREADS; k++) {
+        workers[k] = (worker_t){ .id = k };
+        pthread_create(&threads[k], NULL, worker, &workers[k]);
+    }
+    int errors = 0, mismatches = 0;
+    for (int k = 0; k < THREADS; k++) {
+        pthread_join(threads[k], NULL);
+        errors += workers[k].errors;
+        mismatches += workers[k].mismatches;
+    }
+
+    ff_mutex_stats_t s;
+    ff_mutex_get_stats(0, &s);
+    printf("%d threads x %d rounds: %d errors, %d files read back wrong\n", THREADS, ROUNDS, errors, mismatches);
+    for (int vol = 0; vol <= FF_VOLUMES; vol++) {
+        ff_mutex_stats_t v;
+        ff_mutex_get_stats(vol, &v);
+        printf("%s mutex %d: takes %lu, contended %lu, timeouts %lu\n", vol < FF_VOLUMES ? "volume" : "system",
+               vol, (unsigned long)v.takes, (unsigned long)v.contended, (unsigned long)v.timeouts);
+    }
+
+    sd_host_unmount();
+    remove(IMAGE);
+    return errors || mismatches || !s.takes || s.timeouts ? 1 : 0;
+}
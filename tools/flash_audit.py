@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+List the functions the frame loop and the interrupt handlers can reach
+that still execute from flash.
+
+Code in flash runs through the XIP cache; a miss stalls the core for a
+QSPI transfer, and if the other core is the one missing it can stall
+both. Everything on the per-frame path should be in RAM
+(__not_in_flash_func), so this walks the direct call graph from the
+roots below and reports what it finds at flash addresses.
+
+Usage: flash_audit.py <objdump> <elf> [output]
+
+Indirect calls (blx rN) cannot be followed; callers that make them are
+listed so they can be checked by hand. Functions in the SDK and libc
+(memcpy, time_us_64, ...) show up too; whether they matter depends on
+how often they run.
+"""
+
+import re
+import subprocess
+import sys
+
+# Entry points of the per-frame work on both cores
+ROOTS = [
+    "core1_loop",
+    "send_frame_to_lcd",
+    "render_frame_handler",
+    "audio_queue_handler",
+    "tinybit_poll_input",
+    "to_ms",
+    "perf_frame",
+]
+# Anything installed as an interrupt handler
+IRQ_ROOT = re.compile(r"irq_handler|^isr_")
+
+FLASH_START = 0x10000000
+FLASH_END = 0x12000000
+
+FUNC = re.compile(r"^([0-9a-f]+) <([^>]+)>:$")
+CALL = re.compile(r"\s(?:bl|blx|b\.w|b)\s+[0-9a-f]+ <([^>+]+)>")
+INDIRECT = re.compile(r"\sblx\s+r\d+")
+
+
+def code_sections(objdump, elf):
+    # .time_critical code is linked into .data and core1's code into
+    # .scratch_x, which objdump -d skips
+    out = subprocess.run([objdump, "-h", elf], capture_output=True, text=True, check=True).stdout
+    names = []
+    lines = out.splitlines()
+    for i, line in enumerate(lines):
+        fields = line.split()
+        if len(fields) >= 7 and fields[0].isdigit() and i + 1 < len(lines):
+            if "CODE" in lines[i + 1] or fields[1] in (".data", ".scratch_x", ".scratch_y"):
+                names.append(fields[1])
+    return names
+
+
+def parse(objdump, elf):
+    args = [objdump, "-D", "--no-show-raw-insn"]
+    for s in code_sections(objdump, elf):
+        args += ["-j", s]
+    out = subprocess.run(args + [elf], capture_output=True, text=True, check=True).stdout
+
+    addr, calls, indirect = {}, {}, set()
+    cur = None
+    for line in out.splitlines():
+        m = FUNC.match(line)
+        if m:
+            cur = m.group(2)
+            addr.setdefault(cur, int(m.group(1), 16))
+            calls.setdefault(cur, set())
+            continue
+        if cur is None:
+            continue
+        m = CALL.search(line)
+        if m and m.group(1) != cur:
+            calls[cur].add(m.group(1))
+        elif INDIRECT.search(line):
+            indirect.add(cur)
+    return addr, calls, indirect
+
+
+def target(name):
+    # Long branches from RAM to flash go through linker veneers
+    m = re.match(r"^__(.+)_veneer$", name)
+    return m.group(1) if m else name
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    addr, calls, indirect = parse(sys.argv[1], sys.argv[2])
+
+    roots = [r for r in ROOTS if r in addr]
+    roots += sorted(f for f in addr if IRQ_ROOT.search(f) and f not in roots)
+
+    # Breadth first, remembering who first reached each function
+    via = {r: None for r in roots}
+    queue = list(roots)
+    while queue:
+        f = queue.pop(0)
+        for c in sorted(calls.get(f, ())):
+            c = target(c)
+            if c not in via:
+                via[c] = f
+                queue.append(c)
+
+    def in_flash(f):
+        return f in addr and FLASH_START <= addr[f] < FLASH_END
+
+    def path(f):
+        p = []
+        while f is not None:
+            p.append(f)
+            f = via[f]
+        return " <- ".join(p)
+
+    lines = ["Flash audit of " + sys.argv[2],
+             "Roots: " + ", ".join(roots),
+             "Missing roots: " + (", ".join(r for r in ROOTS if r not in addr) or "none"),
+             ""]
+    flash = sorted((f for f in via if in_flash(f)), key=lambda f: addr[f])
+    lines.append("%d of %d reachable functions run from flash:" % (len(flash), len(via)))
+    for f in flash:
+        lines.append("  %08x %s" % (addr[f], path(f)))
+    lines.append("")
+    ind = sorted(f for f in via if f in indirect)
+    lines.append("%d reachable functions make indirect calls:" % len(ind))
+    for f in ind:
+        lines.append("  %08x %s%s" % (addr[f], f, " (flash)" if in_flash(f) else ""))
+
+    text = "\n".join(lines) + "\n"
+    if len(sys.argv) > 3:
+        with open(sys.argv[3], "w") as fp:
+            fp.write(text)
+        print("Flash audit: %d reachable functions in flash, see %s" % (len(flash), sys.argv[3]))
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+"""
+Generate lcd_geometry.h: where the 128x128 TinyBit screen goes on an
+ST7789 panel, and nearest neighbour row kernels unrolled for that size.
+
+Usage: gen_lcd_geometry.py --panel WxH [--rotation 0|90|180|270]
+                           [--fit fit|integer|stretch] [--offset X,Y] output
+
+--panel is the panel's native, portrait size, e.g. 240x240, 240x320,
+135x240 or 240x280. The ST7789 drives a 240x320 RAM and smaller panels
+sit somewhere inside it; --offset gives the panel's top left corner in
+that RAM at rotation 0, and is known for the panels in PANELS.
+
+--fit picks the image size:
+  fit      largest square that fits, rounded down to an even size
+  integer  largest whole multiple of 128 that fits (pixel perfect)
+  stretch  the whole panel, with different scales across and down
+The image is centred; the rest of the panel stays black.
+
+The column and row maps step through the source the same way the
+interpolator loop they replace did, in 16.16 fixed point, so a 240x240
+panel shows exactly what it did before. The row kernels convert each
+source pixel once and store it as many times as the map repeats it,
+with the column map folded into the code. Each comes in three kinds:
+straight from the framebuffer, and through a palette from the 8 and 4 bit
+indexed frames of lcd_palette.h.
+"""
+
+import argparse
+import sys
+
+SOURCE = 128                    # TinyBit screen, both ways
+RAM_WIDTH, RAM_HEIGHT = 240, 320
+FRAC_BITS = 16
+
+# Native size -> top left corner in the controller RAM at rotation 0
+PANELS = {
+    (240, 240): (0, 0),
+    (240, 320): (0, 0),
+    (240, 280): (0, 20),
+    (135, 240): (52, 40),
+    (170, 320): (35, 0),
+    (172, 320): (34, 0),
+}
+
+# MADCTL (MY MX MV) per rotation, clockwise
+MADCTL = {0: 0x00, 90: 0x60, 180: 0xC0, 270: 0xA0}
+
+
+def fail(msg):
+    sys.exit("gen_lcd_geometry.py: " + msg)
+
+
+def geometry(panel, rotation, fit, offset):
+    w, h = panel
+    if w > RAM_WIDTH or h > RAM_HEIGHT:
+        fail("panel %dx%d is larger than the controller RAM; give the portrait size" % (w, h))
+    if offset is None:
+        if panel not in PANELS:
+            fail("unknown panel %dx%d, give its RAM offset with --offset X,Y" % (w, h))
+        offset = PANELS[panel]
+    cx, ry = offset
+    # The same corner seen from the other sides of the RAM
+    cx2, ry2 = RAM_WIDTH - w - cx, RAM_HEIGHT - h - ry
+
+    g = {"rotation": rotation, "madctl": MADCTL[rotation]}
+    if rotation in (0, 180):
+        g["screen_w"], g["screen_h"] = w, h
+    else:
+        g["screen_w"], g["screen_h"] = h, w
+    g["col_start"], g["row_start"] = {
+        0: (cx, ry), 90: (ry, cx2), 180: (cx2, ry2), 270: (ry2, cx)}[rotation]
+    # Partial area in RAM lines; the MY flip counts them from the bottom
+    ptl = ry if rotation in (0, 90) else ry2
+    g["ptlar"] = (ptl, ptl + h - 1)
+
+    sw, sh = g["screen_w"], g["screen_h"]
+    if min(sw, sh) < SOURCE:
+        fail("panel %dx%d is smaller than the %dx%d screen" % (w, h, SOURCE, SOURCE))
+    if fit == "fit":
+        iw = ih = min(sw, sh) & ~1
+    elif fit == "integer":
+        iw = ih = min(sw, sh) // SOURCE * SOURCE
+    else:
+        iw, ih = sw, sh
+    g["image_w"], g["image_h"] = iw, ih
+    g["image_x"], g["image_y"] = (sw - iw) // 2, (sh - ih) // 2
+    g["step_x"] = (SOURCE << FRAC_BITS) // iw
+    g["step_y"] = (SOURCE << FRAC_BITS) // ih
+    g["col_map"] = [(x * g["step_x"]) >> FRAC_BITS for x in range(iw)]
+    g["row_map"] = [(y * g["step_y"]) >> FRAC_BITS for y in range(ih)]
+    for name, m in (("column", g["col_map"]), ("row", g["row_map"])):
+        if sorted(set(m)) != list(range(SOURCE)):
+            fail("%s map does not cover the source exactly" % name)
+    return g
+
+
+def c_list(values, per_line=16):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+    return "{ \\\n" + " \\\n".join(lines) + " \\\n}"
+
+
+def runs(col_map):
+    """(source column, first output column, count) for each run"""
+    out = []
+    for x, s in enumerate(col_map):
+        if out and out[-1][0] == s:
+            out[-1][2] += 1
+        else:
+            out.append([s, x, 1])
+    return out
+
+
+# Source pixel s of a row, for each kind of row the kernels read
+FETCH = {
+    "565": lambda s: "__builtin_bswap16(lcd_rgb565(src[%d]))" % s,
+    "565_i8": lambda s: "lut[src[%d]]" % s,
+    "565_i4": lambda s: "lut[src[%d] %s]" % (s >> 1, "& 0x0f" if s & 1 else ">> 4"),
+    "444": lambda s: "src[%d]" % s,
+    "444_i8": lambda s: "lut[src[%d]]" % s,
+    "444_i4": lambda s: "lut[src[%d] %s]" % (s >> 1, "& 0x0f" if s & 1 else ">> 4"),
+}
+
+
+def kernel_565(col_map, fetch):
+    body = ["    uint16_t p;"]
+    for s, x, n in runs(col_map):
+        stores = " ".join("dest[%d] = p;" % (x + i) for i in range(n))
+        body.append("    p = %s; %s" % (fetch(s), stores))
+    return "\n".join(body)
+
+
+def kernel_444(col_map, fetch):
+    body = []
+    for x in range(0, len(col_map), 2):
+        body.append("    lcd_pack_rgb444(dest + %d, %s, %s);"
+                    % (x * 3 // 2, fetch(col_map[x]), fetch(col_map[x + 1])))
+    return "\n".join(body)
+
+
+def kernel(out, name, args, comment, body):
+    out.append("// " + comment)
+    out.append("static inline __attribute__((always_inline)) void "
+               "lcd_scale_row_%s(%s) {" % (name, args))
+    out.append(body)
+    out.append("}\n")
+
+
+def header(g, args):
+    iw = g["image_w"]
+    out = []
+    out.append("// Generated by tools/gen_lcd_geometry.py --panel %s --rotation %d --fit %s%s"
+               % (args.panel, args.rotation, args.fit,
+                  " --offset " + args.offset if args.offset else ""))
+    out.append("// Do not edit; set TINYBIT_LCD_PANEL, TINYBIT_LCD_ROTATION and")
+    out.append("// TINYBIT_LCD_FIT in CMake instead.")
+    out.append("""
+#ifndef LCD_GEOMETRY_H
+#define LCD_GEOMETRY_H
+
+#include <stdint.h>
+#include "lcd_pixel.h"
+
+#define LCD_PANEL           "%(panel)s"
+#define LCD_FIT             "%(fit)s"
+#define LCD_ROTATION        %(rotation)d
+#define MADCTL_VAL          0x%(madctl)02X
+
+// Panel in the rotated orientation, and where its top left corner is in
+// the controller RAM
+#define SCREEN_WIDTH        %(screen_w)d
+#define SCREEN_HEIGHT       %(screen_h)d
+#define COL_START           %(col_start)d
+#define ROW_START           %(row_start)d
+#define PTLAR_START         %(ptl0)d
+#define PTLAR_END           %(ptl1)d
+
+// The scaled 128x128 screen, and its top left corner on the panel
+#define LCD_IMAGE_WIDTH     %(image_w)d
+#define LCD_IMAGE_HEIGHT    %(image_h)d
+#define LCD_IMAGE_X         %(image_x)d
+#define LCD_IMAGE_Y         %(image_y)d
+
+// Source step per image pixel in 16.16 fixed point: source row for image
+// row y is (y * LCD_STEP_Y) >> 16, and the same across
+#define LCD_STEP_X          %(step_x)d
+#define LCD_STEP_Y          %(step_y)d
+""" % dict(g, panel=args.panel, fit=args.fit, ptl0=g["ptlar"][0], ptl1=g["ptlar"][1]))
+
+    out.append("#define LCD_COLUMN_MAP %s\n" % c_list(g["col_map"]))
+    out.append("#define LCD_ROW_MAP %s\n" % c_list(g["row_map"]))
+
+    col_map = g["col_map"]
+    kernel(out, "565", "uint16_t *dest, const uint16_t *src",
+           "One image row from one source row, RGB565 in bus byte order",
+           kernel_565(col_map, FETCH["565"]))
+    kernel(out, "565_i8", "uint16_t *dest, const uint8_t *src, const uint16_t *lut",
+           "The same from 8 bit indices (lcd_palette.h), lut in bus byte order",
+           kernel_565(col_map, FETCH["565_i8"]))
+    kernel(out, "565_i4", "uint16_t *dest, const uint8_t *src, const uint16_t *lut",
+           "The same from 4 bit indices",
+           kernel_565(col_map, FETCH["565_i4"]))
+    if iw % 2 == 0:
+        kernel(out, "444", "uint8_t *dest, const uint16_t *src",
+               "One image row from one source row, RGB444 two pixels to three bytes",
+               kernel_444(col_map, FETCH["444"]))
+        kernel(out, "444_i8", "uint8_t *dest, const uint8_t *src, const uint16_t *lut",
+               "The same from 8 bit indices, lut in framebuffer layout",
+               kernel_444(col_map, FETCH["444_i8"]))
+        kernel(out, "444_i4", "uint8_t *dest, const uint8_t *src, const uint16_t *lut",
+               "The same from 4 bit indices",
+               kernel_444(col_map, FETCH["444_i4"]))
+    out.append("#endif // LCD_GEOMETRY_H")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    ap.add_argument("--panel", default="240x240")
+    ap.add_argument("--rotation", type=int, default=0, choices=sorted(MADCTL))
+    ap.add_argument("--fit", default="fit", choices=["fit", "integer", "stretch"])
+    ap.add_argument("--offset", default="")
+    ap.add_argument("output")
+    args = ap.parse_args()
+
+    try:
+        panel = tuple(int(v) for v in args.panel.lower().split("x"))
+        offset = tuple(int(v) for v in args.offset.split(",")) if args.offset else None
+    except ValueError:
+        fail("bad --panel or --offset")
+    if len(panel) != 2 or (offset is not None and len(offset) != 2):
+        fail("bad --panel or --offset")
+
+    text = header(geometry(panel, args.rotation, args.fit, offset), args)
+    # Leave the file alone if nothing changed, so it does not rebuild
+    try:
+        with open(args.output) as f:
+            if f.read() == text:
+                return
+    except OSError:
+        pass
+    with open(args.output, "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
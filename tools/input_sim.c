@@ -0,0 +1,300 @@
+/**
+ * Run the button debouncing of input_debounce.h on synthetic bounce
+ * patterns.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/input_sim
+ *
+ * Each trace is a list of edges on the six button pins in microseconds:
+ * clean and bouncing presses, taps shorter than a frame, double taps,
+ * contact chatter while held, and spikes on lines nobody touches. The
+ * alarm interrupt samples them every INPUT_SAMPLE_US with some latency,
+ * and the frame loop polls at 60 Hz with the jitter of a game loop; the
+ * clock starts just before time_us_32() wraps.
+ *
+ * Checks that every press, and nothing else, comes out as one press event
+ * and one run of frames that read pressed; that each event's timestamp is
+ * no earlier than the contact and no later than its bounce and a sample
+ * after it; that taps pressed and released between two frames read
+ * pressed for one frame;
+ * and that no press takes longer than a frame and the debounce time to
+ * reach one. Then prints the statistics. Exits non-zero if any check
+ * fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "input_debounce.h"
+
+#define FRAME_US        16667
+#define FRAME_JITTER_US 3000
+#define IRQ_LATENCY_US  40
+#define RUN_US          3000000
+#define MAX_EDGES       4096
+#define MAX_PRESSES     256
+
+static const int pins[] = { 16, 17, 18, 19, 20, 21 };
+#define PINS            (sizeof(pins) / sizeof(pins[0]))
+
+static uint32_t rng = 0x6b43a9b5;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static uint32_t between(uint32_t lo, uint32_t hi) {
+    return lo + rand32() % (hi - lo + 1);
+}
+
+// The raw signal of a pin: the level toggles at each edge, from released
+typedef struct {
+    uint32_t edges[MAX_EDGES];
+    int count;
+} signal_t;
+
+// A real press: first contact, and the first edge of the release
+typedef struct {
+    int pin;
+    uint32_t down, up;
+    uint32_t bounce_us;
+    int frame_down, frame_up;   // the frames that took its events
+} press_t;
+
+static signal_t signals[PINS];
+static press_t presses[MAX_PRESSES];
+static int press_count;
+
+static void edge(int p, uint32_t t) {
+    signal_t *s = &signals[p];
+    if (s->count == MAX_EDGES || (s->count && t <= s->edges[s->count - 1])) {
+        printf("bad trace: edge at %u out of order\n", (unsigned)t);
+        exit(2);
+    }
+    s->edges[s->count++] = t;
+}
+
+// A change of level at t with bounces extra pairs of edges in bounce_us
+static void bouncing_edge(int p, uint32_t t, int bounces, uint32_t bounce_us) {
+    edge(p, t);
+    if (!bounces) return;
+    uint32_t step = bounce_us / (2 * bounces);
+    for (int i = 0; i < 2 * bounces; i++) {
+        t += between(step / 2, step);
+        edge(p, t);
+    }
+}
+
+static void press(int p, uint32_t down, uint32_t len, int bounces, uint32_t bounce_us) {
+    presses[press_count++] = (press_t){ p, down, down + len, bounce_us, -1, -1 };
+    bouncing_edge(p, down, bounces, bounce_us);
+    bouncing_edge(p, down + len, bounces, bounce_us);
+}
+
+// The level flipped for len, a spike on an idle line or a dropout on a
+// held one
+static void spike(int p, uint32_t t, uint32_t len) {
+    edge(p, t);
+    edge(p, t + len);
+}
+
+static void trace_clean(void) {
+    for (int i = 0; i < 20; i++) press(1, 100000 + i * 120000, 60000, 0, 0);
+}
+
+static void trace_bouncing(void) {
+    for (int i = 0; i < 20; i++) press(1, 100000 + i * 120000, between(40000, 80000), between(2, 8), 2000);
+}
+
+static void trace_worn(void) {
+    // Bounce for 3 ms, longer than the debounce takes to start counting
+    for (int i = 0; i < 20; i++) press(1, 100000 + i * 120000, 70000, 12, 3000);
+}
+
+static void trace_taps(void) {
+    // Shorter than a frame but longer than the debounce
+    for (int i = 0; i < 40; i++) press(0, 100000 + i * 60000, between(6000, 12000), 2, 800);
+}
+
+static void trace_double_taps(void) {
+    // Two taps 40 ms apart, as fast as a thumb goes
+    for (int i = 0; i < 15; i++) {
+        uint32_t t = 100000 + i * 180000;
+        press(4, t, 35000, 3, 1500);
+        press(4, t + 75000, 35000, 3, 1500);
+    }
+}
+
+static void trace_chatter(void) {
+    // Held for a second, contact lost for up to 2 ms now and then
+    presses[press_count++] = (press_t){ 2, 200000, 1200000, 2000, -1, -1 };
+    bouncing_edge(2, 200000, 4, 2000);
+    for (uint32_t t = 220000; t < 1180000; t += between(20000, 60000)) spike(2, t, between(200, 2000));
+    bouncing_edge(2, 1200000, 4, 2000);
+}
+
+static void trace_noise(void) {
+    // Spikes up to 2 ms on every line, nothing pressed
+    for (int p = 0; p < (int)PINS; p++)
+        for (uint32_t t = between(1000, 5000); t < RUN_US - 10000; t += between(6000, 15000))
+            spike(p, t, between(50, 2000));
+}
+
+static void trace_all(void) {
+    // All six at once, bouncing differently, in chords
+    for (int i = 0; i < 12; i++)
+        for (int p = 0; p < (int)PINS; p++)
+            press(p, 100000 + i * 200000 + p * 700, between(30000, 120000), between(0, 6), 2500);
+}
+
+typedef struct {
+    const char *name;
+    void (*make)(void);
+    int bounces;            // rejects some: 1 has to, 0 must not, -1 either
+} trace_t;
+
+static const trace_t traces[] = {
+    { "clean",          trace_clean,        0 },
+    { "bouncing",       trace_bouncing,     -1 },
+    { "worn contacts",  trace_worn,         -1 },
+    { "short taps",     trace_taps,         -1 },
+    { "double taps",    trace_double_taps,  -1 },
+    { "chatter held",   trace_chatter,      1 },
+    { "noise",          trace_noise,        1 },
+    { "six at once",    trace_all,          -1 },
+};
+
+static int failures;
+
+static void check(bool ok, const char *trace, const char *what) {
+    if (!ok) {
+        printf("%s: %s\n", trace, what);
+        failures++;
+    }
+}
+
+static void run(const trace_t *trace) {
+    for (int p = 0; p < (int)PINS; p++) signals[p].count = 0;
+    press_count = 0;
+    trace->make();
+
+    const uint32_t start = 0xfff00000;
+    uint32_t mask = 0;
+    for (int p = 0; p < (int)PINS; p++) mask |= 1u << pins[p];
+    static input_debounce_t d;
+    input_debounce_init(&d, mask, 0);
+
+    int next_edge[PINS] = { 0 };
+    uint32_t raw = 0;
+    uint32_t sample_at = between(0, INPUT_SAMPLE_US), frame_at = between(0, FRAME_US);
+    uint32_t frames_prev = 0;
+    int frames = 0;
+    int events[PINS] = { 0 }, runs[PINS] = { 0 };
+    int matched[MAX_PRESSES] = { 0 };
+    int frames_pressed[MAX_PRESSES] = { 0 };
+
+    while (sample_at < RUN_US || frame_at < RUN_US) {
+        uint32_t t = sample_at < frame_at ? sample_at : frame_at;
+        for (int p = 0; p < (int)PINS; p++) {
+            signal_t *s = &signals[p];
+            while (next_edge[p] < s->count && s->edges[next_edge[p]] <= t) {
+                raw ^= 1u << pins[p];
+                next_edge[p]++;
+            }
+        }
+
+        if (t == sample_at) {
+            input_debounce_sample(&d, raw | 0xaa000000, start + t);
+            sample_at += INPUT_SAMPLE_US + between(0, IRQ_LATENCY_US) - IRQ_LATENCY_US / 2;
+            continue;
+        }
+
+        // Match the events waiting to real presses and releases
+        for (uint32_t i = d.tail; i != d.head; i++) {
+            const input_event_t *e = &d.events[i & (INPUT_QUEUE_SIZE - 1)];
+            int p = 0;
+            while (p < (int)PINS && pins[p] != e->pin) p++;
+            if (p == (int)PINS) {
+                check(false, trace->name, "event on a pin not in the mask");
+                continue;
+            }
+            uint32_t at = e->time_us - start;
+            int k;
+            for (k = 0; k < press_count; k++) {
+                const press_t *r = &presses[k];
+                uint32_t real = e->pressed ? r->down : r->up;
+                if (r->pin == p && !(matched[k] & (e->pressed ? 1 : 2)) && at >= real &&
+                    at <= real + r->bounce_us + INPUT_SAMPLE_US + IRQ_LATENCY_US)
+                    break;
+            }
+            if (k == press_count) {
+                check(false, trace->name, e->pressed ? "press event without a press, or timestamp off"
+                                                     : "release event without a release, or timestamp off");
+                continue;
+            }
+            matched[k] |= e->pressed ? 1 : 2;
+            if (e->pressed) presses[k].frame_down = frames;
+            else presses[k].frame_up = frames;
+            events[p] += e->pressed;
+        }
+
+        uint32_t frame = input_debounce_frame(&d, start + t);
+        for (int p = 0; p < (int)PINS; p++) {
+            uint32_t bit = 1u << pins[p];
+            if ((frame & bit) && !(frames_prev & bit)) runs[p]++;
+            if (!(frame & bit)) continue;
+            // A pressed frame belongs to the last press it came after
+            int last = -1;
+            for (int k = 0; k < press_count; k++)
+                if (presses[k].pin == p && presses[k].down <= t) last = k;
+            if (last < 0) continue;
+            frames_pressed[last]++;
+        }
+        frames_prev = frame;
+        frames++;
+        frame_at += FRAME_US + between(0, FRAME_JITTER_US) - FRAME_JITTER_US / 2;
+    }
+
+    int expected[PINS] = { 0 }, short_taps = 0, total = 0;
+    for (int k = 0; k < press_count; k++) {
+        expected[presses[k].pin]++;
+        check(matched[k] == 3, trace->name, "press without a press and a release event");
+        check(frames_pressed[k] > 0, trace->name, "press no frame saw");
+        // Pressed and released between two frames
+        if (presses[k].frame_down == presses[k].frame_up) {
+            short_taps++;
+            check(frames_pressed[k] == 1, trace->name, "tap between two frames not pressed for exactly one");
+        }
+    }
+    for (int p = 0; p < (int)PINS; p++) {
+        check(events[p] == expected[p], trace->name, "press events differ from presses");
+        check(runs[p] == expected[p], trace->name, "runs of pressed frames differ from presses");
+        total += expected[p];
+    }
+
+    const input_stats_t *s = &d.stats;
+    check(s->presses == (uint32_t)total, trace->name, "press count differs");
+    check(trace->bounces < 0 || (s->bounces > 0) == trace->bounces, trace->name,
+          trace->bounces ? "no bounces rejected" : "bounces rejected on a clean signal");
+    check(!s->overflows, trace->name, "queue overflowed");
+    check(s->short_presses == (uint32_t)short_taps, trace->name, "short press count differs");
+    check(s->latency_worst_us <= FRAME_US + FRAME_JITTER_US / 2 + 3000 +
+                                 (INPUT_DEBOUNCE_SAMPLES + 1) * INPUT_SAMPLE_US + IRQ_LATENCY_US,
+          trace->name, "press took too long to reach a frame");
+
+    printf("%-14s %7d %7lu %7lu %7lu %9lu %9lu\n", trace->name, total, (unsigned long)s->presses,
+           (unsigned long)s->short_presses, (unsigned long)s->bounces,
+           (unsigned long)(s->latency_count ? s->latency_total_us / s->latency_count : 0),
+           (unsigned long)s->latency_worst_us);
+}
+
+int main(void) {
+    printf("trace          presses  events  short  bounces  mean us  worst us  (press to frame)\n");
+    for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) run(&traces[i]);
+    if (failures) return 1;
+    printf("every press seen once, no bounce or spike seen as one\n");
+    return 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * Check a generated lcd_geometry.h and time its row kernels.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   cmake --build build-tools --target lcd_geometry_table
+ *
+ * tools/CMakeLists.txt generates a header for each panel geometry in
+ * LCD_GEOMETRIES and builds this once per header. Each build checks that
+ * the window fits the controller RAM and the image is centred on the
+ * panel, that the maps cover every source pixel in order, and that the
+ * unrolled RGB565 and RGB444 kernels give the same bytes as the generic
+ * stepping loop for random rows, straight from the framebuffer and from
+ * 8 and 4 bit palette indices. Then it prints one row of the timing
+ * table: host time per frame for the unrolled kernel and the generic
+ * loop it replaces. Exits non-zero on the first failure.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lcd_geometry.h"
+
+#define RENDER_W    128
+#define RENDER_H    128
+
+static const uint8_t column_map[LCD_IMAGE_WIDTH] = LCD_COLUMN_MAP;
+static const uint8_t row_map[LCD_IMAGE_HEIGHT] = LCD_ROW_MAP;
+
+static uint16_t frame[RENDER_W * RENDER_H];
+static uint8_t indices[RENDER_W];
+static uint16_t lut[256];
+static uint8_t line[2][LCD_IMAGE_WIDTH * 2];
+
+static int failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok && !failures++)
+        printf("%s rotation %d %s: %s\n", LCD_PANEL, LCD_ROTATION, LCD_FIT, what);
+}
+
+static uint32_t rng = 0x12345678;
+
+static uint16_t rand16(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// The loop st7789_lcd.c had before the unrolled kernels, with the
+// interpolator's accumulator as a plain variable
+static void generic_565(uint8_t *dest, const uint16_t *src) {
+    uint32_t accum = 0;
+    for (int x = 0; x < LCD_IMAGE_WIDTH; x++) {
+        uint16_t rgb565 = lcd_rgb565(src[accum >> 16]);
+        accum += LCD_STEP_X;
+        dest[x * 2 + 0] = rgb565 >> 8;
+        dest[x * 2 + 1] = rgb565 & 0xFF;
+    }
+}
+
+// Source row through the palette, the way the indexed kernels read it
+static void lookup_row(uint16_t *row, int bits) {
+    for (int x = 0; x < RENDER_W; x++)
+        row[x] = lut[bits == 8 ? indices[x] : (indices[x >> 1] >> (~x & 1) * 4) & 0x0f];
+}
+
+#if LCD_IMAGE_WIDTH % 2 == 0
+static void generic_444(uint8_t *dest, const uint16_t *src) {
+    uint32_t accum = 0;
+    for (int x = 0; x < LCD_IMAGE_WIDTH; x += 2) {
+        uint32_t x0 = accum >> 16;
+        accum += LCD_STEP_X;
+        uint32_t x1 = accum >> 16;
+        accum += LCD_STEP_X;
+        lcd_pack_rgb444(dest, src[x0], src[x1]);
+        dest += 3;
+    }
+}
+#endif
+
+static void check_geometry(void) {
+    bool swapped = LCD_ROTATION == 90 || LCD_ROTATION == 270;
+    check(COL_START + SCREEN_WIDTH <= (swapped ? 320 : 240), "columns outside the controller RAM");
+    check(ROW_START + SCREEN_HEIGHT <= (swapped ? 240 : 320), "rows outside the controller RAM");
+    check(PTLAR_START <= PTLAR_END && PTLAR_END < 320, "partial area outside the RAM");
+    check(PTLAR_END - PTLAR_START + 1 == (swapped ? SCREEN_WIDTH : SCREEN_HEIGHT),
+          "partial area is not the panel height");
+
+    check(LCD_IMAGE_X + LCD_IMAGE_WIDTH <= SCREEN_WIDTH && LCD_IMAGE_Y + LCD_IMAGE_HEIGHT <= SCREEN_HEIGHT,
+          "image does not fit the panel");
+    check(abs(SCREEN_WIDTH - LCD_IMAGE_WIDTH - 2 * LCD_IMAGE_X) <= 1 &&
+          abs(SCREEN_HEIGHT - LCD_IMAGE_HEIGHT - 2 * LCD_IMAGE_Y) <= 1, "image is not centred");
+    if (strcmp(LCD_FIT, "stretch"))
+        check(LCD_IMAGE_WIDTH == LCD_IMAGE_HEIGHT, "image is not square");
+    int short_side = SCREEN_WIDTH < SCREEN_HEIGHT ? SCREEN_WIDTH : SCREEN_HEIGHT;
+    if (!strcmp(LCD_FIT, "integer"))
+        check(LCD_IMAGE_WIDTH % RENDER_W == 0 && LCD_IMAGE_WIDTH + RENDER_W > short_side,
+              "image is not the largest whole multiple of the screen");
+    else if (!strcmp(LCD_FIT, "fit"))
+        check(LCD_IMAGE_WIDTH >= short_side - 1, "image does not fit the short side");
+    else
+        check(LCD_IMAGE_WIDTH == SCREEN_WIDTH && LCD_IMAGE_HEIGHT == SCREEN_HEIGHT,
+              "image does not fill the panel");
+
+    // Every source pixel in order, each shown as often as the scale allows
+    int max_x = (LCD_IMAGE_WIDTH + RENDER_W - 1) / RENDER_W;
+    int max_y = (LCD_IMAGE_HEIGHT + RENDER_H - 1) / RENDER_H;
+    int count = 1;
+    check(column_map[0] == 0 && column_map[LCD_IMAGE_WIDTH - 1] == RENDER_W - 1, "column map ends");
+    for (int x = 1; x < LCD_IMAGE_WIDTH; x++) {
+        check(column_map[x] - column_map[x - 1] <= 1 && column_map[x] >= column_map[x - 1],
+              "column map skips");
+        count = column_map[x] == column_map[x - 1] ? count + 1 : 1;
+        check(count <= max_x, "column repeated too often");
+        check(column_map[x] == (x * LCD_STEP_X) >> 16, "column map is not LCD_STEP_X");
+    }
+    count = 1;
+    check(row_map[0] == 0 && row_map[LCD_IMAGE_HEIGHT - 1] == RENDER_H - 1, "row map ends");
+    for (int y = 1; y < LCD_IMAGE_HEIGHT; y++) {
+        check(row_map[y] - row_map[y - 1] <= 1 && row_map[y] >= row_map[y - 1], "row map skips");
+        count = row_map[y] == row_map[y - 1] ? count + 1 : 1;
+        check(count <= max_y, "row repeated too often");
+        check(row_map[y] == (y * LCD_STEP_Y) >> 16, "row map is not LCD_STEP_Y");
+    }
+}
+
+static void check_kernels(void) {
+    for (int i = 0; i < RENDER_W * RENDER_H; i++) frame[i] = rand16();
+    for (int y = 0; y < RENDER_H; y++) {
+        const uint16_t *src = &frame[y * RENDER_W];
+        generic_565(line[0], src);
+        lcd_scale_row_565((uint16_t *)line[1], src);
+        check(!memcmp(line[0], line[1], LCD_IMAGE_WIDTH * 2), "RGB565 kernel differs");
+#if LCD_IMAGE_WIDTH % 2 == 0
+        generic_444(line[0], src);
+        lcd_scale_row_444(line[1], src);
+        check(!memcmp(line[0], line[1], LCD_IMAGE_WIDTH * 3 / 2), "RGB444 kernel differs");
+#endif
+    }
+
+    // Indexed rows: the palette holds framebuffer pixels for RGB444 and
+    // bus order RGB565 for RGB565
+    uint16_t row[RENDER_W], bus[256];
+    for (int i = 0; i < 256; i++) {
+        lut[i] = rand16();
+        bus[i] = __builtin_bswap16(lcd_rgb565(lut[i]));
+    }
+    for (int n = 0; n < 64; n++) {
+        for (int x = 0; x < RENDER_W; x++) indices[x] = rand16();
+        for (int bits = 4; bits <= 8; bits += 4) {
+            lookup_row(row, bits);
+            generic_565(line[0], row);
+            if (bits == 8) lcd_scale_row_565_i8((uint16_t *)line[1], indices, bus);
+            else lcd_scale_row_565_i4((uint16_t *)line[1], indices, bus);
+            check(!memcmp(line[0], line[1], LCD_IMAGE_WIDTH * 2), "indexed RGB565 kernel differs");
+#if LCD_IMAGE_WIDTH % 2 == 0
+            generic_444(line[0], row);
+            if (bits == 8) lcd_scale_row_444_i8(line[1], indices, lut);
+            else lcd_scale_row_444_i4(line[1], indices, lut);
+            check(!memcmp(line[0], line[1], LCD_IMAGE_WIDTH * 3 / 2), "indexed RGB444 kernel differs");
+#endif
+        }
+    }
+}
+
+static double frame_ns(void (*build)(uint8_t *, const uint16_t *)) {
+    const int frames = 500;
+    struct timespec t0, t1;
+    for (int y = 0; y < LCD_IMAGE_HEIGHT; y++)
+        build(line[y & 1], &frame[row_map[y] * RENDER_W]);     // warm up
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int f = 0; f < frames; f++) {
+        for (int y = 0; y < LCD_IMAGE_HEIGHT; y++)
+            build(line[y & 1], &frame[row_map[y] * RENDER_W]);
+        // Keep the stores from being optimised out
+        __asm__ volatile("" : : "r"(line) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / frames;
+}
+
+static void unrolled_565(uint8_t *dest, const uint16_t *src) {
+    lcd_scale_row_565((uint16_t *)dest, src);
+}
+
+int main(void) {
+    check_geometry();
+    check_kernels();
+    if (failures) return 1;
+
+    double generic = frame_ns(generic_565), unrolled = frame_ns(unrolled_565);
+    char panel[32];
+    snprintf(panel, sizeof(panel), "%s r%d %s", LCD_PANEL, LCD_ROTATION, LCD_FIT);
+    printf("%-24s %3dx%-3d %3dx%-3d at %3d,%-3d %9.0f %9.0f %6.2fx\n", panel,
+           SCREEN_WIDTH, SCREEN_HEIGHT, LCD_IMAGE_WIDTH, LCD_IMAGE_HEIGHT,
+           LCD_IMAGE_X, LCD_IMAGE_Y, generic, unrolled, generic / unrolled);
+    return 0;
+}
@@ -0,0 +1,212 @@
+/**
+ * Check the indexed frames of lcd_palette.h and time them against plain
+ * RGBA4444 frames.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/lcd_palette_check
+ *
+ * For frames with a few, 16, 17, 256, 257 and 4096 colours: indexes the
+ * frame the way render_frame_handler() does, checks the bits per pixel it
+ * picked and that every pixel comes back out of the palette, then builds
+ * the whole image the way send_frame_to_lcd() does with and without
+ * indices and checks the RGB565 and RGB444 bytes are the same. Runs past
+ * the frame stamp wrapping round. Then prints the conversion benchmark:
+ * host time per frame for the copy on core0 and the scanlines on core1,
+ * direct and indexed. Exits non-zero on the first failure.
+ *
+ * Built against the 240x240 lcd_geometry.h.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lcd_geometry.h"
+#include "lcd_palette.h"
+
+#define RENDER_W    128
+#define RENDER_H    128
+#define PIXELS      (RENDER_W * RENDER_H)
+
+static const uint8_t row_map[LCD_IMAGE_HEIGHT] = LCD_ROW_MAP;
+
+static uint16_t display[PIXELS];        // tb_mem.display
+static uint8_t copy[PIXELS * 2];        // frame_buffer_copy
+static lcd_palette_t palette;
+static lcd_palette_map_t map;
+static uint16_t lut[LCD_PALETTE_SIZE];
+static uint8_t image[2][LCD_IMAGE_WIDTH * LCD_IMAGE_HEIGHT * 2];
+
+static uint32_t rng = 0x12345678;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// A frame with exactly colours different colours, in 8x8 tiles the way
+// sprites and text use them. Random alpha on top when alpha is set.
+static void make_frame(int colours, bool alpha) {
+    static uint16_t used[4096];
+    for (int i = 0; i < 4096; i++) used[i] = i;
+    for (int i = 0; i < colours; i++) {
+        int j = i + rand32() % (4096 - i);
+        uint16_t t = used[i];
+        used[i] = used[j];
+        used[j] = t;
+    }
+    for (int i = 0; i < PIXELS; i++) {
+        int tile = (i / RENDER_W / 8) * (RENDER_W / 8) + i % RENDER_W / 8;
+        int c = i < colours ? i : (int)((tile * 7 + (rand32() & 3)) % colours);
+        uint16_t key = used[c];
+        // Back from the lcd_palette_key() number to 0xBARG
+        display[i] = (key & 0xff) | (key & 0xf00) << 4;
+        if (alpha) display[i] |= (rand32() & 0xf) << 8;
+    }
+}
+
+static bool index_frame(void) {
+    if (lcd_palette_index(&palette, copy, display, PIXELS, &map)) return true;
+    memcpy(copy, display, sizeof(display));
+    palette.bits = 16;
+    return false;
+}
+
+static void load_palette(int pixel_bits) {
+    for (int i = 0; i < palette.count; i++)
+        lut[i] = pixel_bits == 16 ? __builtin_bswap16(lcd_rgb565(palette.colours[i])) : palette.colours[i];
+}
+
+// Whole image from the copy, as send_frame_to_lcd() builds it line by line
+static void build_image(uint8_t *out, int pixel_bits) {
+    int bits = palette.bits;
+    int line_bytes = LCD_IMAGE_WIDTH * pixel_bits / 8;
+    if (bits != 16) load_palette(pixel_bits);
+    for (int y = 0; y < LCD_IMAGE_HEIGHT; y++, out += line_bytes) {
+        const uint8_t *row = &copy[row_map[y] * RENDER_W * bits / 8];
+        if (pixel_bits == 16) {
+            if (bits == 16) lcd_scale_row_565((uint16_t *)out, (const uint16_t *)row);
+            else if (bits == 8) lcd_scale_row_565_i8((uint16_t *)out, row, lut);
+            else lcd_scale_row_565_i4((uint16_t *)out, row, lut);
+        } else {
+            if (bits == 16) lcd_scale_row_444(out, (const uint16_t *)row);
+            else if (bits == 8) lcd_scale_row_444_i8(out, row, lut);
+            else lcd_scale_row_444_i4(out, row, lut);
+        }
+    }
+}
+
+static int failures;
+
+static void check(bool ok, const char *frame, const char *what) {
+    if (!ok) {
+        printf("%s: %s\n", frame, what);
+        failures++;
+    }
+}
+
+static void check_frame(const char *name, int colours, bool alpha) {
+    make_frame(colours, alpha);
+    bool indexed = index_frame();
+    int expect = colours <= 16 ? 4 : colours <= LCD_PALETTE_SIZE ? 8 : 16;
+    check(palette.bits == expect, name, "wrong bits per pixel");
+    check(indexed == (expect != 16), name, "wrong fallback");
+    if (!indexed) return;
+
+    check(palette.count == colours, name, "wrong palette size");
+    for (int i = 0; i < palette.count; i++)
+        for (int j = 0; j < i; j++)
+            check(palette.colours[i] != palette.colours[j], name, "colour twice in the palette");
+    for (int i = 0; i < PIXELS; i++) {
+        uint16_t pixel = palette.colours[lcd_palette_at(&copy[i / RENDER_W * RENDER_W * palette.bits / 8],
+                                                        i % RENDER_W, palette.bits)];
+        if (pixel != (display[i] & 0xf0ff)) {
+            check(false, name, "pixel does not come back out of the palette");
+            break;
+        }
+    }
+
+    // Same bytes on the bus as the frame sent directly
+    for (int pixel_bits = 16; pixel_bits >= 12; pixel_bits -= 4) {
+        index_frame();
+        build_image(image[1], pixel_bits);
+        memcpy(copy, display, sizeof(display));
+        palette.bits = 16;
+        build_image(image[0], pixel_bits);
+        check(!memcmp(image[0], image[1], LCD_IMAGE_WIDTH * LCD_IMAGE_HEIGHT * pixel_bits / 8), name,
+              pixel_bits == 16 ? "RGB565 image differs" : "RGB444 image differs");
+    }
+}
+
+static double ns_since(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+// Host ns per frame for the copy on core0 and the RGB565 scanlines on core1
+static void time_frame(const char *name, int colours) {
+    const int frames = 300;
+    struct timespec t0;
+    double copy_direct, copy_indexed, build_direct, build_indexed;
+
+    make_frame(colours, false);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int f = 0; f < frames; f++) {
+        memcpy(copy, display, sizeof(display));
+        __asm__ volatile("" : : "r"(copy) : "memory");
+    }
+    copy_direct = ns_since(&t0) / frames;
+    palette.bits = 16;
+    build_image(image[0], 16);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int f = 0; f < frames; f++) {
+        build_image(image[0], 16);
+        __asm__ volatile("" : : "r"(image) : "memory");
+    }
+    build_direct = ns_since(&t0) / frames;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int f = 0; f < frames; f++) {
+        index_frame();
+        __asm__ volatile("" : : "r"(copy) : "memory");
+    }
+    copy_indexed = ns_since(&t0) / frames;
+    build_image(image[1], 16);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int f = 0; f < frames; f++) {
+        build_image(image[1], 16);
+        __asm__ volatile("" : : "r"(image) : "memory");
+    }
+    build_indexed = ns_since(&t0) / frames;
+
+    printf("%-12s %2d bit %5d bytes   %8.0f %8.0f   %8.0f %8.0f   %5.2fx\n", name, palette.bits,
+           PIXELS * palette.bits / 8, copy_direct, copy_indexed, build_direct, build_indexed,
+           build_direct / build_indexed);
+}
+
+int main(void) {
+    static const struct { const char *name; int colours; } frames[] = {
+        { "4 colours", 4 }, { "16 colours", 16 }, { "17 colours", 17 },
+        { "256 colours", 256 }, { "257 colours", 257 }, { "4096 colours", 4096 },
+    };
+    const int count = sizeof(frames) / sizeof(frames[0]);
+
+    for (int i = 0; i < count; i++)
+        check_frame(frames[i].name, frames[i].colours, false);
+    check_frame("16 colours with alpha", 16, true);
+    // Past the frame stamp wrapping round, with colours coming and going
+    for (int i = 0; i < 600 && !failures; i++)
+        check_frame("stamp wrap", 1 + rand32() % 300, i & 1);
+    if (failures) return 1;
+    printf("indexed frames match the direct ones\n\n");
+
+    printf("frame        format  handed over      copy on core0      scanlines on core1  (ns per frame, host)\n");
+    printf("                                     direct  indexed     direct  indexed\n");
+    for (int i = 0; i < count; i++)
+        time_frame(frames[i].name, frames[i].colours);
+    return 0;
+}
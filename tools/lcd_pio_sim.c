@@ -0,0 +1,312 @@
+/**
+ * Check the st7789_lcd_rep PIO program against the software scaler.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/lcd_pio_sim st7789_lcd.pio
+ *
+ * Reads the program out of st7789_lcd.pio, runs it cycle by cycle on
+ * random lines built the way st7789_lcd.c builds them with LCD_PIO_SCALE,
+ * and records the data pin on every rising clock edge. The bits must be
+ * the 240 pixels the 128 -> 240 software scaler sends. Also prints the
+ * state machine cycles per line next to the plain st7789_lcd program's.
+ * Exits non-zero on the first mismatch.
+ *
+ * Only the instructions and options the LCD programs use are supported.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "lcd_pixel.h"
+
+#define RENDER_W    128
+#define SCREEN_W    240
+#define FRAC_BITS   16
+#define SCALE_X     ((RENDER_W << FRAC_BITS) / SCREEN_W)
+
+#define PROGRAM     "st7789_lcd_rep"
+#define MAX_INSTR   32
+#define MAX_LABELS  16
+
+typedef enum { I_PULL, I_MOV, I_SET, I_OUT, I_JMP, I_NOP } op_t;
+typedef enum { R_PINS, R_X, R_Y, R_OSR, R_ISR, R_NULL } reg_t;
+typedef enum { C_ALWAYS, C_NOT_X, C_X_DEC, C_NOT_Y, C_Y_DEC } cond_t;
+
+typedef struct {
+    op_t op;
+    reg_t dst, src;
+    cond_t cond;
+    int value;              // SET value, OUT bit count
+    char target[32];        // JMP label
+    int side;
+    int line;
+} instr_t;
+
+static instr_t prog[MAX_INSTR];
+static int prog_len, wrap_target, wrap = -1;
+static struct { char name[32]; int pc; } labels[MAX_LABELS];
+static int label_count;
+
+static void fail(int line, const char *what) {
+    fprintf(stderr, "line %d: %s\n", line, what);
+    exit(1);
+}
+
+static reg_t parse_reg(const char *s, int line) {
+    static const char *const names[] = { "pins", "x", "y", "osr", "isr", "null" };
+    for (int i = 0; i < 6; i++)
+        if (!strcmp(s, names[i])) return (reg_t)i;
+    fail(line, "unsupported register");
+    return R_NULL;
+}
+
+static void parse_instr(char *text, int line) {
+    if (prog_len == MAX_INSTR) fail(line, "program too long");
+    instr_t *in = &prog[prog_len++];
+    memset(in, 0, sizeof(*in));
+    in->line = line;
+
+    char *side = strstr(text, "side");
+    if (!side) fail(line, "missing side-set");
+    in->side = atoi(side + 4);
+    *side = 0;
+    if (strchr(text, '[')) fail(line, "delays are not supported");
+
+    char mnemonic[16] = "", a[32] = "", b[32] = "";
+    for (char *p = text; *p; p++) if (*p == ',') *p = ' ';
+    sscanf(text, "%15s %31s %31s", mnemonic, a, b);
+
+    if (!strcmp(mnemonic, "pull")) {
+        in->op = I_PULL;
+    } else if (!strcmp(mnemonic, "nop")) {
+        in->op = I_NOP;
+    } else if (!strcmp(mnemonic, "mov")) {
+        in->op = I_MOV;
+        in->dst = parse_reg(a, line);
+        in->src = parse_reg(b, line);
+    } else if (!strcmp(mnemonic, "set")) {
+        in->op = I_SET;
+        in->dst = parse_reg(a, line);
+        in->value = atoi(b);
+    } else if (!strcmp(mnemonic, "out")) {
+        in->op = I_OUT;
+        in->dst = parse_reg(a, line);
+        in->value = atoi(b);
+    } else if (!strcmp(mnemonic, "jmp")) {
+        in->op = I_JMP;
+        if (!*b) {
+            strcpy(in->target, a);
+        } else {
+            static const char *const conds[] = { "", "!x", "x--", "!y", "y--" };
+            int c = 1;
+            while (c < 5 && strcmp(a, conds[c])) c++;
+            if (c == 5) fail(line, "unsupported jmp condition");
+            in->cond = (cond_t)c;
+            strcpy(in->target, b);
+        }
+    } else {
+        fail(line, "unsupported instruction");
+    }
+}
+
+static void load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "usage: lcd_pio_sim <st7789_lcd.pio>\n");
+        exit(1);
+    }
+    char buf[256];
+    int line = 0;
+    bool in_program = false, found = false;
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        char *p = strchr(buf, ';');
+        if (p) *p = 0;
+        p = buf;
+        while (isspace((unsigned char)*p)) p++;
+        for (char *e = p + strlen(p); e > p && isspace((unsigned char)e[-1]); ) *--e = 0;
+        if (!*p) continue;
+
+        if (!strncmp(p, ".program", 8)) {
+            in_program = !strcmp(p + 8 + strspn(p + 8, " \t"), PROGRAM);
+            found |= in_program;
+            continue;
+        }
+        if (!in_program) continue;
+        if (!strcmp(p, ".wrap_target")) wrap_target = prog_len;
+        else if (!strcmp(p, ".wrap")) wrap = prog_len - 1;
+        else if (!strncmp(p, ".side_set", 9)) {
+            if (atoi(p + 9) != 1) fail(line, "only .side_set 1 is supported");
+        } else if (*p == '.') fail(line, "unsupported directive");
+        else if (p[strlen(p) - 1] == ':') {
+            if (label_count == MAX_LABELS) fail(line, "too many labels");
+            p[strlen(p) - 1] = 0;
+            if (strlen(p) >= sizeof(labels[0].name)) fail(line, "label too long");
+            strcpy(labels[label_count].name, p);
+            labels[label_count++].pc = prog_len;
+        } else parse_instr(p, line);
+    }
+    fclose(f);
+    if (!found) fail(line, "no .program " PROGRAM);
+    if (wrap < 0) wrap = prog_len - 1;
+}
+
+static int label_pc(const instr_t *in) {
+    for (int i = 0; i < label_count; i++)
+        if (!strcmp(labels[i].name, in->target)) return labels[i].pc;
+    fail(in->line, "unknown label");
+    return 0;
+}
+
+// One state machine, OUT shifting left, no autopull
+typedef struct {
+    int pc;
+    uint32_t x, y, osr, isr;
+    int data, clk;
+    const uint32_t *fifo;
+    int fifo_len, fifo_pos;
+    long cycles;
+} sm_t;
+
+// Runs until the SM stalls on an empty FIFO. Calls sample() with the data
+// pin on every rising clock edge.
+static void run(sm_t *sm, void (*sample)(int bit)) {
+    while (1) {
+        const instr_t *in = &prog[sm->pc];
+        int data = sm->data;
+        int next = sm->pc == wrap ? wrap_target : sm->pc + 1;
+
+        switch (in->op) {
+        case I_PULL:
+            if (sm->fifo_pos == sm->fifo_len) return;   // stalled
+            sm->osr = sm->fifo[sm->fifo_pos++];
+            break;
+        case I_NOP:
+            break;
+        case I_MOV: {
+            uint32_t v = in->src == R_X ? sm->x : in->src == R_Y ? sm->y :
+                         in->src == R_OSR ? sm->osr : in->src == R_ISR ? sm->isr : 0;
+            if (in->dst == R_X) sm->x = v;
+            else if (in->dst == R_Y) sm->y = v;
+            else if (in->dst == R_OSR) sm->osr = v;
+            else if (in->dst == R_ISR) sm->isr = v;
+            else fail(in->line, "unsupported mov destination");
+            break;
+        }
+        case I_SET:
+            if (in->dst == R_X) sm->x = in->value;
+            else if (in->dst == R_Y) sm->y = in->value;
+            else if (in->dst == R_PINS) sm->data = in->value & 1;
+            else fail(in->line, "unsupported set destination");
+            break;
+        case I_OUT: {
+            int n = in->value;
+            uint32_t v = n == 32 ? sm->osr : sm->osr >> (32 - n);
+            sm->osr = n == 32 ? 0 : sm->osr << n;
+            if (in->dst == R_PINS) sm->data = v & 1;
+            else if (in->dst == R_X) sm->x = v;
+            else if (in->dst == R_Y) sm->y = v;
+            else if (in->dst != R_NULL) fail(in->line, "unsupported out destination");
+            break;
+        }
+        case I_JMP: {
+            bool take = true;
+            switch (in->cond) {
+            case C_ALWAYS: break;
+            case C_NOT_X: take = !sm->x; break;
+            case C_NOT_Y: take = !sm->y; break;
+            case C_X_DEC: take = sm->x != 0; sm->x--; break;
+            case C_Y_DEC: take = sm->y != 0; sm->y--; break;
+            }
+            if (take) next = label_pc(in);
+            break;
+        }
+        }
+
+        // Data and clock change together at the end of the cycle, so the
+        // data must have been set one instruction before the rising edge
+        if (in->side && !sm->clk) {
+            if (sm->data != data) fail(in->line, "data changes on the rising clock edge");
+            sample(sm->data);
+        }
+        sm->clk = in->side;
+        sm->pc = next;
+        sm->cycles++;
+    }
+}
+
+static uint16_t received[SCREEN_W * 2];
+static int received_bits;
+
+static void sample(int bit) {
+    if (received_bits < (int)(sizeof(received) * 8))
+        received[received_bits / 16] = received[received_bits / 16] << 1 | bit;
+    received_bits++;
+}
+
+static uint32_t rng = 0x12345678;
+
+static uint16_t rand16(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+int main(int argc, char **argv) {
+    load(argc > 1 ? argv[1] : "st7789_lcd.pio");
+    printf("%s: %d instructions\n", PROGRAM, prog_len);
+
+    // Same table as lcd_init_display()
+    uint16_t column_repeat[RENDER_W] = {0};
+    for (int x = 1; x < SCREEN_W; x++) {
+        uint32_t src_x = ((uint32_t)x * SCALE_X) >> FRAC_BITS;
+        if (src_x == (((uint32_t)x - 1) * SCALE_X) >> FRAC_BITS)
+            column_repeat[src_x] = 1;
+    }
+
+    const int lines = 1000;
+    long cycles = 0;
+    sm_t sm = {0};
+    for (int line = 0; line < lines; line++) {
+        uint16_t row[RENDER_W];
+        uint32_t fifo[RENDER_W];
+        for (int x = 0; x < RENDER_W; x++) {
+            // All-ones and all-zeros lines catch stuck bits
+            row[x] = line == 0 ? 0xffff : line == 1 ? 0 : rand16();
+            uint16_t half = lcd_rgb565(row[x]) | column_repeat[x];
+            fifo[x] = (uint32_t)half << 16 | half;  // narrow write replication
+        }
+
+        received_bits = 0;
+        sm.fifo = fifo;
+        sm.fifo_len = RENDER_W;
+        sm.fifo_pos = 0;
+        long start = sm.cycles;
+        run(&sm, sample);
+        cycles += sm.cycles - start;
+
+        if (received_bits != SCREEN_W * 16) {
+            printf("line %d: %d bits sent, expected %d\n", line, received_bits, SCREEN_W * 16);
+            return 1;
+        }
+        for (int x = 0; x < SCREEN_W; x++) {
+            uint16_t expect = lcd_rgb565(row[(x * SCALE_X) >> FRAC_BITS]);
+            if (received[x] != expect) {
+                printf("line %d pixel %d: sent %04x, expected %04x\n", line, x, received[x], expect);
+                return 1;
+            }
+        }
+    }
+
+    // st7789_lcd: out + nop per bit
+    double per_line = (double)cycles / lines;
+    long plain = SCREEN_W * 16 * 2;
+    printf("%d lines match the software scaler\n", lines);
+    printf("SM cycles per line: %.0f (%.1f per pixel), st7789_lcd %ld (32.0 per pixel), %+.1f%%\n",
+           per_line, per_line / SCREEN_W, plain, 100.0 * (per_line - plain) / plain);
+    printf("FIFO entries per line: %d, st7789_lcd %d\n", RENDER_W, SCREEN_W * 2 / 4);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * Check the 12 bit RGB444 panel format against the 16 bit RGB565 one.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/lcd_pixel_check
+ *
+ * Every framebuffer pixel value goes through both encoders, and a random
+ * frame through both scanline layouts with the same 128 -> 240 stepping as
+ * st7789_lcd.c. Both outputs are decoded back to 4 bit channels, the way
+ * the panel reads them, and must match pixel for pixel. Exits non-zero on
+ * the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcd_pixel.h"
+
+#define RENDER_W    128
+#define SCREEN_W    240
+#define FRAC_BITS   16
+#define SCALE_X     ((RENDER_W << FRAC_BITS) / SCREEN_W)
+
+typedef struct { uint8_t r, g, b; } rgb_t;
+
+// The conversion st7789_lcd.c used before lcd_pixel.h
+static uint16_t reference_rgb565(uint16_t pixel) {
+    uint8_t r = (pixel >> 0) & 0xf0;
+    uint8_t g = (pixel << 4) & 0xf0;
+    uint8_t b = (pixel >> 8) & 0xf0;
+    return ((r & 0xF0) << 8) | ((g & 0xF0) << 3) | ((b & 0xF0) >> 3);
+}
+
+// The panel drops the low bits of the wider channels
+static rgb_t decode565(const uint8_t *p) {
+    uint16_t v = p[0] << 8 | p[1];
+    return (rgb_t){ (v >> 12) & 0xf, (v >> 7) & 0xf, (v >> 1) & 0xf };
+}
+
+static void decode444(const uint8_t *p, rgb_t *a, rgb_t *b) {
+    *a = (rgb_t){ p[0] >> 4, p[0] & 0xf, p[1] >> 4 };
+    *b = (rgb_t){ p[1] & 0xf, p[2] >> 4, p[2] & 0xf };
+}
+
+static int same(rgb_t a, rgb_t b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static void line16(uint8_t *dest, const uint16_t *row) {
+    uint32_t accum = 0;
+    for (int x = 0; x < SCREEN_W; x++, accum += SCALE_X) {
+        uint16_t v = lcd_rgb565(row[accum >> FRAC_BITS]);
+        dest[x * 2 + 0] = v >> 8;
+        dest[x * 2 + 1] = v & 0xff;
+    }
+}
+
+static void line12(uint8_t *dest, const uint16_t *row) {
+    uint32_t accum = 0;
+    for (int x = 0; x < SCREEN_W; x += 2, accum += 2 * SCALE_X) {
+        lcd_pack_rgb444(dest, row[accum >> FRAC_BITS], row[(accum + SCALE_X) >> FRAC_BITS]);
+        dest += 3;
+    }
+}
+
+int main(void) {
+    for (uint32_t p = 0; p < 0x10000; p++) {
+        if (lcd_rgb565(p) != reference_rgb565(p)) {
+            printf("lcd_rgb565(%04x) = %04x, expected %04x\n", p, lcd_rgb565(p), reference_rgb565(p));
+            return 1;
+        }
+    }
+
+    // Each byte of the packed pair mixes fields of both pixels; sweep one
+    // pixel through every value against a spread of partners
+    for (uint32_t p = 0; p < 0x10000; p++) {
+        for (uint32_t q = 0; q < 0x10000; q += 0x0fed) {
+            uint8_t b16[4], b12[3];
+            uint16_t v0 = lcd_rgb565(p), v1 = lcd_rgb565(q);
+            b16[0] = v0 >> 8; b16[1] = v0; b16[2] = v1 >> 8; b16[3] = v1;
+            rgb_t a, b;
+            lcd_pack_rgb444(b12, p, q);
+            decode444(b12, &a, &b);
+            if (!same(a, decode565(b16)) || !same(b, decode565(b16 + 2))) {
+                printf("pair %04x %04x decodes differently\n", p, q);
+                return 1;
+            }
+            lcd_pack_rgb444(b12, q, p);
+            decode444(b12, &a, &b);
+            if (!same(a, decode565(b16 + 2)) || !same(b, decode565(b16))) {
+                printf("pair %04x %04x decodes differently\n", q, p);
+                return 1;
+            }
+        }
+    }
+
+    static uint16_t frame[RENDER_W * RENDER_W];
+    srand(1);
+    for (int i = 0; i < RENDER_W * RENDER_W; i++) frame[i] = rand();
+    uint8_t l16[SCREEN_W * 2], l12[SCREEN_W * 3 / 2];
+    for (int y = 0; y < RENDER_W; y++) {
+        line16(l16, &frame[y * RENDER_W]);
+        line12(l12, &frame[y * RENDER_W]);
+        for (int x = 0; x < SCREEN_W; x += 2) {
+            rgb_t a, b;
+            decode444(&l12[x / 2 * 3], &a, &b);
+            if (!same(a, decode565(&l16[x * 2])) || !same(b, decode565(&l16[x * 2 + 2]))) {
+                printf("row %d pixel %d differs\n", y, x);
+                return 1;
+            }
+        }
+    }
+
+    printf("12 bit and 16 bit output match; %d vs %d bytes per line, %d vs %d per frame\n",
+           SCREEN_W * 3 / 2, SCREEN_W * 2, SCREEN_W * SCREEN_W * 3 / 2, SCREEN_W * SCREEN_W * 2);
+    return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * Check the filtered LCD scaling modes against a floating point reference,
+ * and time them against nearest neighbour.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/lcd_scale_check [output directory for PPM images]
+ *
+ * Builds full 240x240 frames from a set of 128x128 test images the way
+ * st7789_lcd.c does, for RGB565 and RGB444, with the interpolator's blend
+ * modelled in C. The golden frames come from the bilinear and sharp
+ * bilinear filters evaluated in double precision. Every panel pixel must
+ * be within MAX_ERROR of them, in 4 bit channel steps, and flat areas and
+ * source pixel centres must come out exact. Exits non-zero if not.
+ *
+ * The timings are for the host. They compare the modes with each other,
+ * together with the interpolator blends per frame, which is most of the
+ * extra work on the device; 's' on the USB console prints the real time
+ * per frame.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "lcd_pixel.h"
+#include "lcd_scale.h"
+
+#define RENDER_W    128
+#define RENDER_H    128
+#define SCREEN_W    240
+#define SCREEN_H    240
+#define FRAC_BITS   16
+#define SCALE_X     ((RENDER_W << FRAC_BITS) / SCREEN_W)
+#define SCALE_Y     ((RENDER_H << FRAC_BITS) / SCREEN_H)
+
+// In 4 bit channel steps: half a 1/16 weight step on each axis for a
+// difference of 15 (0.94), the second blend's truncation (1/16) and the
+// rounding to 4 bits for RGB444 (0.5)
+#define MAX_ERROR   1.5
+
+typedef struct { double r, g, b; } rgbf_t;
+
+static uint16_t image[RENDER_W * RENDER_H];
+static uint8_t frame[SCREEN_W * SCREEN_H * 2];
+static lcd_scale_tap_t x_taps[SCREEN_W], y_taps[SCREEN_H];
+static uint32_t blend_row[RENDER_W];
+static int blend_row_tap;
+static uint32_t blends;
+
+// interp0 in blend mode: base0 + (base1 - base0) * alpha / 256
+static uint32_t interp_blend(uint32_t a, uint32_t b, unsigned alpha) {
+    blends++;
+    return a + (uint32_t)(((int64_t)b - a) * (alpha << 4) / 256);
+}
+
+static uint32_t blend_row_sample(lcd_scale_tap_t t) {
+    uint32_t v = blend_row[t.index];
+    return t.alpha ? interp_blend(v, blend_row[t.index + 1], t.alpha) : v;
+}
+
+// build_filtered_scanline() in st7789_lcd.c
+static void build_filtered(uint8_t *dest, int y, int bits) {
+    lcd_scale_tap_t ty = y_taps[y];
+    int key = ty.index << 8 | ty.alpha;
+    if (key != blend_row_tap) {
+        const uint16_t *row0 = &image[ty.index * RENDER_W];
+        const uint16_t *row1 = row0 + RENDER_W;
+        for (int x = 0; x < RENDER_W; x++)
+            blend_row[x] = ty.alpha ? interp_blend(lcd_rgb_spread(row0[x]), lcd_rgb_spread(row1[x]), ty.alpha)
+                                    : lcd_rgb_spread(row0[x]);
+        blend_row_tap = key;
+    }
+    if (bits == 16) {
+        for (int x = 0; x < SCREEN_W; x++) {
+            uint16_t rgb565 = lcd_spread_to_565(blend_row_sample(x_taps[x]));
+            dest[x * 2 + 0] = rgb565 >> 8;
+            dest[x * 2 + 1] = rgb565 & 0xFF;
+        }
+    } else {
+        for (int x = 0; x < SCREEN_W; x += 2) {
+            lcd_pack_rgb444(dest, lcd_spread_to_fb(blend_row_sample(x_taps[x])),
+                            lcd_spread_to_fb(blend_row_sample(x_taps[x + 1])));
+            dest += 3;
+        }
+    }
+}
+
+// build_scanline_from_buffer(), 16 bit
+static void build_nearest(uint8_t *dest, int y) {
+    const uint16_t *row = &image[((y * SCALE_Y) >> FRAC_BITS) * RENDER_W];
+    uint32_t accum = 0;
+    for (int x = 0; x < SCREEN_W; x++) {
+        uint16_t rgb565 = lcd_rgb565(row[accum >> FRAC_BITS]);
+        accum += SCALE_X;
+        dest[x * 2 + 0] = rgb565 >> 8;
+        dest[x * 2 + 1] = rgb565 & 0xFF;
+    }
+}
+
+static void build_frame(lcd_scale_t mode, int bits) {
+    int line_bytes = SCREEN_W * bits / 8;
+    blend_row_tap = -1;
+    for (int y = 0; y < SCREEN_H; y++) {
+        if (mode == LCD_SCALE_NEAREST) build_nearest(&frame[y * line_bytes], y);
+        else build_filtered(&frame[y * line_bytes], y, bits);
+    }
+}
+
+// Panel pixel (x, y) in 4 bit channel steps
+static rgbf_t decode(int x, int y, int bits) {
+    if (bits == 16) {
+        const uint8_t *p = &frame[(y * SCREEN_W + x) * 2];
+        uint16_t v = p[0] << 8 | p[1];
+        return (rgbf_t){ (v >> 11) / 2.0, ((v >> 5) & 0x3f) / 4.0, (v & 0x1f) / 2.0 };
+    }
+    const uint8_t *p = &frame[(y * SCREEN_W + (x & ~1)) * 3 / 2];
+    uint32_t v = p[0] << 16 | p[1] << 8 | p[2];
+    if (!(x & 1)) v >>= 12;
+    return (rgbf_t){ (v >> 8) & 0xf, (v >> 4) & 0xf, v & 0xf };
+}
+
+static rgbf_t source(int x, int y) {
+    uint16_t p = image[y * RENDER_W + x];
+    return (rgbf_t){ (p >> 4) & 0xf, p & 0xf, p >> 12 };
+}
+
+// Source position and weight for output pixel x, as in lcd_scale.h
+static void reference_tap(int x, int src, int dst, lcd_scale_t mode, int *index, double *w) {
+    double t = (x + 0.5) * src / dst;
+    if (mode == LCD_SCALE_SHARP) {
+        double range = 0.5 - 0.5 * src / dst;
+        double d = t - floor(t) - 0.5;
+        t = floor(t) + (d - fmax(-range, fmin(range, d))) * dst / src + 0.5;
+    }
+    double u = fmin(fmax(t - 0.5, 0), src - 1);
+    *index = (int)floor(u);
+    *w = u - *index;
+}
+
+static rgbf_t lerp(rgbf_t a, rgbf_t b, double w) {
+    return (rgbf_t){ a.r + (b.r - a.r) * w, a.g + (b.g - a.g) * w, a.b + (b.b - a.b) * w };
+}
+
+static rgbf_t golden(int x, int y, lcd_scale_t mode) {
+    int ix, iy;
+    double wx, wy;
+    reference_tap(x, RENDER_W, SCREEN_W, mode, &ix, &wx);
+    reference_tap(y, RENDER_H, SCREEN_H, mode, &iy, &wy);
+    int ix1 = ix + (ix < RENDER_W - 1), iy1 = iy + (iy < RENDER_H - 1);
+    return lerp(lerp(source(ix, iy), source(ix1, iy), wx),
+                lerp(source(ix, iy1), source(ix1, iy1), wx), wy);
+}
+
+static uint32_t rng = 0x12345678;
+
+static uint16_t rand16(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static uint16_t pack(int r, int g, int b) {
+    return b << 12 | 0x0f00 | r << 4 | g;
+}
+
+typedef enum { IMG_FLAT, IMG_CHECKER, IMG_GRADIENT, IMG_SPRITES, IMG_NOISE, IMAGES } image_t;
+static const char *const image_names[IMAGES] = { "flat", "checker", "gradient", "sprites", "noise" };
+
+static void make_image(image_t which) {
+    for (int y = 0; y < RENDER_H; y++) {
+        for (int x = 0; x < RENDER_W; x++) {
+            uint16_t p;
+            switch (which) {
+            case IMG_FLAT: p = pack(9, 3, 12); break;
+            case IMG_CHECKER: p = (x ^ y) & 1 ? pack(15, 15, 15) : pack(0, 0, 0); break;
+            case IMG_GRADIENT: p = pack(x / 8, y / 8, (x + y) / 16); break;
+            case IMG_SPRITES:
+                // 8x8 tiles of solid colour with a one pixel outline
+                p = (x % 8 == 0 || y % 8 == 0) ? pack(0, 0, 0)
+                    : pack((x / 8) & 15, (y / 8) & 15, ((x / 8) ^ (y / 8)) & 15);
+                break;
+            default: p = rand16(); break;
+            }
+            image[y * RENDER_W + x] = p;
+        }
+    }
+}
+
+static void write_ppm(const char *dir, const char *name, int bits, lcd_scale_t mode, bool reference) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s-%s%s.ppm", dir, name, lcd_scale_names[mode],
+             reference ? "-golden" : bits == 12 ? "-444" : "");
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", SCREEN_W, SCREEN_H);
+    for (int y = 0; y < SCREEN_H; y++) {
+        for (int x = 0; x < SCREEN_W; x++) {
+            rgbf_t c = reference ? golden(x, y, mode) : decode(x, y, bits);
+            fputc((int)lround(c.r * 17), f);
+            fputc((int)lround(c.g * 17), f);
+            fputc((int)lround(c.b * 17), f);
+        }
+    }
+    fclose(f);
+}
+
+// Compares the frame against the golden one; returns the number of bad pixels
+static int compare(image_t img, lcd_scale_t mode, int bits) {
+    double worst = 0, total = 0;
+    int bad = 0;
+    for (int y = 0; y < SCREEN_H; y++) {
+        for (int x = 0; x < SCREEN_W; x++) {
+            rgbf_t got = decode(x, y, bits), want = golden(x, y, mode);
+            double err = fmax(fabs(got.r - want.r), fmax(fabs(got.g - want.g), fabs(got.b - want.b)));
+            total += err;
+            if (err > worst) worst = err;
+            // Flat areas and pixels sampling one source pixel must be exact
+            double limit = img == IMG_FLAT || (x_taps[x].alpha == 0 && y_taps[y].alpha == 0)
+                           ? 0 : MAX_ERROR;
+            if (err > limit + 1e-9) {
+                if (!bad)
+                    printf("  %s %s %d bit: pixel %d,%d off by %.2f\n", image_names[img],
+                           lcd_scale_names[mode], bits, x, y, err);
+                bad++;
+            }
+        }
+    }
+    printf("%-9s %-9s %2d bit: max error %.2f, mean %.3f%s\n", image_names[img],
+           lcd_scale_names[mode], bits, worst, total / (SCREEN_W * SCREEN_H), bad ? " FAIL" : "");
+    return bad;
+}
+
+static double frame_ns(lcd_scale_t mode) {
+    const int frames = 200;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < frames; i++) build_frame(mode, 16);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / frames;
+}
+
+int main(int argc, char **argv) {
+    const char *ppm_dir = argc > 1 ? argv[1] : NULL;
+    int bad = 0;
+
+    for (lcd_scale_t mode = LCD_SCALE_BILINEAR; mode < LCD_SCALE_MODES; mode++) {
+        lcd_scale_taps(x_taps, RENDER_W, SCREEN_W, mode);
+        lcd_scale_taps(y_taps, RENDER_H, SCREEN_H, mode);
+        int flat = 0;
+        for (int x = 0; x < SCREEN_W; x++) flat += x_taps[x].alpha == 0;
+        printf("%s: %d of %d columns sample a single source pixel\n",
+               lcd_scale_names[mode], flat, SCREEN_W);
+
+        for (image_t img = 0; img < IMAGES; img++) {
+            make_image(img);
+            for (int bits = 16; bits >= 12; bits -= 4) {
+                build_frame(mode, bits);
+                bad += compare(img, mode, bits);
+                if (ppm_dir) write_ppm(ppm_dir, image_names[img], bits, mode, false);
+            }
+            if (ppm_dir) write_ppm(ppm_dir, image_names[img], 16, mode, true);
+        }
+    }
+    if (ppm_dir) {
+        for (image_t img = 0; img < IMAGES; img++) {
+            make_image(img);
+            build_frame(LCD_SCALE_NEAREST, 16);
+            write_ppm(ppm_dir, image_names[img], 16, LCD_SCALE_NEAREST, false);
+        }
+    }
+
+    make_image(IMG_NOISE);
+    printf("\nHost time per 240x240 frame, RGB565:\n");
+    for (lcd_scale_t mode = LCD_SCALE_NEAREST; mode < LCD_SCALE_MODES; mode++) {
+        if (mode != LCD_SCALE_NEAREST) {
+            lcd_scale_taps(x_taps, RENDER_W, SCREEN_W, mode);
+            lcd_scale_taps(y_taps, RENDER_H, SCREEN_H, mode);
+        }
+        blends = 0;
+        build_frame(mode, 16);
+        uint32_t per_frame = blends;
+        printf("  %-9s %8.0f ns, %6u interpolator blends\n", lcd_scale_names[mode],
+               frame_ns(mode), per_frame);
+    }
+
+    if (bad) {
+        printf("%d pixels outside the limits\n", bad);
+        return 1;
+    }
+    printf("All frames match the golden images\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * Replay a recorded Lua allocation trace against lua_heap.c on the host.
+ *
+ * Record a trace on the device: press 'l' on the USB console, play the
+ * cartridge, press 'l' again and save the console log. Lines starting
+ * with '@' are the trace, everything else is skipped.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/lua_heap_bench console.log
+ *
+ * Prints the heap statistics at the point of peak usage and at the end,
+ * and the time per call for lua_heap and for the host's malloc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lua_heap.h"
+
+typedef enum { OP_ALLOC, OP_REALLOC, OP_FREE } op_kind_t;
+
+typedef struct {
+    uint8_t kind;
+    uint32_t old_id;        // object the call works on
+    uint32_t new_id;        // object it returns
+    uint32_t size;
+} op_t;
+
+static op_t* ops;
+static size_t op_count, op_cap;
+static uint32_t id_count;
+
+// Recorded device address -> object id of the live object there
+static struct { unsigned long addr; uint32_t id; } *live;
+static size_t live_cap;
+
+static size_t live_slot(unsigned long addr) {
+    size_t i = (addr * 0x9E3779B1u) & (live_cap - 1);
+    while (live[i].addr && live[i].addr != addr) i = (i + 1) & (live_cap - 1);
+    return i;
+}
+
+static uint32_t live_take(unsigned long addr) {
+    size_t i = live_slot(addr);
+    if (!live[i].addr) return 0;
+    uint32_t id = live[i].id;
+    // Backward shift delete keeps the probe chains intact
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & (live_cap - 1);
+        if (!live[j].addr) break;
+        size_t home = (live[j].addr * 0x9E3779B1u) & (live_cap - 1);
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            live[i] = live[j];
+            i = j;
+        }
+    }
+    live[i].addr = 0;
+    return id;
+}
+
+static void live_put(unsigned long addr, uint32_t id) {
+    size_t i = live_slot(addr);
+    live[i].addr = addr;
+    live[i].id = id;
+}
+
+static void add_op(op_kind_t kind, uint32_t old_id, uint32_t new_id, uint32_t size) {
+    if (op_count == op_cap) {
+        op_cap = op_cap ? op_cap * 2 : 4096;
+        ops = realloc(ops, op_cap * sizeof(*ops));
+    }
+    ops[op_count++] = (op_t){ kind, old_id, new_id, size };
+}
+
+// Turn the trace into operations on object ids, so it can be replayed
+// against any allocator
+static int load(FILE* f) {
+    live_cap = 1 << 20;
+    live = calloc(live_cap, sizeof(*live));
+    char line[128];
+    unsigned long a, b, size;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "@a %lx %lu", &a, &size) == 2) {
+            if (!a) continue;   // failed on the device
+            live_put(a, ++id_count);
+            add_op(OP_ALLOC, 0, id_count, size);
+        } else if (sscanf(line, "@r %lx %lx %lu", &a, &b, &size) == 3) {
+            uint32_t old_id = live_take(a);
+            if (!b) {
+                if (old_id) live_put(a, old_id);
+                continue;
+            }
+            live_put(b, ++id_count);
+            if (old_id) add_op(OP_REALLOC, old_id, id_count, size);
+            else add_op(OP_ALLOC, 0, id_count, size);   // allocated before recording began
+        } else if (sscanf(line, "@f %lx", &a) == 1) {
+            uint32_t id = live_take(a);
+            if (id) add_op(OP_FREE, id, 0, 0);
+        }
+    }
+    return op_count ? 0 : -1;
+}
+
+typedef struct {
+    void* (*realloc)(void*, size_t);
+    void (*free)(void*);
+} allocator_t;
+
+// Replays the trace; returns ns per call, or -1 if a call failed
+static double replay(const allocator_t* a, bool stats, lua_heap_stats_t* at_peak) {
+    void** ptrs = calloc(id_count + 1, sizeof(void*));
+    uint32_t peak = 0;
+    size_t failed = 0;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t i = 0; i < op_count; i++) {
+        const op_t* op = &ops[i];
+        switch (op->kind) {
+        case OP_ALLOC:
+            if (!(ptrs[op->new_id] = a->realloc(NULL, op->size))) failed++;
+            break;
+        case OP_REALLOC:
+            if (!(ptrs[op->new_id] = a->realloc(ptrs[op->old_id], op->size))) failed++;
+            ptrs[op->old_id] = NULL;
+            break;
+        case OP_FREE:
+            a->free(ptrs[op->old_id]);
+            ptrs[op->old_id] = NULL;
+            break;
+        }
+        if (stats) {
+            lua_heap_stats_t s;
+            lua_heap_stats(&s);
+            if (s.in_use > peak) {
+                peak = s.in_use;
+                *at_peak = s;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (uint32_t id = 1; id <= id_count; id++) a->free(ptrs[id]);
+    free(ptrs);
+    if (failed) {
+        printf("%zu calls failed\n", failed);
+        return -1;
+    }
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / op_count;
+}
+
+static void print_stats(const char* when, const lua_heap_stats_t* s) {
+    printf("%s: %u bytes in use, TLSF %u free in %u blocks, largest %u, "
+           "fragmentation %u.%u%%, %u pages free, %u fallbacks\n",
+           when, s->in_use, s->tlsf_free, s->tlsf_free_blocks, s->tlsf_largest,
+           s->fragmentation / 10, s->fragmentation % 10, s->pages_free, s->pool_fallbacks);
+}
+
+int main(int argc, char** argv) {
+    FILE* f = argc > 1 ? fopen(argv[1], "r") : stdin;
+    if (!f || load(f)) {
+        fprintf(stderr, "usage: %s <console log with a lua_heap trace>\n", argv[0]);
+        return 1;
+    }
+    printf("%zu calls on %u objects\n", op_count, id_count);
+
+    const allocator_t heap = { lua_heap_realloc, lua_heap_free };
+    const allocator_t host = { realloc, free };
+
+    lua_heap_stats_t at_peak = {0}, s;
+    lua_heap_reset();
+    replay(&heap, true, &at_peak);
+    print_stats("At peak", &at_peak);
+    lua_heap_reset();
+    double ns = replay(&heap, false, NULL);
+    lua_heap_stats(&s);
+    printf("Peak %u bytes, %u failed requests\n", s.peak_in_use, s.failures);
+    for (int c = 0; c < LUA_HEAP_CLASSES; c++) {
+        const lua_heap_class_stats_t* k = &s.classes[c];
+        printf("  %4u: peak %6u live, %8u allocs\n", k->size, k->peak_live, k->allocs);
+    }
+
+    double ns_host = replay(&host, false, NULL);
+    printf("lua_heap %.1f ns per call, host malloc %.1f ns per call\n", ns, ns_host);
+    return 0;
+}
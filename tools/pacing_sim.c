@@ -0,0 +1,217 @@
+/**
+ * Run the frame pacing of pacing.h on synthetic timing traces.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/pacing_sim
+ *
+ * Models the firmware's two cores and the audio DMA in microseconds. Core0
+ * runs the game loop: the game's logic for a frame, render_frame_handler()
+ * with pacing_frame() and a hold where it asks for one, then
+ * i2s_queue_samples() waiting while a buffer is still queued. Core1 sends a
+ * frame for its present time from when it is handed over. Each trace sets
+ * the logic and present time per frame; the clock starts just before
+ * time_us_32() wraps.
+ *
+ * Checks that no frame is handed over while core1 is still sending and no
+ * hold leaves less audio queued than PACING_AUDIO_MARGIN_US, and for each
+ * trace the rate it settles on and the counts it expects, then prints the
+ * statistics. Exits non-zero if any check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "pacing.h"
+
+#define TB_AUDIO_FRAME_SAMPLES  366
+#define I2S_SAMPLE_RATE         22000
+#define AUDIO_US    (TB_AUDIO_FRAME_SAMPLES * 1000000 / I2S_SAMPLE_RATE)
+#define COPY_US     200         // render_frame_handler()'s memcpy
+#define QUEUE_US    50          // i2s_queue_samples()'s conversion
+#define FRAMES      3600
+
+static uint32_t rng = 0x2545f491;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Uniform in [centre - spread, centre + spread]
+static uint32_t around(uint32_t centre, uint32_t spread) {
+    return spread ? centre - spread + rand32() % (2 * spread + 1) : centre;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t (*logic_us)(int frame);
+    uint32_t (*present_us)(int frame);
+    uint32_t rate_hz;           // at the end, 0 for either
+    int rate_changes;           // exactly, or -1 for any
+    uint32_t max_dropped;
+    uint32_t min_held, max_held;
+    uint32_t min_late;
+    uint32_t max_judder;
+    bool audio_clean;           // no underruns
+} trace_t;
+
+typedef struct {
+    pacing_t pacing;
+    uint32_t underruns;
+    uint32_t overwrites;        // frames handed over while core1 was busy
+    uint32_t margin_holds;      // holds that left less audio than the margin
+} result_t;
+
+static bool before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static void run(const trace_t *trace, result_t *r) {
+    uint32_t t = 0xfff00000;
+    // Audio DMA: when the buffer playing ends, and whether one is queued
+    bool dma_running = false, queued = false;
+    uint32_t dma_end = 0;
+    // Core1
+    uint32_t core1_done = t, core1_present = 0, sending_us = 0, handoff = 0;
+    bool sending = false;
+
+    pacing_init(&r->pacing);
+    r->underruns = r->overwrites = r->margin_holds = 0;
+
+    for (int frame = 0; frame < FRAMES; frame++) {
+        uint32_t start = t;
+        t += trace->logic_us(frame);
+
+        // The DMA moves on through the logic; with nothing queued it plays
+        // the fill buffer again
+        while (dma_running && !before(t, dma_end)) {
+            if (queued) queued = false;
+            else r->underruns++;
+            dma_end += AUDIO_US;
+        }
+        if (sending && !before(t, core1_done)) {
+            sending = false;
+            core1_present = sending_us;
+        }
+
+        // render_frame_handler()
+        pacing_input_t in = {
+            .now_us = t,
+            .logic_us = t - start,
+            .present_us = core1_present,
+            .busy = sending,
+            .busy_until_us = handoff + r->pacing.present_us,
+            .audio_us = dma_running ? dma_end - t + (queued ? AUDIO_US : 0) : 0,
+        };
+        pacing_action_t action = pacing_frame(&r->pacing, &in);
+        if (action == PACING_HOLD) {
+            uint32_t until = r->pacing.hold_until_us;
+            if (sending && !before(until, core1_done)) until = core1_done;
+            if (before(t, until)) t = until;
+            if (before(dma_end + (queued ? AUDIO_US : 0), t + PACING_AUDIO_MARGIN_US)) r->margin_holds++;
+            if (sending && !before(t, core1_done)) {
+                sending = false;
+                core1_present = sending_us;
+            }
+            action = pacing_held(&r->pacing, sending);
+        }
+        if (action == PACING_PRESENT) {
+            if (sending) r->overwrites++;
+            t += COPY_US;
+            handoff = t;
+            pacing_present(&r->pacing, handoff);
+            sending = true;
+            sending_us = trace->present_us(frame);
+            core1_done = handoff + sending_us;
+        }
+
+        // i2s_queue_samples(): wait while a buffer is queued
+        while (dma_running && !before(t, dma_end)) {
+            if (queued) queued = false;
+            else r->underruns++;
+            dma_end += AUDIO_US;
+        }
+        if (queued) {
+            t = dma_end;
+            dma_end += AUDIO_US;
+        }
+        t += QUEUE_US;
+        if (dma_running) {
+            queued = true;
+        } else {
+            dma_running = true;
+            dma_end = t + AUDIO_US;
+        }
+    }
+}
+
+static uint32_t logic_8ms(int frame) { (void)frame; return around(8000, 500); }
+static uint32_t logic_gc(int frame) { return frame % 100 == 99 ? 45000 : around(8000, 500); }
+static uint32_t logic_busy(int frame) { (void)frame; return around(16800, 600); }
+static uint32_t logic_slow(int frame) { (void)frame; return around(22000, 1000); }
+static uint32_t present_12ms(int frame) { (void)frame; return around(12000, 300); }
+static uint32_t present_20ms(int frame) { (void)frame; return around(20000, 300); }
+static uint32_t present_border(int frame) { (void)frame; return around(15500, 1500); }
+static uint32_t present_tight(int frame) { (void)frame; return around(16000, 1000); }
+static uint32_t present_recover(int frame) { return frame < FRAMES / 3 ? around(20000, 300) : around(10000, 300); }
+
+static const trace_t traces[] = {
+    // name             logic       present          Hz chg drop  held        late judder  clean audio
+    { "steady",         logic_8ms,  present_12ms,    60, 0, 0,    0, 0,       0,   2,      true },
+    { "heavy present",  logic_8ms,  present_20ms,    30, 1, 2,    0, 5,       0,   2,      true },
+    { "borderline",     logic_8ms,  present_border,  60, 0, 8,    1, FRAMES,  0,   40,     true },
+    { "gc spikes",      logic_gc,   present_12ms,    60, 0, 0,    0, 10,      20,  80,     false },
+    { "audio starved",  logic_busy, present_tight,   30, 1, 8,    0, 0,       0,   8,      false },
+    { "recovery",       logic_8ms,  present_recover, 60, 2, 2,    0, 5,       0,   4,      true },
+    { "slow game",      logic_slow, present_12ms,    30, 1, 2,    0, 5,       0,   FRAMES, false },
+};
+
+static int failures;
+
+static void check(bool ok, const char *trace, const char *what) {
+    if (!ok) {
+        printf("%s: %s\n", trace, what);
+        failures++;
+    }
+}
+
+int main(void) {
+    const int count = sizeof(traces) / sizeof(traces[0]);
+    static result_t results[sizeof(traces) / sizeof(traces[0])];
+
+    for (int i = 0; i < count; i++) {
+        const trace_t *tr = &traces[i];
+        result_t *r = &results[i];
+        const pacing_stats_t *s = &r->pacing.stats;
+        run(tr, r);
+
+        check(!r->overwrites, tr->name, "frame handed over while core1 was sending");
+        check(!r->margin_holds, tr->name, "hold ran into the audio margin");
+        check(s->frames == FRAMES, tr->name, "frames not counted");
+        check(s->presented + s->skipped + s->dropped == s->frames, tr->name, "frames not accounted for");
+        check(!tr->rate_hz || r->pacing.rate_hz == tr->rate_hz, tr->name, "wrong rate");
+        check(tr->rate_changes < 0 || (int)s->rate_changes == tr->rate_changes, tr->name,
+              "wrong number of rate changes");
+        check(s->dropped <= tr->max_dropped, tr->name, "too many dropped frames");
+        check(s->held >= tr->min_held && s->held <= tr->max_held, tr->name, "held frames out of range");
+        check(s->late >= tr->min_late, tr->name, "late frames not counted");
+        check(s->judder <= tr->max_judder, tr->name, "too much judder");
+        check(!tr->audio_clean || !r->underruns, tr->name, "audio underran");
+    }
+
+    printf("trace           Hz chg  presented  held  skipped  dropped  late  judder  deviation  underruns\n");
+    for (int i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+        const pacing_stats_t *s = &r->pacing.stats;
+        printf("%-15s %2u %3u  %9u %5u  %7u  %7u  %4u  %6u  %6lu us  %9u\n", traces[i].name,
+               (unsigned)r->pacing.rate_hz, (unsigned)s->rate_changes, (unsigned)s->presented,
+               (unsigned)s->held, (unsigned)s->skipped, (unsigned)s->dropped, (unsigned)s->late,
+               (unsigned)s->judder, (unsigned long)(s->intervals ? s->deviation_us / s->intervals : 0),
+               (unsigned)r->underruns);
+    }
+    if (failures) return 1;
+    printf("all traces pace as expected\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * Compare reading and writing a contiguous file through raw sector
+ * streams (f_raw_stream.h) with f_read() and f_write(), on a disk image
+ * with the SDIO timing preset.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/raw_stream_bench
+ *
+ * Preallocates a 4 MB file with f_expand() on a FAT32 image with 4 KB
+ * clusters, then moves it in 2 KB and 16 KB chunks both ways. Prints the
+ * card commands and modelled time of each and checks every byte read.
+ * Also checks that a fragmented file is refused with FR_DENIED. Exits
+ * non-zero if any check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "f_raw_stream.h"
+#include "sd_host.h"
+
+#define IMAGE       "raw_stream_bench.img"
+#define FILE_BYTES  (4 << 20)
+#define MAX_CHUNK   16384
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *message) {
+    if (!ok) {
+        printf("%s: %s\n", what, message);
+        failures++;
+    }
+}
+
+static uint8_t pattern(uint32_t i, uint32_t seed) {
+    return (uint8_t)((i * 2654435761u + seed * 40503u) >> 11);
+}
+
+// Word aligned, so SDIO would DMA straight into it
+static uint8_t buf[MAX_CHUNK] __attribute__((aligned(4)));
+
+static void fill(uint32_t at, uint32_t chunk, uint32_t seed) {
+    for (uint32_t i = 0; i < chunk; i++) buf[i] = pattern(at + i, seed);
+}
+
+static bool same(uint32_t at, uint32_t chunk, uint32_t seed) {
+    for (uint32_t i = 0; i < chunk; i++)
+        if (buf[i] != pattern(at + i, seed)) return false;
+    return true;
+}
+
+static void start(void) {
+    sd_host_if.timing = SD_IMAGE_TIMING_SDIO;
+    sd_image_reset_stats(&sd_host_card);
+}
+
+static void report(const char *name, uint32_t chunk) {
+    sd_image_stats_t s = sd_image_stats(&sd_host_card);
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+    printf("%-10s %6lu  %8lu  %8.1f  %6.2f\n", name, (unsigned long)chunk,
+           (unsigned long)(s.read_cmds + s.write_cmds + s.sync_cmds), s.simulated_us / 1000.0,
+           FILE_BYTES / (double)s.simulated_us);
+}
+
+static void fatfs_write(FIL *f, uint32_t chunk, uint32_t seed) {
+    UINT bw;
+    f_lseek(f, 0);
+    start();
+    for (uint32_t at = 0; at < FILE_BYTES; at += chunk) {
+        fill(at, chunk, seed);
+        if (f_write(f, buf, chunk, &bw) != FR_OK || bw != chunk) {
+            check(false, "f_write", "write failed");
+            break;
+        }
+    }
+    check(f_sync(f) == FR_OK, "f_write", "sync failed");
+    report("f_write", chunk);
+}
+
+static void fatfs_read(FIL *f, uint32_t chunk, uint32_t seed) {
+    UINT br;
+    f_lseek(f, 0);
+    start();
+    for (uint32_t at = 0; at < FILE_BYTES; at += chunk) {
+        if (f_read(f, buf, chunk, &br) != FR_OK || br != chunk || !same(at, chunk, seed)) {
+            check(false, "f_read", "data read back differs");
+            break;
+        }
+    }
+    report("f_read", chunk);
+}
+
+static void raw_write(f_raw_stream_t *rs, uint32_t chunk, uint32_t seed) {
+    UINT n;
+    f_raw_stream_seek(rs, 0);
+    start();
+    for (uint32_t at = 0; at < FILE_BYTES; at += chunk) {
+        fill(at, chunk, seed);
+        if (f_raw_stream_write(rs, buf, chunk / FF_MIN_SS, &n) != FR_OK || n != chunk / FF_MIN_SS) {
+            check(false, "raw write", "write failed");
+            break;
+        }
+    }
+    // Closes the open multi-block write
+    check(disk_ioctl(rs->pdrv, CTRL_SYNC, NULL) == RES_OK, "raw write", "sync failed");
+    report("raw write", chunk);
+}
+
+static void raw_read(f_raw_stream_t *rs, uint32_t chunk, uint32_t seed) {
+    UINT n;
+    f_raw_stream_seek(rs, 0);
+    start();
+    for (uint32_t at = 0; at < FILE_BYTES; at += chunk) {
+        if (f_raw_stream_read(rs, buf, chunk / FF_MIN_SS, &n) != FR_OK || n != chunk / FF_MIN_SS ||
+            !same(at, chunk, seed)) {
+            check(false, "raw read", "data read back differs");
+            break;
+        }
+    }
+    report("raw read", chunk);
+}
+
+static void check_fragmented(void) {
+    const char *what = "fragmented";
+    FIL f[2];
+    UINT bw;
+    f_raw_stream_t rs;
+    check(f_open(&f[0], "a.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK &&
+          f_open(&f[1], "b.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK, what, "cannot create the files");
+    // Clusters of the two files alternate
+    for (int n = 0; n < 8; n++)
+        for (int k = 0; k < 2; k++) {
+            fill(0, 4096, k);
+            f_write(&f[k], buf, 4096, &bw);
+            f_sync(&f[k]);
+        }
+    check(f_raw_stream_open(&f[0], &rs) == FR_DENIED, what, "fragmented file not refused");
+    f_close(&f[0]);
+    f_close(&f[1]);
+}
+
+int main(void) {
+    static const uint32_t chunks[] = { 2048, 16384 };
+    if (!sd_host_format(IMAGE, 512, FM_FAT32, 4096)) return 1;
+
+    FIL f;
+    f_raw_stream_t rs;
+    check(f_open(&f, "stream.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS) == FR_OK, "setup", "cannot create");
+    check(f_expand(&f, FILE_BYTES, 1) == FR_OK, "setup", "cannot preallocate");
+    check(f_raw_stream_open(&f, &rs) == FR_OK, "setup", "contiguous file refused");
+    if (failures) return 1;
+
+    printf("path        chunk  commands        ms    MB/s  (modelled, SDIO, 4 MB file)\n");
+    for (int k = 0; k < 2; k++) {
+        // Each written one way and read back the other, then the same
+        fatfs_write(&f, chunks[k], 2 * k);
+        raw_read(&rs, chunks[k], 2 * k);
+        fatfs_read(&f, chunks[k], 2 * k);
+        raw_write(&rs, chunks[k], 2 * k + 1);
+        fatfs_read(&f, chunks[k], 2 * k + 1);
+        raw_read(&rs, chunks[k], 2 * k + 1);
+    }
+    f_close(&f);
+    check_fragmented();
+
+    sd_host_unmount();
+    remove(IMAGE);
+    return failures ? 1 : 0;
+}
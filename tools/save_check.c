@@ -0,0 +1,244 @@
+/**
+ * Check the save data journal of save.c on a disk image, including
+ * recovery after power is lost part way through a commit.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/save_check
+ *
+ * Checks that a cartridge that only reads its save data gets no journal
+ * file and costs no card writes; that data written, committed and opened
+ * again reads back, also after the ring of SAVE_SLOTS records wraps; and
+ * that writes are coalesced into one record. For power loss it copies the
+ * journal after every save_poll() of a commit, puts each copy back, opens
+ * the journal again and expects the old data until the header sector has
+ * landed and the new data after. A record with a corrupt payload must
+ * fall back to the one before it. Then prints the modelled card time, with
+ * the SPI timing preset, of creating a journal, of the slowest
+ * save_poll() of a commit, and of writing the same data with f_write()
+ * and f_sync(). Exits non-zero if any check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "f_raw_stream.h"
+#include "save.h"
+#include "sd_host.h"
+
+#define IMAGE           "save_check.img"
+#define CART            "game.png"
+#define JOURNAL         SAVE_DIR "/game.sav"
+#define SLOT_SECTORS    (1 + SAVE_DATA_SIZE / FF_MIN_SS)
+#define JOURNAL_SECTORS (SAVE_SLOTS * SLOT_SECTORS)
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *message) {
+    if (!ok) {
+        printf("%s: %s\n", what, message);
+        failures++;
+    }
+}
+
+static uint8_t pattern(uint32_t i, uint32_t seed) {
+    return (uint8_t)((i * 2654435761u + seed * 40503u) >> 11);
+}
+
+static uint8_t data[SAVE_DATA_SIZE];
+
+static void write_all(uint32_t seed, uint32_t now_ms) {
+    for (uint32_t i = 0; i < SAVE_DATA_SIZE; i++) data[i] = pattern(i, seed);
+    save_write(0, data, SAVE_DATA_SIZE, now_ms);
+}
+
+// The save data as save_read() gives it is that of seed
+static bool holds(uint32_t seed) {
+    if (save_read(0, data, SAVE_DATA_SIZE) != SAVE_DATA_SIZE) return false;
+    for (uint32_t i = 0; i < SAVE_DATA_SIZE; i++)
+        if (data[i] != pattern(i, seed)) return false;
+    return true;
+}
+
+static bool blank(void) {
+    save_read(0, data, SAVE_DATA_SIZE);
+    for (uint32_t i = 0; i < SAVE_DATA_SIZE; i++)
+        if (data[i]) return false;
+    return true;
+}
+
+// Lose the RAM copy as a power cut would, and open the cartridge again
+static void reboot(void) {
+    save_discard();
+    save_open(CART);
+}
+
+static bool journal_exists(void) {
+    FILINFO fno;
+    return f_stat(JOURNAL, &fno) == FR_OK;
+}
+
+static LBA_t journal_lba(void) {
+    FIL f;
+    f_raw_stream_t rs = { 0 };
+    if (f_open(&f, JOURNAL, FA_READ) != FR_OK) return 0;
+    if (f_raw_stream_open(&f, &rs) != FR_OK) rs.lba = 0;
+    f_close(&f);
+    return rs.lba;
+}
+
+static uint8_t snapshots[SLOT_SECTORS + 1][JOURNAL_SECTORS * FF_MIN_SS];
+
+static void check_lazy(void) {
+    const char *what = "read only";
+    sd_image_reset_stats(&sd_host_card);
+    save_open(CART);
+    check(blank(), what, "save data of a new cartridge not blank");
+    for (uint32_t t = 0; t < 5000; t += 16) save_poll(t);
+    save_close();
+    check(!journal_exists(), what, "journal created without a write");
+    check(sd_image_stats(&sd_host_card).write_cmds == 0, what, "card written without a write");
+}
+
+static void check_round_trip(void) {
+    const char *what = "round trip";
+    save_open(CART);
+    write_all(1, 0);
+    check(journal_exists(), what, "first write did not create the journal");
+    save_close();
+    save_open(CART);
+    check(holds(1), what, "flushed data did not read back");
+
+    // Coalesced: the last of a burst of writes goes in one record
+    uint32_t t = 1000;
+    for (int n = 0; n < 10; n++, t += 16) {
+        write_all(100 + n, t);
+        save_poll(t);
+    }
+    sd_image_reset_stats(&sd_host_card);
+    for (uint32_t end = t + SAVE_COALESCE_MS + 200; t < end; t += 16) save_poll(t);
+    check(sd_image_stats(&sd_host_card).blocks_written == SLOT_SECTORS, what, "burst not one record");
+    reboot();
+    check(holds(109), what, "polled commit did not read back");
+
+    // Past the end of the ring
+    for (int n = 0; n < SAVE_SLOTS + 6; n++) {
+        write_all(200 + n, t);
+        save_flush();
+    }
+    reboot();
+    check(holds(200 + SAVE_SLOTS + 5), what, "newest record lost after the ring wrapped");
+    save_close();
+}
+
+static void check_power_loss(void) {
+    const char *what = "power loss";
+    save_open(CART);
+    write_all(7, 0);
+    save_flush();
+    LBA_t lba = journal_lba();
+    check(lba != 0, what, "journal not contiguous");
+
+    // Copy the journal before the commit and after each slice of it
+    write_all(8, 10000);
+    int steps = 0;
+    disk_read(0, snapshots[steps++], lba, JOURNAL_SECTORS);
+    sd_image_reset_stats(&sd_host_card);
+    for (uint32_t t = 10000; t < 20000 && steps <= SLOT_SECTORS; t += 16) {
+        uint32_t written = sd_image_stats(&sd_host_card).blocks_written;
+        save_poll(t);
+        if (sd_image_stats(&sd_host_card).blocks_written != written)
+            disk_read(0, snapshots[steps++], lba, JOURNAL_SECTORS);
+    }
+    check(steps == SLOT_SECTORS + 1, what, "commit not one sector per poll");
+
+    for (int k = 0; k < steps; k++) {
+        disk_write(0, snapshots[k], lba, JOURNAL_SECTORS);
+        reboot();
+        // The header goes last, so only the final step shows the new data
+        check(holds(k == steps - 1 ? 8 : 7), what,
+              k == steps - 1 ? "committed record not recovered" : "torn record recovered or old one lost");
+    }
+    save_close();
+}
+
+static void check_corrupt(void) {
+    const char *what = "corrupt";
+    save_open(CART);
+    write_all(21, 0);
+    save_flush();
+    write_all(22, 0);
+    save_flush();
+    save_close();
+
+    // Flip a payload byte of the newest record
+    LBA_t lba = journal_lba();
+    static uint8_t sector[FF_MIN_SS];
+    uint32_t seq = 0, newest = 0;
+    for (uint32_t slot = 0; slot < SAVE_SLOTS; slot++) {
+        disk_read(0, sector, lba + slot * SLOT_SECTORS, 1);
+        uint32_t s;
+        memcpy(&s, sector + 4, 4);
+        if (s > seq) {
+            seq = s;
+            newest = slot;
+        }
+    }
+    LBA_t payload = lba + newest * SLOT_SECTORS + 2;
+    disk_read(0, sector, payload, 1);
+    sector[100] ^= 0x40;
+    disk_write(0, sector, payload, 1);
+
+    save_open(CART);
+    check(holds(21), what, "did not fall back to the record before the corrupt one");
+    save_close();
+}
+
+static void timing(void) {
+    sd_host_if.timing = SD_IMAGE_TIMING_SPI;
+    save_open("other.png");
+    sd_image_reset_stats(&sd_host_card);
+    write_all(31, 0);
+    uint64_t create_us = sd_image_stats(&sd_host_card).simulated_us;
+
+    uint64_t worst_us = 0;
+    write_all(32, 1000);
+    for (uint32_t t = 1000; t < 2000; t += 16) {
+        sd_image_reset_stats(&sd_host_card);
+        save_poll(t);
+        uint64_t us = sd_image_stats(&sd_host_card).simulated_us;
+        if (us > worst_us) worst_us = us;
+    }
+    save_close();
+
+    FIL f;
+    UINT bw;
+    f_open(&f, "plain.sav", FA_WRITE | FA_CREATE_ALWAYS);
+    f_write(&f, data, SAVE_DATA_SIZE, &bw);
+    f_sync(&f);
+    f_lseek(&f, 0);
+    sd_image_reset_stats(&sd_host_card);
+    f_write(&f, data, SAVE_DATA_SIZE, &bw);
+    f_sync(&f);
+    uint64_t plain_us = sd_image_stats(&sd_host_card).simulated_us;
+    f_close(&f);
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+
+    printf("SPI timing (modelled): creating a journal %.1f ms, slowest poll of a commit %.2f ms,\n"
+           "f_write() and f_sync() of the same %d bytes %.2f ms\n",
+           create_us / 1000.0, worst_us / 1000.0, SAVE_DATA_SIZE, plain_us / 1000.0);
+}
+
+int main(void) {
+    if (!sd_host_format(IMAGE, 512, FM_FAT32, 4096)) return 1;
+    check_lazy();
+    check_round_trip();
+    check_power_loss();
+    check_corrupt();
+
+    if (!failures) printf("no journal without a write, every step of a commit recovers old or new data\n");
+    timing();
+
+    sd_host_unmount();
+    remove(IMAGE);
+    return failures ? 1 : 0;
+}
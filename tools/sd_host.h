@@ -0,0 +1,68 @@
+/**
+ * The SD card of the host programs that run the SD card / FatFs stack on
+ * a disk image (sd_image_host, see no-OS-FatFS-SD-SDIO-SPI-RPi-Pico/host).
+ *
+ * Defines sd_get_num() and sd_get_by_num() the way hw_config.c does on the
+ * device, with one SD_IF_IMAGE card, so include it in one source file of a
+ * program. Images are created in the current directory, which is the build
+ * directory under ctest.
+ */
+
+#ifndef SD_HOST_H
+#define SD_HOST_H
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "hw_config.h"
+#include "Image/sd_card_image.h"
+#include "diskio.h"
+#include "ff.h"
+#include "f_util.h"
+
+static sd_image_if_t sd_host_if = { .timing = SD_IMAGE_TIMING_NONE };
+static sd_card_t sd_host_card = { .type = SD_IF_IMAGE, .image_if_p = &sd_host_if };
+
+size_t sd_get_num() { return 1; }
+sd_card_t *sd_get_by_num(size_t num) { return num ? NULL : &sd_host_card; }
+
+static bool sd_host_mount(void) {
+    FRESULT fr = f_mount(&sd_host_card.state.fatfs, "", 1);
+    if (fr != FR_OK) printf("f_mount(%s): %s (%d)\n", sd_host_if.path, FRESULT_str(fr), fr);
+    return fr == FR_OK;
+}
+
+// Unmount and power the card down, so the next mount reads everything
+// from the image again
+static void sd_host_unmount(void) {
+    f_unmount("");
+    if (sd_host_card.deinit) sd_host_card.deinit(&sd_host_card);
+}
+
+// Make path a blank image of mb MB, format it as fmt (FM_FAT32, FM_EXFAT)
+// with clusters of cluster bytes, and mount it. Formatting costs no
+// modelled time; the timing is left as it was.
+static bool sd_host_format(const char *path, uint32_t mb, BYTE fmt, DWORD cluster) {
+    sd_host_unmount();
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)mb << 20) || close(fd)) {
+        printf("%s: cannot create the image\n", path);
+        return false;
+    }
+    sd_host_if.path = path;
+    sd_image_timing_t timing = sd_host_if.timing;
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+
+    static BYTE work[FF_MAX_SS * 8];
+    MKFS_PARM opt = { .fmt = fmt, .au_size = cluster };
+    FRESULT fr = f_mkfs("", &opt, work, sizeof(work));
+    sd_host_if.timing = timing;
+    if (fr != FR_OK) {
+        printf("f_mkfs(%s): %s (%d)\n", path, FRESULT_str(fr), fr);
+        return false;
+    }
+    return sd_host_mount();
+}
+
+#endif // SD_HOST_H
@@ -0,0 +1,162 @@
+/**
+ * Check the disk image block device of the SD card / FatFs stack
+ * (sd_driver/Image, built as sd_image_host) and its latency model.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/sd_image_check
+ *
+ * Formats FAT32 and exFAT images, writes files through FatFs in chunks of
+ * several sizes, remounts and reads them back, and checks every byte.
+ * Checks the modelled time of single commands against the timing preset:
+ * a read, a write, a write that carries on an open multi-block write, and
+ * a sync. Checks that an ejected card fails commands and needs
+ * initializing again. Then prints the modelled throughput of f_read() and
+ * f_write() with the SPI and SDIO presets. Exits non-zero if any check
+ * fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "sd_host.h"
+
+#define IMAGE       "sd_image_check.img"
+#define FILE_BYTES  (1 << 20)
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *message) {
+    if (!ok) {
+        printf("%s: %s\n", what, message);
+        failures++;
+    }
+}
+
+static uint8_t pattern(uint32_t i, uint32_t seed) {
+    return (uint8_t)((i * 2654435761u + seed) >> 13);
+}
+
+static uint8_t buf[16384] __attribute__((aligned(4)));
+
+static bool write_file(const char *path, uint32_t chunk, uint32_t seed) {
+    FIL f;
+    UINT bw;
+    if (f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return false;
+    for (uint32_t at = 0; at < FILE_BYTES; at += chunk) {
+        for (uint32_t i = 0; i < chunk; i++) buf[i] = pattern(at + i, seed);
+        if (f_write(&f, buf, chunk, &bw) != FR_OK || bw != chunk) return false;
+    }
+    return f_close(&f) == FR_OK;
+}
+
+static bool read_file(const char *path, uint32_t chunk, uint32_t seed) {
+    FIL f;
+    UINT br;
+    if (f_open(&f, path, FA_READ) != FR_OK) return false;
+    for (uint32_t at = 0; at < FILE_BYTES; at += chunk) {
+        if (f_read(&f, buf, chunk, &br) != FR_OK || br != chunk) return false;
+        for (uint32_t i = 0; i < chunk; i++)
+            if (buf[i] != pattern(at + i, seed)) return false;
+    }
+    return f_close(&f) == FR_OK;
+}
+
+static void check_files(const char *what, BYTE fmt) {
+    static const uint32_t chunks[] = { 100, 512, 4096, 16384 };
+    char path[32];
+    // FAT32 needs 65526 clusters
+    uint32_t mb = fmt == FM_FAT32 ? 512 : 64;
+    check(sd_host_format(IMAGE, mb, fmt, 4096), what, "cannot format and mount");
+    for (int k = 0; k < 4; k++) {
+        snprintf(path, sizeof(path), "file%d.bin", k);
+        check(write_file(path, chunks[k], k), what, "write failed");
+    }
+    // From the image, not the FatFs window
+    sd_host_unmount();
+    check(sd_host_mount(), what, "cannot mount again");
+    for (int k = 0; k < 4; k++) {
+        snprintf(path, sizeof(path), "file%d.bin", k);
+        check(read_file(path, chunks[k] == 100 ? 4096 : chunks[k], k), what, "data read back differs");
+    }
+}
+
+// The modelled time of one command, as sd_card_image.h describes it
+static uint64_t model_us(sd_image_timing_t t, bool cmd, uint32_t blocks, bool write) {
+    uint64_t ns = (cmd ? (uint64_t)t.cmd_latency_us * 1000 : 0) + (uint64_t)blocks * 512 * t.byte_latency_ns +
+                  (write ? (uint64_t)blocks * t.write_busy_us * 1000 : 0);
+    return ns / 1000;
+}
+
+static void check_timing(void) {
+    const char *what = "timing";
+    sd_image_timing_t t = SD_IMAGE_TIMING_SPI;
+    sd_host_if.timing = t;
+    LBA_t lba = 20000;
+
+    sd_image_reset_stats(&sd_host_card);
+    check(disk_read(0, buf, lba, 8) == RES_OK, what, "read failed");
+    sd_image_stats_t s = sd_image_stats(&sd_host_card);
+    check(s.read_cmds == 1 && s.blocks_read == 8, what, "read not counted");
+    check(s.simulated_us == model_us(t, true, 8, false), what, "read time differs from the model");
+
+    sd_image_reset_stats(&sd_host_card);
+    check(disk_write(0, buf, lba, 4) == RES_OK, what, "write failed");
+    uint64_t first = sd_image_stats(&sd_host_card).simulated_us;
+    check(first == model_us(t, true, 4, true), what, "write time differs from the model");
+    // Carries on the open multi-block write: no command
+    check(disk_write(0, buf, lba + 4, 4) == RES_OK, what, "write failed");
+    s = sd_image_stats(&sd_host_card);
+    check(s.write_cmds == 1 && s.simulated_us - first == model_us(t, false, 4, true), what,
+          "continued write paid for a command");
+    // Anything else closes it
+    check(disk_ioctl(0, CTRL_SYNC, NULL) == RES_OK, what, "sync failed");
+    check(disk_write(0, buf, lba + 8, 1) == RES_OK, what, "write failed");
+    check(sd_image_stats(&sd_host_card).write_cmds == 2, what, "write after a sync did not start a command");
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+}
+
+static void check_eject(void) {
+    const char *what = "eject";
+    sd_host_if.ejected = true;
+    check(disk_read(0, buf, 100, 1) != RES_OK, what, "read from an ejected card succeeded");
+    check(disk_status(0) & STA_NOINIT, what, "ejected card still initialized");
+    check(!sd_host_card.sd_test_com(&sd_host_card), what, "ejected card answers");
+    sd_host_if.ejected = false;
+    check(disk_read(0, buf, 100, 1) != RES_OK, what, "read without initializing again succeeded");
+    check(!(disk_initialize(0) & STA_NOINIT), what, "cannot initialize again");
+    check(disk_read(0, buf, 100, 1) == RES_OK, what, "read after initializing again failed");
+}
+
+static void throughput(const char *name, sd_image_timing_t timing) {
+    static const uint32_t chunks[] = { 512, 4096, 16384 };
+    for (int k = 0; k < 3; k++) {
+        sd_host_if.timing = timing;
+        sd_image_reset_stats(&sd_host_card);
+        write_file("speed.bin", chunks[k], 0);
+        sd_image_stats_t w = sd_image_stats(&sd_host_card);
+        sd_image_reset_stats(&sd_host_card);
+        read_file("speed.bin", chunks[k], 0);
+        sd_image_stats_t r = sd_image_stats(&sd_host_card);
+        printf("%-5s %6lu  %8lu %8.2f  %8lu %8.2f\n", name, (unsigned long)chunks[k],
+               (unsigned long)(w.read_cmds + w.write_cmds + w.sync_cmds), FILE_BYTES / (double)w.simulated_us,
+               (unsigned long)r.read_cmds, FILE_BYTES / (double)r.simulated_us);
+    }
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+}
+
+int main(void) {
+    check_files("FAT32", FM_FAT32);
+    check_timing();
+    check_eject();
+    check_files("exFAT", FM_EXFAT);
+    if (failures) return 1;
+    printf("files read back as written, command times as modelled\n\n");
+
+    check(sd_host_format(IMAGE, 512, FM_FAT32, 4096), "throughput", "cannot format and mount");
+    printf("timing chunk  write cmds   MB/s  read cmds   MB/s  (modelled, FAT32, 1 MB file)\n");
+    throughput("SPI", SD_IMAGE_TIMING_SPI);
+    throughput("SDIO", SD_IMAGE_TIMING_SDIO);
+    sd_host_unmount();
+    remove(IMAGE);
+    return failures ? 1 : 0;
+}
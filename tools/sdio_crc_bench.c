@@ -0,0 +1,151 @@
+/**
+ * Check the SDIO data checksum kernel of sdio_crc.c and time it against
+ * the one it replaced, for reads of 1 to 256 blocks.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/sdio_crc_bench [crc_us]
+ *
+ * The kernel must give the same 64 bits as the previous one (a 64-bit
+ * accumulator) and as a bit by bit CRC16 of each data line, on random
+ * blocks and on the all-ones block. Then prints, per block count, the time
+ * per block of both kernels on this machine, and the effective MB/s of a
+ * read on the SDIO bus (the SD_IMAGE_TIMING_SDIO preset) when every block
+ * is checked after the transfer ends, as rp2040_sdio_rx_poll() used to,
+ * and when each block is checked from the DMA interrupt as it arrives.
+ * The checksum time in that model is this machine's unless crc_us gives
+ * the microseconds per block measured on the device. Exits non-zero if
+ * any check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Image/sd_card_image.h"
+#include "SDIO/sdio_crc.h"
+
+#define BLOCK_WORDS 128         // SDIO_WORDS_PER_BLOCK
+#define MAX_BLOCKS  256         // SDIO_MAX_BLOCKS
+#define BYTES       (BLOCK_WORDS * 4)
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *message) {
+    if (!ok) {
+        printf("%s: %s\n", what, message);
+        failures++;
+    }
+}
+
+// The previous kernel, with one 64-bit accumulator
+__attribute__((optimize("Ofast")))
+static uint64_t crc_before(uint32_t *data, uint32_t num_words) {
+    uint64_t crc = 0;
+    uint32_t *end = data + num_words;
+    while (data < end) {
+        for (int unroll = 0; unroll < 4; unroll++) {
+            uint32_t data_in = __builtin_bswap32(*data++);
+            uint32_t data_out = crc >> 32;
+            crc <<= 32;
+            data_out ^= (data_out >> 16);
+            data_out ^= (data_in >> 16);
+            uint64_t xorred = data_out ^ data_in;
+            crc ^= xorred;
+            crc ^= xorred << (5 * 4);
+            crc ^= xorred << (12 * 4);
+        }
+    }
+    return crc;
+}
+
+// CRC16 (x^16 + x^12 + x^5 + 1) of each line on its own. The bytes go out in
+// memory order, high nibble first, with DAT0 in the low bit of each nibble.
+static uint64_t crc_bitwise(const uint32_t *data, uint32_t num_words) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint16_t crc[4] = {0};
+    for (uint32_t i = 0; i < num_words * 4; i++)
+        for (int half = 1; half >= 0; half--) {
+            uint8_t nibble = bytes[i] >> (half * 4) & 15;
+            for (int line = 0; line < 4; line++) {
+                bool bit = (nibble >> line & 1) ^ (crc[line] >> 15);
+                crc[line] = (uint16_t)(crc[line] << 1) ^ (bit ? 0x1021 : 0);
+            }
+        }
+    // Sent the same way: most significant bit of each line first
+    uint64_t out = 0;
+    for (int b = 15; b >= 0; b--)
+        for (int line = 3; line >= 0; line--) out = out << 1 | (crc[line] >> b & 1);
+    return out;
+}
+
+static uint32_t blocks[MAX_BLOCKS][BLOCK_WORDS];
+
+static void check_kernel(void) {
+    const char *what = "checksum";
+    srand(1);
+    for (int b = 0; b < MAX_BLOCKS; b++)
+        for (int w = 0; w < BLOCK_WORDS; w++) blocks[b][w] = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+    for (int w = 0; w < BLOCK_WORDS; w++) blocks[0][w] = 0xFFFFFFFF;
+    for (int b = 0; b < MAX_BLOCKS; b++) {
+        uint64_t crc = sdio_crc16_4bit_checksum(blocks[b], BLOCK_WORDS);
+        check(crc == crc_before(blocks[b], BLOCK_WORDS), what, "differs from the previous kernel");
+        check(crc == crc_bitwise(blocks[b], BLOCK_WORDS), what, "differs from the CRC16 of each line");
+    }
+    // Shorter than a block, as for the 64 byte status registers
+    check(sdio_crc16_4bit_checksum(blocks[1], 16) == crc_bitwise(blocks[1], 16), what,
+          "wrong for 16 words");
+}
+
+static double ns_since(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+// Keeps the timed calls from being optimized away
+static volatile uint64_t sink;
+
+// Time per block of checking n blocks
+static double time_kernel(uint64_t (*kernel)(uint32_t *, uint32_t), int n) {
+    int rounds = 200000 / n;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < rounds; r++)
+        for (int b = 0; b < n; b++) sink = kernel(blocks[b], BLOCK_WORDS);
+    return ns_since(&t0) / rounds / n;
+}
+
+// A read of n blocks: the command, then one block every block_us. With
+// per_block the checksum of each runs as it arrives, queued behind the
+// previous one; otherwise all of them run after the last.
+static double read_mb_s(int n, double crc_us, bool per_block) {
+    sd_image_timing_t t = SD_IMAGE_TIMING_SDIO;
+    double block_us = BYTES * t.byte_latency_ns / 1000.0;
+    double arrived = t.cmd_latency_us, done = 0;
+    for (int b = 0; b < n; b++) {
+        arrived += block_us;
+        if (per_block) done = (done > arrived ? done : arrived) + crc_us;
+    }
+    if (!per_block) done = arrived + n * crc_us;
+    return n * BYTES / done;
+}
+
+int main(int argc, char **argv) {
+    double device_us = argc > 1 ? atof(argv[1]) : 0;
+    check_kernel();
+
+    printf("blocks  ns per block (host)   read MB/s (SDIO, modelled)\n");
+    printf("        before    now         checked after   per block\n");
+    static const int counts[] = { 1, 8, 64, MAX_BLOCKS };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        int n = counts[i];
+        double before = time_kernel(crc_before, n);
+        double now = time_kernel(sdio_crc16_4bit_checksum, n);
+        printf("%6d  %6.0f  %6.0f         %8.2f        %8.2f\n", n, before, now,
+               read_mb_s(n, device_us ? device_us : before / 1000, false),
+               read_mb_s(n, device_us ? device_us : now / 1000, true));
+    }
+    if (failures) return 1;
+    printf("checksums match the previous kernel and the CRC16 of each line\n");
+    return 0;
+}
@@ -0,0 +1,213 @@
+/**
+ * Run the SD card hot-plug state machine of storage.c against disk
+ * images, pulling and inserting cards the way a player would.
+ *
+ *   cmake -S tools -B build-tools && cmake --build build-tools
+ *   build-tools/storage_check
+ *
+ * The frame loop is simulated at 60 Hz, without a card detect pin, so
+ * presence comes from probing the card. Checks that:
+ * - a probe while a raw sector stream has a multi-block write open (as
+ *   capture and the save journal leave it) keeps the card mounted, the
+ *   stream's data intact and the stream a single pre-erased write, where
+ *   probing with the write open would lose it;
+ * - pulling the card in the middle of loading a game unmounts it through
+ *   storage_io_error(), and the save journal is dropped, not written to
+ *   the next card;
+ * - an empty socket costs no card time;
+ * - a different card put in is mounted within a probe interval and the
+ *   settle time, with its own catalog.
+ * Then prints the modelled card time of a mount with the SPI timing
+ * preset. Exits non-zero if any check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "f_raw_stream.h"
+#include "save.h"
+#include "storage.h"
+#include "sd_host.h"
+
+#define IMAGE_A     "storage_check_a.img"
+#define IMAGE_B     "storage_check_b.img"
+#define FRAME_MS    16
+#define GAME_BYTES  8192
+#define STREAM_SECTORS (GAME_BYTES / FF_MIN_SS)
+
+static int failures;
+
+static void check(bool ok, const char *what, const char *message) {
+    if (!ok) {
+        printf("%s: %s\n", what, message);
+        failures++;
+    }
+}
+
+static uint8_t pattern(uint32_t i, uint32_t seed) {
+    return (uint8_t)((i * 2654435761u + seed * 40503u) >> 11);
+}
+
+static uint32_t now_ms;
+static uint8_t buf[GAME_BYTES] __attribute__((aligned(4)));
+
+static void frames(uint32_t ms) {
+    for (uint32_t end = now_ms + ms; now_ms < end; now_ms += FRAME_MS) {
+        storage_poll(now_ms);
+        save_poll(now_ms);
+    }
+}
+
+// Run frames until the state is reached; the time taken, or -1
+static int wait_for(storage_state_t state, uint32_t limit_ms) {
+    uint32_t start = now_ms;
+    while (storage_state() != state) {
+        if (now_ms - start > limit_ms) return -1;
+        storage_poll(now_ms);
+        now_ms += FRAME_MS;
+    }
+    return (int)(now_ms - start);
+}
+
+static bool make_card(const char *path, int games) {
+    if (!sd_host_format(path, 64, FM_EXFAT, 4096)) return false;
+    FIL f;
+    UINT bw;
+    char name[32];
+    for (int g = 0; g < games; g++) {
+        snprintf(name, sizeof(name), "game%d.png", g);
+        for (uint32_t i = 0; i < GAME_BYTES; i++) buf[i] = pattern(i, g);
+        if (f_open(&f, name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return false;
+        f_write(&f, buf, GAME_BYTES, &bw);
+        f_close(&f);
+    }
+    // Not a game
+    if (f_open(&f, "notes.txt", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return false;
+    f_write(&f, "hi", 2, &bw);
+    f_close(&f);
+    sd_host_unmount();
+    return true;
+}
+
+static void check_probe_while_streaming(void) {
+    const char *what = "probe while streaming";
+    FIL f;
+    f_raw_stream_t rs;
+    UINT n;
+    check(f_open(&f, "stream.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS) == FR_OK &&
+          f_expand(&f, GAME_BYTES, 1) == FR_OK && f_raw_stream_open(&f, &rs) == FR_OK,
+          what, "cannot set up the stream");
+    f_close(&f);
+
+    // Written a sector per frame, probed in between
+    uint32_t generation = storage_generation();
+    sd_image_reset_stats(&sd_host_card);
+    for (int s = 0; s < STREAM_SECTORS; s++) {
+        memset(buf, s + 1, FF_MIN_SS);
+        check(f_raw_stream_write(&rs, buf, 1, &n) == FR_OK && n == 1, what, "stream write failed");
+        frames(STORAGE_PROBE_MS / 4);
+    }
+    sd_image_stats_t s = sd_image_stats(&sd_host_card);
+    disk_ioctl(rs.pdrv, CTRL_SYNC, NULL);
+    check(storage_mounted() && storage_generation() == generation, what, "card unmounted by a probe");
+    check(s.write_cmds == 1 && s.pre_erase_cmds == 1 && s.pre_erase_blocks == STREAM_SECTORS, what,
+          "stream split by a probe");
+
+    f_raw_stream_seek(&rs, 0);
+    bool same = f_raw_stream_read(&rs, buf, STREAM_SECTORS, &n) == FR_OK && n == STREAM_SECTORS;
+    for (int s = 0; same && s < STREAM_SECTORS; s++)
+        same = buf[s * FF_MIN_SS] == s + 1 && buf[s * FF_MIN_SS + FF_MIN_SS - 1] == s + 1;
+    check(same, what, "stream data lost");
+
+    // What storage.c avoids: the card does not answer inside the write
+    f_raw_stream_seek(&rs, 0);
+    f_raw_stream_write(&rs, buf, 1, &n);
+    check(!sd_host_card.sd_test_com(&sd_host_card), what, "card answered inside a multi-block write");
+    check(wait_for(STORAGE_NO_CARD, 2 * STORAGE_PROBE_MS) >= 0, what, "card left for uninitialized stayed mounted");
+    check(wait_for(STORAGE_MOUNTED, STORAGE_PROBE_MS + STORAGE_SETTLE_MS + 100) >= 0, what, "not mounted again");
+}
+
+// The read loop of sd_gameload() in main.c, pulling the card after pull_at
+// bytes
+static FRESULT load_game(const char *name, uint32_t pull_at) {
+    FIL f;
+    UINT br;
+    FRESULT fr = f_open(&f, name, FA_READ);
+    if (fr != FR_OK) return fr;
+    for (uint32_t at = 0; at < GAME_BYTES; at += br) {
+        if (at >= pull_at) sd_host_if.ejected = true;
+        fr = f_read(&f, buf, 256, &br);
+        if (fr != FR_OK || br == 0) break;
+    }
+    f_close(&f);
+    return fr;
+}
+
+static void check_pull_mid_load(void) {
+    const char *what = "pulled mid-load";
+    // A save commit in flight when the card goes
+    save_open("game1.png");
+    save_write(0, "abc", 3, now_ms);
+    frames(SAVE_COALESCE_MS + FRAME_MS);
+
+    uint32_t generation = storage_generation();
+    FRESULT fr = load_game("game0.png", GAME_BYTES / 2);
+    check(fr == FR_DISK_ERR, what, "read from a pulled card did not fail");
+    storage_io_error(fr, now_ms);
+    check(storage_state() == STORAGE_NO_CARD, what, "read error did not unmount");
+    check(storage_generation() != generation && storage_game_count() == 0, what, "catalog not dropped");
+}
+
+static void check_empty(void) {
+    const char *what = "empty socket";
+    sd_host_if.timing = SD_IMAGE_TIMING_SPI;
+    sd_image_reset_stats(&sd_host_card);
+    frames(5000);
+    sd_image_stats_t s = sd_image_stats(&sd_host_card);
+    check(storage_state() == STORAGE_NO_CARD, what, "mounted with no card");
+    check(!s.read_cmds && !s.write_cmds && !s.simulated_us, what, "card time spent on an empty socket");
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+}
+
+static void check_insert_other(void) {
+    const char *what = "other card";
+    sd_host_if.path = IMAGE_B;
+    sd_host_if.timing = SD_IMAGE_TIMING_SPI;
+    sd_image_reset_stats(&sd_host_card);
+    sd_host_if.ejected = false;
+    int ms = wait_for(STORAGE_MOUNTED, STORAGE_PROBE_MS + STORAGE_SETTLE_MS + 2 * FRAME_MS);
+    sd_image_stats_t s = sd_image_stats(&sd_host_card);
+    sd_host_if.timing = SD_IMAGE_TIMING_NONE;
+    check(ms >= 0, what, "not mounted within a probe and the settle time");
+    check(storage_game_count() == 5, what, "catalog of the new card wrong");
+
+    // The journal of the pulled card stays dropped
+    sd_image_reset_stats(&sd_host_card);
+    frames(SAVE_MAX_DELAY_MS);
+    check(!sd_image_stats(&sd_host_card).blocks_written, what, "old save data written to the new card");
+    FILINFO fno;
+    check(f_stat(SAVE_DIR, &fno) != FR_OK, what, "old save journal created on the new card");
+
+    check(load_game("game4.png", GAME_BYTES) == FR_OK, what, "cannot load from the new card");
+    printf("mounted %d ms after insertion; mount %.1f ms of card time, %lu reads (SPI, modelled)\n", ms,
+           s.simulated_us / 1000.0, (unsigned long)s.read_cmds);
+}
+
+int main(void) {
+    if (!make_card(IMAGE_B, 5) || !make_card(IMAGE_A, 3)) return 1;
+
+    storage_init(now_ms);
+    check(storage_mounted() && storage_game_count() == 3, "boot", "card not mounted with its catalog");
+    check_probe_while_streaming();
+    check_pull_mid_load();
+    check_empty();
+    check_insert_other();
+
+    save_discard();
+    sd_host_unmount();
+    remove(IMAGE_A);
+    remove(IMAGE_B);
+    if (failures) return 1;
+    printf("probes leave open writes alone, pulls and swaps handled\n");
+    return 0;
+}